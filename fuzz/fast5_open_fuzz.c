@@ -0,0 +1,170 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_open_fuzz.c
+ * \brief     Fuzz target, file images through the open and the readers
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   libFuzzer entry point: each input is opened with fast5_open_mem() and
+   every read of it goes through the attribute, raw, events and FASTQ
+   readers. Built by configure --enable-fuzz, with clang (CC=clang) the
+   target links with -fsanitize=fuzzer, run it with a directory of
+   FAST5 files as the seed corpus:
+
+     fuzz/fast5_open_fuzz -max_len=1048576 CORPUS
+
+   With a compiler with no libFuzzer, FAST5_FUZZ_MAIN is defined and the
+   program runs the files given in the command line once, to replay a
+   crash or a corpus.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <hdf5.h>
+
+#include "fast5.h"
+
+/* Elements read from a dataset, the sizes come from the input */
+#define FUZZ_LEN_MAX (1 << 20)
+
+static void fuzz_read(struct fast5 * f5, struct fast5_reader * rd)
+{
+	struct fast5_events_info events_info;
+	struct fast5_channel_id channel_id;
+	struct fast5_basecall basecall;
+	struct fast5_raw raw_read;
+	struct fast5_dset_info ds_info;
+	struct fast5_dset * ds;
+	unsigned int strand;
+	int16_t raw[64];
+	size_t len;
+
+	fast5_channel_id(f5, &channel_id);
+
+	if (fast5_raw_read_info(f5, &raw_read) == 0) {
+		if ((len = raw_read.length) > FUZZ_LEN_MAX)
+			len = FUZZ_LEN_MAX;
+		fast5_reader_raw(rd, f5, len);
+		/* a range at the end, and one past it */
+		if (len >= 64)
+			fast5_raw_read_range(f5, raw, len - 64, 64);
+		fast5_raw_read_range(f5, raw, len, 1);
+	}
+
+	if ((ds = fast5_raw_open(f5)) != NULL) {
+		fast5_dset_info(ds, &ds_info);
+		if (fast5_dset_length(ds) > 0)
+			fast5_dset_read(ds, raw, 0, 1);
+		fast5_dset_close(ds);
+	}
+
+	if (fast5_events_info(f5, &events_info) == 0) {
+		if ((len = events_info.length) > FUZZ_LEN_MAX)
+			len = FUZZ_LEN_MAX;
+		fast5_reader_events(rd, f5, len);
+	}
+
+	for (strand = 0; strand < 3; ++strand) {
+		if (fast5_basecall_info(f5, strand, &basecall) == 0)
+			fast5_reader_fastq(rd, f5, strand, &len);
+	}
+}
+
+int LLVMFuzzerInitialize(int * argc, char *** argv)
+{
+	/* the HDF5 error stack of each rejected input is not of interest */
+	H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+	struct fast5_reader * rd;
+	struct fast5 * f5;
+	int cnt;
+	int i;
+
+	if (size == 0)
+		return 0;
+
+	if ((f5 = fast5_open_mem(data, size, 0)) == NULL)
+		return 0;
+
+	if ((rd = fast5_reader_new()) != NULL) {
+		cnt = fast5_read_count(f5);
+		for (i = 0; i < cnt; ++i) {
+			if (fast5_read_select(f5, i) < 0)
+				break;
+			fuzz_read(f5, rd);
+		}
+		fast5_reader_free(rd);
+	}
+
+	fast5_close(f5);
+
+	return 0;
+}
+
+#ifdef FAST5_FUZZ_MAIN
+int main(int argc, char * argv[])
+{
+	uint8_t * buf;
+	long size;
+	FILE * f;
+	int i;
+
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	for (i = 1; i < argc; ++i) {
+		if ((f = fopen(argv[i], "rb")) == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		if ((size < 0) || ((buf = malloc(size + 1)) == NULL)) {
+			fclose(f);
+			return 1;
+		}
+		if (fread(buf, 1, size, f) != (size_t)size) {
+			perror(argv[i]);
+			free(buf);
+			fclose(f);
+			return 1;
+		}
+		fclose(f);
+
+		printf("%s: %ld bytes\n", argv[i], size);
+		LLVMFuzzerTestOneInput(buf, size);
+		free(buf);
+	}
+
+	return 0;
+}
+#endif
@@ -37,6 +37,21 @@
 /* Opaque structures */
 struct fast5;
 
+/* Reusable read context */
+struct fast5_reader;
+
+/* Open dataset descriptor */
+struct fast5_dset;
+
+/* Sampled index over the events start column */
+struct fast5_event_index;
+
+/* Recursive directory walker */
+struct fast5_dir_iter;
+
+/* Bump allocator over large mappings */
+struct fast5_arena;
+
 struct fast5_info {
 	char filename[PATH_MAX];
 	struct {
@@ -83,6 +98,26 @@ struct fast5_events_info {
 	size_t length;
 };
 
+/* Info fields selection masks. Only the attributes and datasets needed 
+   by the selected fields are accessed. The dataset path is always 
+   filled in. */
+#define FAST5_F_DURATION      (1 << 0)
+#define FAST5_F_MEDIAN_BEFORE (1 << 1)
+#define FAST5_F_READ_ID       (1 << 2)
+#define FAST5_F_READ_NUMBER   (1 << 3)
+#define FAST5_F_SCALING_USED  (1 << 4)
+#define FAST5_F_START_MUX     (1 << 5)
+#define FAST5_F_START_TIME    (1 << 6)
+/* Opens the dataset */
+#define FAST5_F_LENGTH        (1 << 7)
+#define FAST5_F_ALL           0xffffffff
+
+#define FAST5_F_RAW_ATTRS (FAST5_F_DURATION | FAST5_F_MEDIAN_BEFORE | \
+						   FAST5_F_READ_ID | FAST5_F_READ_NUMBER | \
+						   FAST5_F_START_MUX | FAST5_F_START_TIME)
+
+#define FAST5_F_EVENTS_ATTRS (FAST5_F_RAW_ATTRS | FAST5_F_SCALING_USED)
+
 struct fast5_event {
 	int64_t start;
 	int64_t length;
@@ -91,12 +126,212 @@ struct fast5_event {
 	double variance;
 };
 
+#define FAST5_ANALYSIS_NAME_MAX 63
+
+/* An /Analyses group, e.g.: "Basecall_1D_001" is a "Basecall_1D" 
+   analysis, version 1. */
+struct fast5_analysis {
+	char name[FAST5_ANALYSIS_NAME_MAX + 1];
+	char type[FAST5_ANALYSIS_NAME_MAX + 1];
+	unsigned int version;
+	/* used by the accessors of this type */
+	bool selected;
+};
+
+/* Dataset storage layouts */
+#define FAST5_LAYOUT_COMPACT    0
+#define FAST5_LAYOUT_CONTIGUOUS 1
+#define FAST5_LAYOUT_CHUNKED    2
+
+/* Dataset filters */
+#define FAST5_FILTER_DEFLATE (1 << 0)
+#define FAST5_FILTER_SHUFFLE (1 << 1)
+#define FAST5_FILTER_OTHER   (1 << 7)
+
+/* Dataset descriptor info */
+struct fast5_dset_info {
+	char path[FAST5_OBJ_PATH_MAX + 1];
+	/* number of elements */
+	size_t length;
+	/* element size in the file */
+	size_t size;
+	/* the file type is the memory type, no conversion is made */
+	bool native;
+	unsigned int layout;
+	/* elements per chunk, 0 if not chunked */
+	size_t chunk;
+	unsigned int filters;
+	/* bytes allocated in the file */
+	uint64_t storage;
+	/* file offset of the data if contiguous, -1 otherwise */
+	int64_t offset;
+};
+
+/* Open pore trimming parameters */
+struct fast5_trim_opt {
+	/* samples per window */
+	unsigned int win;
+	/* windows in a row below the threshold */
+	unsigned int hold;
+	/* threshold, as a fraction of the open pore level */
+	double ratio;
+	/* samples searched */
+	size_t max;
+};
+
+/* Basecall strands */
+#define FAST5_STRAND_TEMPLATE   0
+#define FAST5_STRAND_COMPLEMENT 1
+#define FAST5_STRAND_2D         2
+
+/* Basecall results info */
+struct fast5_basecall {
+	/* BaseCalled_<strand> group */
+	char group[FAST5_OBJ_PATH_MAX + 1];
+	/* FASTQ record size, not including the terminating NUL. For fixed 
+	   length strings this is the storage size, an upper bound. */
+	size_t fastq_len;
+	/* move table entries */
+	size_t moves_len;
+	/* signal samples per move table entry, 0 if the moves are the "move" 
+	   field of the basecall events, one entry per event */
+	uint32_t stride;
+};
+
+/* Writer compression codecs */
+#define FAST5_CODEC_NONE            0
+#define FAST5_CODEC_DEFLATE         1
+#define FAST5_CODEC_SHUFFLE_DEFLATE 2
+
+/* Writer options */
+struct fast5_wr_opt {
+	/* Signal and events chunk size in elements. 0 stores the datasets 
+	   contiguous, which requires FAST5_CODEC_NONE. */
+	size_t chunk;
+	unsigned int codec;
+	/* deflate level (1..9) */
+	unsigned int level;
+	/* If not 0 the file image is built in memory, growing by this many 
+	   bytes at a time, and written out with a few large writes when the 
+	   file is closed. */
+	size_t bufsize;
+	/* Metadata aggregation block size, 0 for the HDF5 default. */
+	size_t meta_block;
+};
+
+/* Directory walker options */
+struct fast5_dir_opt {
+	/* file name extension, NULL for ".fast5", "" for any file */
+	const char * ext;
+	/* fast5_open_flags() flags */
+	unsigned int flags;
+	/* opened handles waiting for a consumer, 0 for the default (16) */
+	unsigned int queue;
+	/* Only open the part-th of every nparts matching files, so that 
+	   worker processes can share a tree. 0 nparts for all the files. */
+	unsigned int part;
+	unsigned int nparts;
+};
+
+/* Buffer allocator of the readers. alloc() returns size bytes aligned to
+   at least 64 bytes, or NULL. free() is given the size of the buffer. */
+struct fast5_allocator {
+	void * (* alloc)(void * arg, size_t size);
+	void (* free)(void * arg, void * ptr, size_t size);
+	void * arg;
+};
+
+/* fast5_arena_new() flags */
+#define FAST5_ARENA_HUGEPAGE    (1 << 0)
+#define FAST5_ARENA_FIRST_TOUCH (1 << 1)
+
+/* Library calls accounted by the performance counters */
+enum fast5_perf_call {
+	FAST5_PERF_OPEN = 0,
+	FAST5_PERF_CLOSE,
+	FAST5_PERF_RAW_INFO,
+	FAST5_PERF_RAW_READ,
+	FAST5_PERF_EVENTS_INFO,
+	FAST5_PERF_EVENTS_READ,
+	FAST5_PERF_CHANNEL_ID,
+	FAST5_PERF_FASTQ_READ,
+	FAST5_PERF_CALL_MAX
+};
+
+/* Performance counters snapshot */
+struct fast5_perf {
+	struct {
+		uint64_t count;
+		uint64_t ns;
+	} call[FAST5_PERF_CALL_MAX];
+	/* bytes delivered by the raw and events reads */
+	uint64_t bytes_read;
+	/* HDF5 handles (files, groups, datasets, attributes, types, spaces) */
+	uint64_t h5_open;
+	uint64_t h5_close;
+	/* memory allocations made by the library */
+	uint64_t alloc;
+	uint64_t alloc_bytes;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* 
+ * Error codes. The int returning calls return 0 or one of these. The
+ * calls returning a pointer return NULL, fast5_error() then returns the 
+ * code of the last error of the calling thread.
+ */
+#define FAST5_OK          0
+#define FAST5_ERR_HDF5   -1 /* HDF5 call failed */
+#define FAST5_ERR_NOMEM  -2 /* out of memory */
+#define FAST5_ERR_FORMAT -3 /* not a FAST5 file, or malformed */
+#define FAST5_ERR_NOENT  -4 /* no such group, dataset or read */
+#define FAST5_ERR_RANGE  -5 /* out of range read or index */
+#define FAST5_ERR_NAME   -6 /* object name too long */
+#define FAST5_ERR_INVAL  -7 /* invalid argument */
+#define FAST5_ERR_IO     -8 /* system I/O error */
+
+int fast5_error(void);
+
+const char * fast5_strerror(int err);
+
+/* 
+ * Threads. The library calls HDF5, which can be called from several 
+ * threads only if it was built thread safe (H5_HAVE_THREADSAFE). Such a 
+ * build takes one lock for every HDF5 call of a process: the calls of 
+ * all its threads are serialized, they never run in parallel. Processes 
+ * don't share that lock, the tools run their parallel jobs as worker 
+ * processes. Without thread safety a single thread at a time may use 
+ * the library.
+ */
+
+/* fast5_open_flags() flags */
+
+/* Don't validate the file on open. The root attributes and groups are 
+   looked up (once) when an accessor first needs them. */
+#define FAST5_LAZY (1 << 0)
+
 struct fast5 * fast5_open(const char * path);
 
+struct fast5 * fast5_open_flags(const char * path, unsigned int flags);
+
+/* 
+ * Cheap FAST5 check, without the HDF5 library. Looks for the HDF5 
+ * superblock and the root "file_version" attribute with a few small 
+ * reads. Returns FAST5_ERR_FORMAT if the file is certainly not a FAST5 
+ * file, 0 otherwise. fast5_open() does the check before opening.
+ */
+int fast5_sniff(const char * path);
+
+int fast5_sniff_mem(const void * buf, size_t len);
+
+/* Open a file image held in memory. The image is copied, the buffer can
+   be released after the call. fast5_raw_map() always copies. */
+struct fast5 * fast5_open_mem(const void * buf, size_t len, 
+							  unsigned int flags);
+
 int fast5_close(struct fast5 * f5);
 
 int fast5_info(struct fast5 * f5, struct fast5_info * info);
@@ -105,15 +340,244 @@ int fast5_stats(struct fast5 * f5);
 		
 int fast5_raw_read_info(struct fast5 * f5, struct fast5_raw * info);
 
+int fast5_raw_read_info_mask(struct fast5 * f5, struct fast5_raw * info,
+							 unsigned int mask);
+
 int fast5_raw_read(struct fast5 * f5, int16_t * raw, size_t len);
 
+/* 
+ * Dataset descriptors. fast5_raw_open() and fast5_events_open() open the
+ * Signal or Events dataset of the selected read once, the length is read
+ * at open, the layout and storage by the first fast5_dset_info() call.
+ * fast5_raw_read_range() doesn't allocate a descriptor, it is the cheaper
+ * way to read a signal once. fast5_dset_read() reads int16_t samples or 
+ * struct fast5_event records, from element start; record fields missing 
+ * in the file are left untouched. The descriptor must be closed before 
+ * the file.
+ */
+struct fast5_dset * fast5_raw_open(struct fast5 * f5);
+
+struct fast5_dset * fast5_events_open(struct fast5 * f5);
+
+int fast5_dset_info(struct fast5_dset * ds, struct fast5_dset_info * info);
+
+size_t fast5_dset_length(struct fast5_dset * ds);
+
+int fast5_dset_read(struct fast5_dset * ds, void * buf, size_t start, 
+					size_t len);
+
+int fast5_dset_close(struct fast5_dset * ds);
+
+/* Read len samples of the raw signal starting at sample start */
+int fast5_raw_read_range(struct fast5 * f5, int16_t * raw, size_t start,
+						 size_t len);
+
+/* 
+ * Zero-copy access to the raw signal of the selected read. If the Signal 
+ * dataset is stored contiguous, unfiltered and in the native byte order 
+ * the returned pointer points straight into a read-only mapping of the 
+ * file, otherwise the signal is read into a buffer owned by the handle. 
+ * The pointer is valid until fast5_raw_unmap(), the next fast5_raw_map() 
+ * or fast5_close().
+ */
+const int16_t * fast5_raw_map(struct fast5 * f5, size_t * len);
+
+int fast5_raw_unmap(struct fast5 * f5);
+
+/* 
+ * Find the start of the strand signal. The signal is split in windows 
+ * and the strand starts with the first run of opt->hold windows whose 
+ * mean is below opt->ratio times the open pore level (median_before). 
+ * fast5_trim_detect() returns the offset of the first strand sample, or 
+ * len if there is none. fast5_raw_trim() reads at most opt->max samples 
+ * of the selected read and takes the open pore level from median_before 
+ * and the channel calibration, the offset is 0 if the level is unknown. 
+ * A NULL opt uses the defaults: 40 samples windows, 5 windows, 0.8, 
+ * 40000 samples.
+ */
+size_t fast5_trim_detect(const int16_t * raw, size_t len, double level,
+						 const struct fast5_trim_opt * opt);
+
+int fast5_raw_trim(struct fast5 * f5, const struct fast5_trim_opt * opt,
+				   size_t * offset);
+
 int fast5_events_info(struct fast5 * f5, struct fast5_events_info * info);
 
+int fast5_events_info_mask(struct fast5 * f5, 
+						   struct fast5_events_info * info, unsigned int mask);
+
 int fast5_events_read(struct fast5 * f5, struct fast5_event * event, 
 					  size_t len);
 
+/* Read len events starting at event offset */
+int fast5_events_read_range(struct fast5 * f5, struct fast5_event * event, 
+							size_t offset, size_t len);
+
+/* 
+ * Event to signal alignment. The index keeps the start of every step-th 
+ * event of the selected read (step 0 for the default of 64), read in one
+ * strided pass, and the events dataset open; a lookup reads a single 
+ * block of step events. fast5_event_index_lookup() returns the index of
+ * the event covering sample, in the units of the events start field, or
+ * -1 if no event covers it. The index must be freed before the file is 
+ * closed.
+ */
+struct fast5_event_index * fast5_event_index_new(struct fast5 * f5, 
+												 unsigned int step);
+
+int fast5_event_index_free(struct fast5_event_index * idx);
+
+long fast5_event_index_lookup(struct fast5_event_index * idx, 
+							  int64_t sample);
+
 int fast5_channel_id(struct fast5 * f5, struct fast5_channel_id * info);
 
+/* 
+ * Analyses. The /Analyses group is listed once per handle, when first 
+ * needed. For each analysis type the highest version is selected unless 
+ * another one is selected by name. fast5_analysis_select_latest() 
+ * restores the default for one type, or all types if type is NULL.
+ */
+int fast5_analysis_count(struct fast5 * f5);
+
+int fast5_analysis_get(struct fast5 * f5, unsigned int idx, 
+					   struct fast5_analysis * an);
+
+int fast5_analysis_select(struct fast5 * f5, const char * name);
+
+int fast5_analysis_select_latest(struct fast5 * f5, const char * type);
+
+/* 
+ * Basecall results, from the selected Basecall_1D analysis or, failing 
+ * that, the selected Basecall_2D one. fast5_fastq_read() reads at most 
+ * size - 1 characters of the FASTQ record and returns its length.
+ */
+int fast5_basecall_info(struct fast5 * f5, unsigned int strand, 
+						struct fast5_basecall * info);
+
+int fast5_fastq_read(struct fast5 * f5, unsigned int strand, 
+					 char * buf, size_t size);
+
+int fast5_moves_read(struct fast5 * f5, unsigned int strand, 
+					 uint8_t * move, size_t len);
+
+/* Number of reads in the file, more than one for multi-read files */
+int fast5_read_count(struct fast5 * f5);
+
+/* Select the read used by the raw, events and channel accessors */
+int fast5_read_select(struct fast5 * f5, unsigned int idx);
+
+/* 
+ * Writer. fast5_raw_write() starts a new read group, so several calls 
+ * produce a multi-read file. The groups are named after the position of 
+ * the read in the file, the read number is only kept as an attribute: 
+ * reads of different channels can share it. fast5_events_write() and 
+ * fast5_channel_id_write() add to the last read written, in a file with 
+ * no raw reads each fast5_events_write() starts a new read. The handle 
+ * is released with fast5_close().
+ */
+struct fast5 * fast5_create(const char * path, 
+							const struct fast5_wr_opt * opt);
+
+int fast5_raw_write(struct fast5 * f5, const struct fast5_raw * info,
+					const int16_t * raw, size_t len);
+
+int fast5_events_write(struct fast5 * f5, 
+					   const struct fast5_events_info * info,
+					   const struct fast5_event * event, size_t len);
+
+int fast5_channel_id_write(struct fast5 * f5, 
+						   const struct fast5_channel_id * info);
+
+/* 
+ * Directory walker. A thread scans the tree under path, reading the 
+ * directories with large getdents64() batches, and opens the files whose 
+ * name ends with opt->ext and that pass fast5_sniff(). The 
+ * opened handles wait in a bounded queue, in path order (the entries of 
+ * each directory are sorted). fast5_dir_iter_next() can be called from 
+ * several consumer threads, each gets the next handle and copies its 
+ * path into path (if not NULL), it returns NULL at the end of the walk. 
+ * The handles are released by the consumer with fast5_close(). A NULL 
+ * opt uses the defaults.
+ * With an HDF5 library built without thread safety the walker thread 
+ * only sniffs the files, the consumers open them one at a time. The 
+ * calls on the returned handles are not serialized: use a single 
+ * consumer thread, or worker processes (opt->part).
+ */
+struct fast5_dir_iter * fast5_dir_iter_new(const char * path, 
+										   const struct fast5_dir_opt * opt);
+
+struct fast5 * fast5_dir_iter_next(struct fast5_dir_iter * it, 
+								   char * path, size_t size);
+
+/* Files skipped by the walk, not FAST5 or not readable */
+unsigned long fast5_dir_iter_skipped(struct fast5_dir_iter * it);
+
+int fast5_dir_iter_free(struct fast5_dir_iter * it);
+
+/* 
+ * A reader owns grow-only aligned buffers and the cached HDF5 memory 
+ * types. The returned pointers remain valid until the next call on the 
+ * same reader, so a stream of reads can be processed with no 
+ * allocations once the buffers reached the size of the largest read.
+ */
+struct fast5_reader * fast5_reader_new(void);
+
+/* A reader with its buffers taken from alloc, NULL for the default */
+struct fast5_reader * fast5_reader_new_alloc(const struct fast5_allocator * 
+											 alloc);
+
+int fast5_reader_free(struct fast5_reader * rd);
+
+int16_t * fast5_reader_raw(struct fast5_reader * rd, struct fast5 * f5,
+						   size_t len);
+
+struct fast5_event * fast5_reader_events(struct fast5_reader * rd, 
+										 struct fast5 * f5, size_t len);
+
+/* NUL terminated FASTQ record, its length is returned in len */
+char * fast5_reader_fastq(struct fast5_reader * rd, struct fast5 * f5,
+						  unsigned int strand, size_t * len);
+
+/* 
+ * Allocators. fast5_heap_allocator, the default, uses posix_memalign().
+ * 
+ * An arena hands out buffers from large mappings, chunk bytes each 
+ * (0 for 64 MiB), bigger buffers get a mapping of their own. Only the 
+ * last buffer of the current mapping is given back by free(), the 
+ * memory is released with the arena, so an arena fits bulk loads that 
+ * are dropped at once. An arena serves a single thread.
+ * 
+ * FAST5_ARENA_HUGEPAGE aligns the mappings to 2 MiB and asks for 
+ * transparent huge pages (MADV_HUGEPAGE), a full run in memory then 
+ * needs a fraction of the TLB entries. FAST5_ARENA_FIRST_TOUCH writes 
+ * every page of a new mapping from the calling thread, so with the 
+ * kernel's first touch policy the memory is placed on the NUMA node of 
+ * the worker that owns the arena, not of the thread that happens to 
+ * fill it first.
+ */
+extern const struct fast5_allocator fast5_heap_allocator;
+
+struct fast5_arena * fast5_arena_new(size_t chunk, unsigned int flags);
+
+const struct fast5_allocator * fast5_arena_allocator(struct fast5_arena * ar);
+
+/* Bytes mapped */
+size_t fast5_arena_size(struct fast5_arena * ar);
+
+int fast5_arena_free(struct fast5_arena * ar);
+
+/* 
+ * Take a snapshot of the process wide performance counters. Returns -1
+ * (and a zeroed snapshot) if the library was built without 
+ * --enable-perf.
+ */
+int fast5_perf_counters(struct fast5_perf * perf);
+
+void fast5_perf_reset(void);
+
+const char * fast5_perf_call_name(unsigned int call);
+
 #ifdef __cplusplus
 }
 #endif
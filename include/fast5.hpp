@@ -0,0 +1,494 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      fast5.hpp
+ * \brief     FAST5 library C++ interface
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   A header only C++17 layer over the C API. Each member function is an
+   inline call of the matching fast5_*() function, there is nothing to
+   link but libfast5.
+
+   - f5::file, f5::dset and f5::dir own a handle, they are move only
+     and release it in the destructor.
+   - Data is always read into caller memory, passed as a span (std::span
+     with C++20, a minimal f5::span otherwise). Nothing is copied to
+     an intermediate container.
+   - file::reads() iterates over the reads of a file, selecting each in
+     turn. file::raw_chunks() and file::event_chunks() read the selected
+     read one caller buffer at a time, as the loop advances.
+   - Errors throw f5::error, with the fast5_error() code.
+
+   Example:
+
+     std::vector<int16_t> buf(16384);
+     f5::file f(path);
+     for (unsigned int idx : f.reads())
+       for (auto chunk : f.raw_chunks(buf))
+         process(chunk);
+*/
+
+#ifndef __FAST5_HPP__
+#define __FAST5_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if (__cplusplus >= 202002L) && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#define FAST5_HAVE_STD_SPAN 1
+#endif
+#endif
+
+#include "fast5.h"
+
+namespace f5 {
+
+#ifdef FAST5_HAVE_STD_SPAN
+
+template <typename T>
+using span = std::span<T>;
+
+#else
+
+/* The subset of std::span used by this interface */
+template <typename T>
+class span {
+public:
+	using element_type = T;
+	using value_type = std::remove_cv_t<T>;
+	using size_type = std::size_t;
+	using pointer = T *;
+	using iterator = T *;
+
+	constexpr span() noexcept : ptr_(nullptr), len_(0) {}
+	constexpr span(T * ptr, std::size_t len) noexcept
+		: ptr_(ptr), len_(len) {}
+	template <std::size_t N>
+	constexpr span(T (&arr)[N]) noexcept : ptr_(arr), len_(N) {}
+	/* any contiguous container: std::vector, std::array... */
+	template <typename C, typename = std::enable_if_t<
+		std::is_convertible_v<decltype(std::declval<C &>().data()), T *>>>
+	constexpr span(C & c) noexcept : ptr_(c.data()), len_(c.size()) {}
+	/* span<const T> from span<T> */
+	template <typename U, typename = std::enable_if_t<
+		std::is_convertible_v<U (*)[], T (*)[]>>>
+	constexpr span(const span<U> & s) noexcept
+		: ptr_(s.data()), len_(s.size()) {}
+
+	constexpr T * data() const noexcept { return ptr_; }
+	constexpr std::size_t size() const noexcept { return len_; }
+	constexpr bool empty() const noexcept { return len_ == 0; }
+	constexpr T & operator[](std::size_t i) const noexcept { return ptr_[i]; }
+	constexpr T * begin() const noexcept { return ptr_; }
+	constexpr T * end() const noexcept { return ptr_ + len_; }
+	constexpr span first(std::size_t n) const noexcept {
+		return span(ptr_, n);
+	}
+	constexpr span subspan(std::size_t off) const noexcept {
+		return span(ptr_ + off, len_ - off);
+	}
+
+private:
+	T * ptr_;
+	std::size_t len_;
+};
+
+#endif
+
+/* A failed library call */
+class error : public std::runtime_error {
+public:
+	explicit error(int code)
+		: std::runtime_error(fast5_strerror(code)), code_(code) {}
+	error(int code, const std::string & what)
+		: std::runtime_error(what + ": " + fast5_strerror(code)),
+		  code_(code) {}
+
+	int code() const noexcept { return code_; }
+
+private:
+	int code_;
+};
+
+namespace detail {
+
+inline int check(int ret)
+{
+	if (ret < 0)
+		throw error(fast5_error() ? fast5_error() : ret);
+	return ret;
+}
+
+template <typename P>
+inline P * check(P * ptr)
+{
+	if (ptr == nullptr)
+		throw error(fast5_error());
+	return ptr;
+}
+
+} /* namespace detail */
+
+/* An open dataset of the selected read, see fast5_raw_open() */
+template <typename T>
+class dset {
+public:
+	explicit dset(struct fast5_dset * ds) noexcept : ds_(ds) {}
+	dset(dset && o) noexcept : ds_(std::exchange(o.ds_, nullptr)) {}
+	dset & operator=(dset && o) noexcept {
+		std::swap(ds_, o.ds_);
+		return *this;
+	}
+	dset(const dset &) = delete;
+	dset & operator=(const dset &) = delete;
+	~dset() {
+		if (ds_ != nullptr)
+			fast5_dset_close(ds_);
+	}
+
+	struct fast5_dset * get() const noexcept { return ds_; }
+
+	std::size_t length() const { return fast5_dset_length(ds_); }
+
+	struct fast5_dset_info info() const {
+		struct fast5_dset_info inf;
+		detail::check(fast5_dset_info(ds_, &inf));
+		return inf;
+	}
+
+	/* Read out.size() elements from start */
+	void read(span<T> out, std::size_t start = 0) const {
+		detail::check(fast5_dset_read(ds_, out.data(), start, out.size()));
+	}
+
+private:
+	struct fast5_dset * ds_;
+};
+
+/*
+ * Reads a dataset into a caller buffer, one buffer full per step. The
+ * iterator yields the part of the buffer filled, valid until the next
+ * step.
+ */
+template <typename T>
+class chunks {
+public:
+	chunks(dset<T> && ds, span<T> buf)
+		: ds_(std::move(ds)), buf_(buf), len_(ds_.length()) {}
+
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = span<const T>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = span<const T>;
+
+		iterator() noexcept : rng_(nullptr), pos_(0), cnt_(0) {}
+		explicit iterator(chunks * rng) : rng_(rng), pos_(0), cnt_(0) {
+			fill();
+		}
+
+		span<const T> operator*() const noexcept {
+			return span<const T>(rng_->buf_.data(), cnt_);
+		}
+		iterator & operator++() {
+			pos_ += cnt_;
+			fill();
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+		/* position of the chunk in the dataset */
+		std::size_t offset() const noexcept { return pos_; }
+
+		bool operator==(const iterator & o) const noexcept {
+			return end() == o.end();
+		}
+		bool operator!=(const iterator & o) const noexcept {
+			return !(*this == o);
+		}
+
+	private:
+		bool end() const noexcept { return cnt_ == 0; }
+		void fill() {
+			std::size_t n = rng_->len_ - pos_;
+			if (n > rng_->buf_.size())
+				n = rng_->buf_.size();
+			if ((cnt_ = n) > 0)
+				rng_->ds_.read(rng_->buf_.first(n), pos_);
+		}
+
+		chunks * rng_;
+		std::size_t pos_;
+		std::size_t cnt_;
+	};
+
+	iterator begin() { return iterator(this); }
+	iterator end() noexcept { return iterator(); }
+
+	std::size_t length() const noexcept { return len_; }
+
+private:
+	dset<T> ds_;
+	span<T> buf_;
+	std::size_t len_;
+};
+
+/* Indexes of the reads of a file, each read is selected in turn */
+class read_range {
+public:
+	read_range(struct fast5 * f5, unsigned int cnt) noexcept
+		: f5_(f5), cnt_(cnt) {}
+
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = unsigned int;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = unsigned int;
+
+		iterator(struct fast5 * f5, unsigned int idx) noexcept
+			: f5_(f5), idx_(idx) {}
+
+		unsigned int operator*() const {
+			detail::check(fast5_read_select(f5_, idx_));
+			return idx_;
+		}
+		iterator & operator++() noexcept { ++idx_; return *this; }
+		void operator++(int) noexcept { ++idx_; }
+
+		bool operator==(const iterator & o) const noexcept {
+			return idx_ == o.idx_;
+		}
+		bool operator!=(const iterator & o) const noexcept {
+			return idx_ != o.idx_;
+		}
+
+	private:
+		struct fast5 * f5_;
+		unsigned int idx_;
+	};
+
+	iterator begin() const noexcept { return iterator(f5_, 0); }
+	iterator end() const noexcept { return iterator(f5_, cnt_); }
+	unsigned int size() const noexcept { return cnt_; }
+
+private:
+	struct fast5 * f5_;
+	unsigned int cnt_;
+};
+
+/* An open FAST5 file */
+class file {
+public:
+	explicit file(const char * path, unsigned int flags = 0)
+		: f5_(fast5_open_flags(path, flags)) {
+		if (f5_ == nullptr)
+			throw error(fast5_error(), path);
+	}
+	explicit file(const std::string & path, unsigned int flags = 0)
+		: file(path.c_str(), flags) {}
+	/* Take ownership of a handle, e.g. from fast5_dir_iter_next() */
+	explicit file(struct fast5 * f5) noexcept : f5_(f5) {}
+
+	file(file && o) noexcept : f5_(std::exchange(o.f5_, nullptr)) {}
+	file & operator=(file && o) noexcept {
+		std::swap(f5_, o.f5_);
+		return *this;
+	}
+	file(const file &) = delete;
+	file & operator=(const file &) = delete;
+	~file() {
+		if (f5_ != nullptr)
+			fast5_close(f5_);
+	}
+
+	/* The image is copied, buf can be released after the call */
+	static file open_mem(span<const std::uint8_t> buf,
+						 unsigned int flags = 0) {
+		return file(detail::check(fast5_open_mem(buf.data(), buf.size(),
+												 flags)));
+	}
+
+	struct fast5 * get() const noexcept { return f5_; }
+	struct fast5 * release() noexcept { return std::exchange(f5_, nullptr); }
+	explicit operator bool() const noexcept { return f5_ != nullptr; }
+
+	struct fast5_info info() const {
+		struct fast5_info inf;
+		detail::check(fast5_info(f5_, &inf));
+		return inf;
+	}
+
+	/* Multi-read files */
+	unsigned int read_count() const {
+		return detail::check(fast5_read_count(f5_));
+	}
+	void select(unsigned int idx) const {
+		detail::check(fast5_read_select(f5_, idx));
+	}
+	read_range reads() const { return read_range(f5_, read_count()); }
+
+	/* Attributes of the selected read */
+	struct fast5_raw raw_info(unsigned int mask = FAST5_F_ALL) const {
+		struct fast5_raw inf;
+		detail::check(fast5_raw_read_info_mask(f5_, &inf, mask));
+		return inf;
+	}
+	struct fast5_events_info events_info(unsigned int mask = FAST5_F_ALL)
+		const {
+		struct fast5_events_info inf;
+		detail::check(fast5_events_info_mask(f5_, &inf, mask));
+		return inf;
+	}
+	struct fast5_channel_id channel_id() const {
+		struct fast5_channel_id ch;
+		detail::check(fast5_channel_id(f5_, &ch));
+		return ch;
+	}
+
+	/* Read out.size() samples of the selected read from start */
+	std::size_t read_raw(span<std::int16_t> out, std::size_t start = 0)
+		const {
+		detail::check(fast5_raw_read_range(f5_, out.data(), start,
+										   out.size()));
+		return out.size();
+	}
+	/* Read out.size() events of the selected read from start */
+	std::size_t read_events(span<struct fast5_event> out,
+							std::size_t start = 0) const {
+		detail::check(fast5_events_read_range(f5_, out.data(), start,
+											   out.size()));
+		return out.size();
+	}
+
+	/* The signal of the selected read, mapped if possible. Valid until
+	   unmap(), the next raw_map() or the file is closed. */
+	span<const std::int16_t> raw_map() const {
+		std::size_t len;
+		const std::int16_t * raw = detail::check(fast5_raw_map(f5_, &len));
+		return span<const std::int16_t>(raw, len);
+	}
+	void unmap() const { fast5_raw_unmap(f5_); }
+
+	dset<std::int16_t> raw_open() const {
+		return dset<std::int16_t>(detail::check(fast5_raw_open(f5_)));
+	}
+	dset<struct fast5_event> events_open() const {
+		return dset<struct fast5_event>(
+			detail::check(fast5_events_open(f5_)));
+	}
+
+	/* Iterate over the selected read, buf.size() elements at a time */
+	chunks<std::int16_t> raw_chunks(span<std::int16_t> buf) const {
+		return chunks<std::int16_t>(raw_open(), buf);
+	}
+	chunks<struct fast5_event> event_chunks(span<struct fast5_event> buf)
+		const {
+		return chunks<struct fast5_event>(events_open(), buf);
+	}
+
+	/* Analyses */
+	void analysis_select(const char * name) const {
+		detail::check(fast5_analysis_select(f5_, name));
+	}
+
+private:
+	struct fast5 * f5_;
+};
+
+/* The FAST5 files under a directory, see fast5_dir_iter_new() */
+class dir {
+public:
+	explicit dir(const char * path, const struct fast5_dir_opt * opt = nullptr)
+		: it_(fast5_dir_iter_new(path, opt)) {
+		if (it_ == nullptr)
+			throw error(fast5_error(), path);
+	}
+	dir(dir && o) noexcept : it_(std::exchange(o.it_, nullptr)) {}
+	dir & operator=(dir && o) noexcept {
+		std::swap(it_, o.it_);
+		return *this;
+	}
+	dir(const dir &) = delete;
+	dir & operator=(const dir &) = delete;
+	~dir() {
+		if (it_ != nullptr)
+			fast5_dir_iter_free(it_);
+	}
+
+	/* The next file, an empty one at the end of the walk */
+	file next() { return file(fast5_dir_iter_next(it_, nullptr, 0)); }
+
+	unsigned long skipped() const { return fast5_dir_iter_skipped(it_); }
+
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = file;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = file;
+
+		iterator() noexcept : dir_(nullptr), cur_(static_cast<struct fast5 *>(nullptr)) {}
+		explicit iterator(dir * d) : dir_(d), cur_(d->next()) {}
+
+		/* moves the handle out, once per step */
+		file operator*() { return std::move(cur_); }
+		iterator & operator++() {
+			cur_ = dir_->next();
+			return *this;
+		}
+
+		bool operator==(const iterator & o) const noexcept {
+			return !cur_ && !o.cur_;
+		}
+		bool operator!=(const iterator & o) const noexcept {
+			return !(*this == o);
+		}
+
+	private:
+		dir * dir_;
+		file cur_;
+	};
+
+	iterator begin() { return iterator(this); }
+	iterator end() noexcept { return iterator(); }
+
+private:
+	struct fast5_dir_iter * it_;
+};
+
+} /* namespace f5 */
+
+#endif /* __FAST5_HPP__ */
+
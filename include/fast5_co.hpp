@@ -0,0 +1,618 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      fast5_co.hpp
+ * \brief     FAST5 library C++20 coroutine interface
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   Coroutines over fast5.hpp, to overlap the HDF5 reads with the
+   processing of the reads already loaded.
+
+   - f5::executor runs posted jobs on its own threads. An I/O executor
+     with one thread runs the blocking library calls, more would not 
+     run them in parallel (see "Threads" in fast5.h).
+     co_await ex.schedule() continues a coroutine on the executor.
+   - f5::task<T> is a lazy coroutine, started when awaited. sync_wait()
+     runs a task from a plain function and waits for its result.
+   - f5::generator<T> is a synchronous co_yield sequence, reads() yields
+     the reads of an open file.
+   - read_raw_async() and read_events_async() read into caller memory
+     on the I/O executor.
+   - f5::read_stream loads the reads of a list of files on the I/O
+     executor, at most depth reads ahead of its consumer (one coroutine
+     at a time). Files that can't be opened are skipped. co_await
+     stream.next() gets the next read, or an empty optional at the end.
+
+   A coroutine that had to wait is resumed on the thread that completed
+   the wait: the I/O thread, or the resume executor of a read_stream.
+   Long computations should not run on the I/O thread, they would stall
+   the prefetch.
+
+   Example:
+
+     f5::executor io(1), cpu(4);
+     f5::read_stream rs(io, paths, 8, f5::load_signal, &cpu);
+
+     f5::task<void> run() {
+       while (auto rd = co_await rs.next())
+         process(rd->signal);
+     }
+     f5::sync_wait(run());
+*/
+
+#ifndef __FAST5_CO_HPP__
+#define __FAST5_CO_HPP__
+
+#if __cplusplus < 202002L
+#error "fast5_co.hpp needs C++20"
+#endif
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "fast5.hpp"
+
+namespace f5 {
+
+/* Threads running posted jobs, in the order posted. The destructor
+   runs the jobs still queued, then joins the threads. */
+class executor {
+public:
+	explicit executor(unsigned int nthreads = 1) {
+		if (nthreads == 0)
+			nthreads = 1;
+		for (unsigned int i = 0; i < nthreads; ++i)
+			thr_.emplace_back([this] { run(); });
+	}
+	executor(const executor &) = delete;
+	executor & operator=(const executor &) = delete;
+	~executor() {
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			stop_ = true;
+		}
+		cv_.notify_all();
+		for (auto & t : thr_)
+			t.join();
+	}
+
+	/* Notifies with mtx_ held: once the job is queued it may run and 
+	   let the owner destroy the executor, post() must not touch it after 
+	   releasing the lock. */
+	void post(std::function<void()> fn) {
+		std::lock_guard<std::mutex> lk(mtx_);
+		jobs_.push_back(std::move(fn));
+		cv_.notify_one();
+	}
+
+	void post(std::coroutine_handle<> h) {
+		post([h] { h.resume(); });
+	}
+
+	/* co_await ex.schedule() continues on one of the threads */
+	auto schedule() noexcept {
+		struct awaiter {
+			executor * ex;
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h) { ex->post(h); }
+			void await_resume() const noexcept {}
+		};
+		return awaiter{this};
+	}
+
+private:
+	void run() {
+		for (;;) {
+			std::function<void()> fn;
+			{
+				std::unique_lock<std::mutex> lk(mtx_);
+				cv_.wait(lk, [this] { return stop_ || !jobs_.empty(); });
+				if (jobs_.empty())
+					return;
+				fn = std::move(jobs_.front());
+				jobs_.pop_front();
+			}
+			fn();
+		}
+	}
+
+	std::mutex mtx_;
+	std::condition_variable cv_;
+	std::deque<std::function<void()>> jobs_;
+	std::vector<std::thread> thr_;
+	bool stop_ = false;
+};
+
+namespace detail {
+
+/* Resumes the awaiting coroutine when a task completes */
+template <typename P>
+struct final_awaiter {
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h)
+		noexcept {
+		auto cont = h.promise().cont;
+		return cont ? cont : std::noop_coroutine();
+	}
+	void await_resume() const noexcept {}
+};
+
+struct promise_base {
+	std::coroutine_handle<> cont;
+	std::exception_ptr exc;
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	void unhandled_exception() noexcept { exc = std::current_exception(); }
+};
+
+template <typename T>
+struct task_promise : promise_base {
+	std::optional<T> val;
+
+	void return_value(T v) { val.emplace(std::move(v)); }
+	T result() {
+		if (exc)
+			std::rethrow_exception(exc);
+		return std::move(*val);
+	}
+};
+
+template <>
+struct task_promise<void> : promise_base {
+	void return_void() const noexcept {}
+	void result() {
+		if (exc)
+			std::rethrow_exception(exc);
+	}
+};
+
+} /* namespace detail */
+
+/* A lazy coroutine, started by co_await */
+template <typename T = void>
+class task {
+public:
+	struct promise_type : detail::task_promise<T> {
+		task get_return_object() {
+			return task(std::coroutine_handle<promise_type>::from_promise(
+				*this));
+		}
+		detail::final_awaiter<promise_type> final_suspend() const noexcept {
+			return {};
+		}
+	};
+
+	task(task && o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+	task & operator=(task && o) noexcept {
+		std::swap(h_, o.h_);
+		return *this;
+	}
+	task(const task &) = delete;
+	task & operator=(const task &) = delete;
+	~task() {
+		if (h_)
+			h_.destroy();
+	}
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont)
+		noexcept {
+		h_.promise().cont = cont;
+		return h_;
+	}
+	T await_resume() { return h_.promise().result(); }
+
+private:
+	explicit task(std::coroutine_handle<promise_type> h) noexcept : h_(h) {}
+
+	std::coroutine_handle<promise_type> h_;
+};
+
+namespace detail {
+
+/* Eager, self destroying coroutine, the driver of sync_wait() */
+struct detached {
+	struct promise_type {
+		detached get_return_object() const noexcept { return {}; }
+		std::suspend_never initial_suspend() const noexcept { return {}; }
+		std::suspend_never final_suspend() const noexcept { return {}; }
+		void return_void() const noexcept {}
+		void unhandled_exception() const noexcept { std::terminate(); }
+	};
+};
+
+} /* namespace detail */
+
+/* Run a task and block the calling thread until it completes */
+template <typename T>
+T sync_wait(task<T> t)
+{
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool done = false;
+	std::exception_ptr exc;
+	std::optional<std::conditional_t<std::is_void_v<T>, char, T>> val;
+
+	auto drive = [&]() -> detail::detached {
+		try {
+			if constexpr (std::is_void_v<T>)
+				co_await std::move(t);
+			else
+				val.emplace(co_await std::move(t));
+		} catch (...) {
+			exc = std::current_exception();
+		}
+		std::lock_guard<std::mutex> lk(mtx);
+		done = true;
+		cv.notify_all();
+	};
+	drive();
+
+	std::unique_lock<std::mutex> lk(mtx);
+	cv.wait(lk, [&] { return done; });
+	if (exc)
+		std::rethrow_exception(exc);
+	if constexpr (!std::is_void_v<T>)
+		return std::move(*val);
+}
+
+/* A synchronous sequence of co_yield values */
+template <typename T>
+class generator {
+public:
+	struct promise_type {
+		std::optional<T> val;
+		std::exception_ptr exc;
+
+		generator get_return_object() {
+			return generator(
+				std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		std::suspend_always final_suspend() const noexcept { return {}; }
+		std::suspend_always yield_value(T v) {
+			val.emplace(std::move(v));
+			return {};
+		}
+		void return_void() const noexcept {}
+		void unhandled_exception() noexcept {
+			exc = std::current_exception();
+		}
+	};
+
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		explicit iterator(std::coroutine_handle<promise_type> h) : h_(h) {
+			advance();
+		}
+
+		T & operator*() const noexcept { return *h_.promise().val; }
+		T * operator->() const noexcept { return &*h_.promise().val; }
+		iterator & operator++() {
+			advance();
+			return *this;
+		}
+		void operator++(int) { advance(); }
+
+		bool operator==(std::default_sentinel_t) const noexcept {
+			return !h_ || h_.done();
+		}
+
+	private:
+		void advance() {
+			h_.promise().val.reset();
+			h_.resume();
+			if (h_.done() && h_.promise().exc)
+				std::rethrow_exception(h_.promise().exc);
+		}
+
+		std::coroutine_handle<promise_type> h_;
+	};
+
+	generator(generator && o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+	generator(const generator &) = delete;
+	generator & operator=(const generator &) = delete;
+	~generator() {
+		if (h_)
+			h_.destroy();
+	}
+
+	iterator begin() { return iterator(h_); }
+	std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+	explicit generator(std::coroutine_handle<promise_type> h) noexcept
+		: h_(h) {}
+
+	std::coroutine_handle<promise_type> h_;
+};
+
+/* What is loaded for each read */
+enum : unsigned int {
+	load_signal = 1 << 0,
+	load_events = 1 << 1
+};
+
+/* A read loaded in memory */
+struct read {
+	std::string path;
+	/* index of the read in the file */
+	unsigned int index = 0;
+	struct fast5_raw info {};
+	struct fast5_channel_id channel {};
+	std::vector<std::int16_t> signal;
+	std::vector<struct fast5_event> events;
+};
+
+/* Load the selected read of a file. Missing data is left empty. */
+inline read load_read(const file & f, unsigned int idx, unsigned int what,
+					  const char * path = "")
+{
+	read rd;
+	struct fast5_events_info ev;
+
+	rd.path = path;
+	rd.index = idx;
+	if (fast5_raw_read_info(f.get(), &rd.info) < 0)
+		rd.info = {};
+	if (fast5_channel_id(f.get(), &rd.channel) < 0)
+		rd.channel = {};
+
+	if ((what & load_signal) && (rd.info.length > 0)) {
+		rd.signal.resize(rd.info.length);
+		f.read_raw(rd.signal);
+	}
+
+	if ((what & load_events) &&
+		(fast5_events_info_mask(f.get(), &ev, FAST5_F_LENGTH) == 0) &&
+		(ev.length > 0)) {
+		rd.events.resize(ev.length);
+		f.read_events(rd.events);
+	}
+
+	return rd;
+}
+
+/* The reads of an open file, loaded one at a time */
+inline generator<read> reads(const file & f, unsigned int what = load_signal)
+{
+	unsigned int cnt = f.read_count();
+
+	for (unsigned int i = 0; i < cnt; ++i) {
+		f.select(i);
+		co_yield load_read(f, i, what);
+	}
+}
+
+/* Read out.size() samples of the selected read on the io executor */
+inline task<std::size_t> read_raw_async(executor & io, const file & f,
+										span<std::int16_t> out,
+										std::size_t start = 0)
+{
+	co_await io.schedule();
+	co_return f.read_raw(out, start);
+}
+
+/* Read out.size() events of the selected read on the io executor */
+inline task<std::size_t> read_events_async(executor & io, const file & f,
+										   span<struct fast5_event> out,
+										   std::size_t start = 0)
+{
+	co_await io.schedule();
+	co_return f.read_events(out, start);
+}
+
+/* The reads of a list of files, prefetched on an io executor */
+class read_stream {
+public:
+	read_stream(executor & io, std::vector<std::string> paths,
+				unsigned int depth = 4, unsigned int what = load_signal,
+				executor * resume = nullptr)
+		: st_(std::make_shared<state>()) {
+		st_->io = &io;
+		st_->resume = resume;
+		st_->paths = std::move(paths);
+		st_->what = what;
+		for (unsigned int i = 0; i < (depth ? depth : 1); ++i)
+			state::fetch(st_);
+	}
+	read_stream(const read_stream &) = delete;
+	read_stream & operator=(const read_stream &) = delete;
+	/* The pending loads are dropped, the io executor must outlive them */
+	~read_stream() {
+		std::lock_guard<std::mutex> lk(st_->mtx);
+		st_->closed = true;
+	}
+
+	/* co_await next(): the next read, empty at the end of the list */
+	auto next() noexcept {
+		struct awaiter {
+			std::shared_ptr<state> st;
+
+			bool await_ready() const {
+				std::lock_guard<std::mutex> lk(st->mtx);
+				return st->available();
+			}
+			bool await_suspend(std::coroutine_handle<> h) {
+				std::lock_guard<std::mutex> lk(st->mtx);
+				if (st->available())
+					return false;
+				st->waiter = h;
+				return true;
+			}
+			std::optional<read> await_resume() {
+				return state::take(st);
+			}
+		};
+		return awaiter{st_};
+	}
+
+	/* Files that could not be opened */
+	unsigned long skipped() const {
+		std::lock_guard<std::mutex> lk(st_->mtx);
+		return st_->skipped;
+	}
+
+private:
+	struct state {
+		std::mutex mtx;
+		executor * io = nullptr;
+		executor * resume = nullptr;
+		std::coroutine_handle<> waiter;
+		std::deque<read> ready;
+		std::exception_ptr exc;
+		bool eof = false;
+		bool closed = false;
+		unsigned long skipped = 0;
+
+		/* io side, only touched by the load jobs, under io_mtx */
+		std::mutex io_mtx;
+		std::vector<std::string> paths;
+		std::size_t next_path = 0;
+		std::optional<file> cur;
+		unsigned int cur_idx = 0;
+		unsigned int cur_cnt = 0;
+		unsigned int what = 0;
+
+		bool available() const { return !ready.empty() || eof || exc; }
+
+		/* Queue the load of one read */
+		static void fetch(const std::shared_ptr<state> & st) {
+			st->io->post([st] { load(st); });
+		}
+
+		static void load(const std::shared_ptr<state> & st) {
+			std::optional<read> rd;
+			std::exception_ptr exc;
+			bool end = false;
+			unsigned long skip = 0;
+
+			{
+				std::lock_guard<std::mutex> io_lk(st->io_mtx);
+				{
+					std::lock_guard<std::mutex> lk(st->mtx);
+					if (st->closed || st->eof || st->exc)
+						return;
+				}
+				try {
+					while (!rd && !end) {
+						if (st->cur && (st->cur_idx < st->cur_cnt)) {
+							st->cur->select(st->cur_idx);
+							rd.emplace(load_read(*st->cur, st->cur_idx,
+												 st->what,
+												 st->paths[st->next_path - 1]
+												 .c_str()));
+							st->cur_idx++;
+						} else if (st->next_path < st->paths.size()) {
+							const std::string & p =
+								st->paths[st->next_path++];
+							st->cur.reset();
+							struct fast5 * f5 = fast5_open(p.c_str());
+							if (f5 == nullptr) {
+								skip++;
+								continue;
+							}
+							st->cur.emplace(f5);
+							st->cur_idx = 0;
+							st->cur_cnt = st->cur->read_count();
+						} else {
+							st->cur.reset();
+							end = true;
+						}
+					}
+				} catch (...) {
+					exc = std::current_exception();
+				}
+
+				/* still under io_mtx, the reads queue in file order */
+				std::lock_guard<std::mutex> lk(st->mtx);
+				st->skipped += skip;
+				if (rd)
+					st->ready.push_back(std::move(*rd));
+				/* a failed load ends the stream */
+				if (end || exc)
+					st->eof = true;
+				if (exc)
+					st->exc = exc;
+			}
+
+			wake(st);
+		}
+
+		static void wake(const std::shared_ptr<state> & st) {
+			std::coroutine_handle<> h;
+			{
+				std::lock_guard<std::mutex> lk(st->mtx);
+				h = std::exchange(st->waiter, nullptr);
+			}
+			if (!h)
+				return;
+			if (st->resume != nullptr)
+				st->resume->post(h);
+			else
+				h.resume();
+		}
+
+		static std::optional<read> take(const std::shared_ptr<state> & st) {
+			std::optional<read> rd;
+			{
+				std::lock_guard<std::mutex> lk(st->mtx);
+				if (!st->ready.empty()) {
+					rd.emplace(std::move(st->ready.front()));
+					st->ready.pop_front();
+				} else if (st->exc) {
+					std::rethrow_exception(std::exchange(st->exc, nullptr));
+				}
+				if (!rd || st->eof)
+					return rd;
+			}
+			/* one out, one more in flight */
+			fetch(st);
+			return rd;
+		}
+	};
+
+	std::shared_ptr<state> st_;
+};
+
+} /* namespace f5 */
+
+#endif /* __FAST5_CO_HPP__ */
+
@@ -0,0 +1,97 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      fast5_filter.h
+ * \brief     Raw signal streaming filters
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   A filter chain is built from a text specification, a comma separated
+   list of stages, each with optional colon separated parameters:
+
+     median[:W]        running median of the last W samples (default 5)
+     iir[:A]           one pole low-pass, y += A * (x - y) (default 0.25)
+     fir[:N[:FC]]      N taps windowed sinc low-pass, cutoff FC in
+                       cycles per sample (default 31 taps, 0.1)
+     mad[:K[:W]]       clip samples further than K * MAD from the median,
+                       both estimated over blocks of W samples
+                       (default 4, 4096)
+     resample:RATE[:T] convert to RATE samples per second with a
+                       polyphase low-pass of T taps per phase
+                       (default 16)
+
+   e.g.: "mad:5,median:3,fir:15:0.05"
+
+   The signal is processed one chunk at a time, in place. The stages keep
+   their state between calls, so a read can be filtered as it is read
+   with fast5_raw_read_range(). All the stages are causal, the output
+   sample n only depends on the input samples up to n.
+   fast5_filter_reset() must be called before a new read.
+
+   The resample stage needs the sampling rate of the read, set with
+   fast5_filter_rate() (which also resets the chain); it passes the
+   samples through until then. The rate ratio is approximated by L/M,
+   L at most 512, and the filter banks of the last few ratios are kept.
+   A chain that resamples returns a different number of samples than it
+   was given: fast5_filter_process() writes them to out, which must hold
+   fast5_filter_len() samples. fast5_filter_run() fails if the chain 
+   could return more samples than the chunk holds. Both return the 
+   number of output samples.
+*/
+
+#ifndef __FAST5_FILTER_H__
+#define __FAST5_FILTER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Opaque filter chain */
+struct fast5_filter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fast5_filter * fast5_filter_new(const char * spec);
+
+int fast5_filter_free(struct fast5_filter * flt);
+
+void fast5_filter_reset(struct fast5_filter * flt);
+
+int fast5_filter_run(struct fast5_filter * flt, int16_t * buf, size_t len);
+
+int fast5_filter_process(struct fast5_filter * flt, const int16_t * in, 
+						 size_t len, int16_t * out);
+
+/* Set the input sampling rate, returns the output rate */
+double fast5_filter_rate(struct fast5_filter * flt, double rate);
+
+/* Maximum output samples for len input samples */
+size_t fast5_filter_len(struct fast5_filter * flt, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAST5_FILTER_H__ */
+
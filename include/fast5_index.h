@@ -0,0 +1,152 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      fast5_index.h
+ * \brief     Read index of a run, by channel and time
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   The read index of a run holds, for each raw read of a set of files,
+   the file, the read in the file, the channel number and the interval
+   start_time .. start_time + duration covered by the signal. Times are
+   in samples from the start of the run, the units of the raw read
+   start_time attribute. Reads with no raw signal are not indexed.
+
+   The reads are kept sorted by channel and start time, each entry also
+   holds the latest end of the reads of its channel up to it. A query
+   is then a binary search for the first read ending after t0 and a
+   scan up to the first read starting at or after t1, the reads of a
+   channel don't overlap in practice. fast5_index_load() and
+   fast5_index_merge() return a sorted index; after fast5_index_add()
+   or fast5_index_add_file() the sort is done by fast5_index_sort(), or
+   else by the next query or save. Queries can be run from several 
+   threads on a sorted index only, as long as it is not changed.
+
+   fast5_index_query() returns the reads overlapping [t0, t1), with the
+   offset and count of the overlapping samples in each read, so only
+   these reads are opened and only the overlapping part of the signal
+   is read. fast5_index_hit_read() does it for one hit.
+
+   An index can be saved and loaded, so the files of a run are scanned
+   once (f5stats -x). All fields of the file are little-endian:
+
+   Header (16 bytes):
+     char     magic[4]      "F5IX"
+     uint16   version       1
+     uint16   reserved
+     uint32   nfiles
+     uint32   nreads
+
+   File table, nfiles times:
+     uint16   len
+     char     path[len]
+
+   Reads, nreads times, sorted by channel and start:
+     uint32   file
+     uint32   read
+     uint32   channel
+     uint32   reserved
+     uint64   start
+     uint64   duration
+*/
+
+#ifndef __FAST5_INDEX_H__
+#define __FAST5_INDEX_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fast5.h"
+
+#define FAST5_INDEX_VERSION 1
+
+/* Opaque index */
+struct fast5_index;
+
+/* Part of a read overlapping a query window */
+struct fast5_index_hit {
+	/* valid until the index is changed or released */
+	const char * path;
+	unsigned int read;
+	unsigned int channel;
+	/* read start_time and duration */
+	uint64_t start;
+	uint64_t duration;
+	/* first overlapping sample in the read, and sample count */
+	uint64_t offset;
+	uint64_t count;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fast5_index * fast5_index_new(void);
+
+int fast5_index_free(struct fast5_index * idx);
+
+/* Add the read-th read of the file path */
+int fast5_index_add(struct fast5_index * idx, const char * path,
+					unsigned int read, const struct fast5_raw * raw,
+					const struct fast5_channel_id * ch);
+
+/* Add all the raw reads of f5, opened from path */
+int fast5_index_add_file(struct fast5_index * idx, struct fast5 * f5,
+						 const char * path);
+
+/* Add the reads of src to dst */
+int fast5_index_merge(struct fast5_index * dst,
+					  const struct fast5_index * src);
+
+/* Sort the reads by channel and start, before concurrent queries */
+int fast5_index_sort(struct fast5_index * idx);
+
+/* Number of reads */
+size_t fast5_index_count(const struct fast5_index * idx);
+
+/*
+ * Reads of channel overlapping the samples [t0, t1), in time order. At
+ * most max hits are stored, the number of overlapping reads is returned.
+ */
+int fast5_index_query(struct fast5_index * idx, unsigned int channel,
+					  uint64_t t0, uint64_t t1,
+					  struct fast5_index_hit * hit, unsigned int max);
+
+/*
+ * Select the read of a hit in f5, the file of hit->path, and read its
+ * overlapping samples into raw, hit->count samples long. Returns the
+ * number of samples read, less than hit->count if the signal is shorter
+ * than the read duration.
+ */
+int fast5_index_hit_read(struct fast5 * f5,
+						 const struct fast5_index_hit * hit, int16_t * raw);
+
+int fast5_index_save(struct fast5_index * idx, FILE * f);
+
+struct fast5_index * fast5_index_load(FILE * f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAST5_INDEX_H__ */
@@ -0,0 +1,107 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      fast5_stats.h
+ * \brief     Run level statistics
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   An accumulator folds the raw read attributes and the channel
+   calibration of any number of reads into fixed size tables:
+
+     - reads per channel and start mux;
+     - reads and samples per time bin (yield over time);
+     - a log-linear histogram of the signal lengths;
+     - a histogram of the open pore current (median_before) per channel.
+
+   The tables are only added to, two accumulators are merged by adding
+   their tables, in any order. Each worker fills its own accumulator,
+   the results are then reduced with fast5_stats_merge().
+   FAST5_STATS_SHARED allocates the accumulator in memory shared with
+   the child processes, so a worker process created by fork() can fill
+   it for the parent.
+*/
+
+#ifndef __FAST5_STATS_H__
+#define __FAST5_STATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fast5.h"
+
+/* Opaque accumulator */
+struct fast5_stats;
+
+/* fast5_stats_new() flags */
+#define FAST5_STATS_SHARED (1 << 0)
+
+/* Run summary */
+struct fast5_stats_summary {
+	uint64_t files;
+	uint64_t reads;
+	/* reads with no raw signal or no channel_id */
+	uint64_t skipped;
+	uint64_t samples;
+	uint64_t min_length;
+	uint64_t max_length;
+	/* from the length histogram, 1/8 of an octave resolution */
+	uint64_t median_length;
+	uint64_t n50_length;
+	unsigned int channels;
+	double sampling_rate;
+	/* last read start, in seconds from the start of the run */
+	double duration;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fast5_stats * fast5_stats_new(unsigned int flags);
+
+int fast5_stats_free(struct fast5_stats * st);
+
+/* Fold one read */
+int fast5_stats_add(struct fast5_stats * st, const struct fast5_raw * raw,
+					const struct fast5_channel_id * ch);
+
+/* Fold all the reads of a file */
+int fast5_stats_add_file(struct fast5_stats * st, struct fast5 * f5);
+
+/* dst += src */
+int fast5_stats_merge(struct fast5_stats * dst,
+					  const struct fast5_stats * src);
+
+int fast5_stats_summary(const struct fast5_stats * st,
+						struct fast5_stats_summary * sum);
+
+/* Text report: the summary, then the time, length and channel tables */
+int fast5_stats_report(const struct fast5_stats * st, FILE * f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAST5_STATS_H__ */
+
@@ -0,0 +1,154 @@
+/*
+ * ftab - columnar table writer
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      ftab.h
+ * \brief     Columnar table writer public API
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   FTAB is a minimal columnar table, in the spirit of the Arrow IPC file
+   format (not its container): the rows are split in batches, each batch
+   stores the values of every column contiguous, and a batch index is
+   appended at the end of the file. All values are fixed size, so a
+   column of a batch can be used in place (e.g. numpy.frombuffer() or a
+   mmap) with no parsing. Strings are NUL padded to the column size.
+
+   All fields are little-endian, every column of a batch starts at an
+   8 bytes aligned offset from the start of the batch.
+
+   Header (16 bytes):
+     char     magic[4]      "FTAB"
+     uint16   version       1
+     uint16   ncols
+     uint32   batch_rows    maximum rows per batch
+     uint32   reserved
+
+   Column table, ncols times, then padded to 8 bytes:
+     uint8    type          FTAB_U8 ... FTAB_STR
+     uint8    namelen
+     uint16   size          bytes per value
+     char     name[namelen]
+
+   Batch:
+     char     magic[4]      "FTBB"
+     uint32   rows
+     { uint8 values[rows * size], padded to 8 bytes } * ncols
+
+   Trailer:
+     uint32   nbatches
+     uint32   reserved
+       { uint64 offset, uint64 rows } * nbatches
+     uint64   index_offset
+     uint64   rows          total
+     char     magic[4]      "FTBI"
+     uint32   nbatches
+
+   FTAB_FMT_TSV writes the same table as tab separated text instead, with
+   a header line of column names.
+
+   The writer takes the rows in the host order and stores the numbers 
+   little-endian, ftab_open() and ftab_batch_read() read a binary table
+   back one column of a batch at a time, in the host order.
+*/
+
+#ifndef __FTAB_H__
+#define __FTAB_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define FTAB_VERSION 1
+
+#define FTAB_BATCH_ROWS 65536
+
+/* Column types */
+#define FTAB_U8  0
+#define FTAB_I32 1
+#define FTAB_U32 2
+#define FTAB_I64 3
+#define FTAB_U64 4
+#define FTAB_F64 5
+#define FTAB_STR 6
+
+/* Output formats */
+#define FTAB_FMT_BIN 0
+#define FTAB_FMT_TSV 1
+
+/* Opaque table structures */
+struct ftab;
+
+struct ftab_reader;
+
+/* Column of a table being read */
+struct ftab_col_info {
+	char name[256];
+	unsigned int type;
+	/* bytes per value */
+	size_t size;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A NULL path writes to stdout */
+struct ftab * ftab_create(const char * path, unsigned int fmt);
+
+/* Add a column before the first row. The values are taken from the
+   rows passed to ftab_append(), size bytes at offset. */
+int ftab_col_new(struct ftab * tab, const char * name, unsigned int type,
+				 size_t size, size_t offset);
+
+/* Append cnt rows of stride bytes */
+int ftab_append(struct ftab * tab, const void * rows, size_t stride,
+				unsigned int cnt);
+
+int ftab_close(struct ftab * tab);
+
+struct ftab_reader * ftab_open(const char * path);
+
+int ftab_reader_close(struct ftab_reader * rd);
+
+unsigned int ftab_ncols(struct ftab_reader * rd);
+
+int ftab_col_info(struct ftab_reader * rd, unsigned int col,
+				  struct ftab_col_info * info);
+
+/* Index of the column name, -1 if there is none */
+int ftab_col_find(struct ftab_reader * rd, const char * name);
+
+uint64_t ftab_rows(struct ftab_reader * rd);
+
+unsigned int ftab_nbatches(struct ftab_reader * rd);
+
+/* Read the values of a column of a batch into buf, which must hold 
+   FTAB_BATCH_ROWS values. Returns the number of rows of the batch. */
+int ftab_batch_read(struct ftab_reader * rd, unsigned int batch,
+					unsigned int col, void * buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FTAB_H__ */
+
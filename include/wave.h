@@ -0,0 +1,105 @@
+/*
+ * wave - compact binary waveform encoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file      wave.h
+ * \brief     Compact binary waveform library public API
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   A compact binary alternative to the VCD output, f5vcd -F wave. This
+   is a container of its own, it is not the GTKWave FST format and the
+   GTKWave tools don't read it. The samples of each variable are split 
+   in fixed size blocks, every block is delta encoded (zig-zag LEB128 
+   varints) and a block index is appended at the end of the file, so a 
+   reader can seek straight to any point of a signal without decoding 
+   what comes before it.
+
+   All fields are little-endian.
+
+   Header (32 bytes):
+     char     magic[4]      "F5WV"
+     uint16   version       1
+     uint16   block_len     maximum samples per block
+     double   timescale     seconds per time unit
+     uint64   date          creation time (seconds since the epoch)
+     uint64   reserved
+
+   Block (20 bytes + payload):
+     uint8    var           variable id
+     uint8    encoding      WAVE_ENC_DELTA_VARINT
+     uint16   reserved
+     uint32   count         number of samples
+     uint64   start         index of the first sample
+     uint32   size          payload size in bytes
+     uint8    payload[size]
+
+   Trailer:
+     uint32   nvars
+       { uint8 id, uint8 sizeoftype, uint8 namelen, char name[namelen],
+         double period } * nvars
+     uint32   nblocks
+       { uint8 var, uint32 count, uint64 start, uint64 offset } * nblocks
+     uint64   vartab_offset
+     uint64   index_offset
+     char     magic[4]      "F5WI"
+     uint32   nblocks
+*/
+
+#ifndef __WAVE_H__
+#define __WAVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define WAVE_VERSION 1
+
+#define WAVE_BLOCK_LEN 4096
+
+#define WAVE_ENC_DELTA_VARINT 0
+
+/* Opaque waveform file structure */
+struct wave;
+
+struct wave_var;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct wave * wave_create(const char * path, double timescale);
+
+int wave_close(struct wave * wv);
+
+struct wave_var * wave_var_new(struct wave * wv, const char * name,
+							 double rate);
+
+int wave_var_append(struct wave_var * var, void * data, unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WAVE_H__ */
+
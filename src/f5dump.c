@@ -27,6 +27,7 @@
  */ 
 
 #include <unistd.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -36,24 +37,81 @@
 #include <libgen.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "config.h"
 #include "fast5.h"
+#include "fast5_filter.h"
+#include "fast5_index.h"
+#include "ftab.h"
 
 int verbose = 0;
 
 void usage(FILE * f, char * prog)
 {
-	fprintf(f, "Usage: %s [OPTION...] FILE\n", prog);
+	fprintf(f, "Usage: %s [OPTION...] FILE...\n", prog);
+	fprintf(f, "   or: %s [OPTION...] -R DIR\n", prog);
 	fprintf(f, "FAST5 decoder test.\n");
 	fprintf(f, "\n");
 	fprintf(f, "  -?     \tShow this help message\n");
 	fprintf(f, "  -v[v]  \tVerbosity level\n");
 	fprintf(f, "  -r     \tRaw data dump\n");
 	fprintf(f, "  -e     \tEvents dump\n");
+	fprintf(f, "  -t     \tSkip the open pore samples of the raw dump\n");
+	fprintf(f, "  -w N,CNT\tOnly the events covering CNT samples from N\n");
+	fprintf(f, "  -q     \tTemplate FASTQ dump\n");
+	fprintf(f, "  -a NAME\tUse analysis NAME (e.g. EventDetection_001)\n");
+	fprintf(f, "  -j JOBS\tParallel jobs for the FASTQ and summary dumps "
+			"(default: 1)\n");
+	fprintf(f, "  -R DIR \tAll the .fast5 files under DIR, recursively\n");
+	fprintf(f, "  --filter SPEC\tFilter the raw data (e.g. mad:4,median:5,"
+			"fir:31:0.1,resample:5000)\n");
+	fprintf(f, "  --summary FILE\tWrite a table of all the reads to FILE "
+			"(- for stdout)\n");
+	fprintf(f, "  --tsv  \tText summary table, tab separated\n");
+	fprintf(f, "  --query CH:T0:T1\tRaw samples of channel CH from T0 to T1 "
+			"(run samples)\n");
+	fprintf(f, "  --index FILE\tRead index for --query (see f5stats -x)\n");
+	fprintf(f, "  --bench\tLoad all the raw signals in memory and scan them, "
+			"with each allocator, in JOBS threads\n");
+	fprintf(f, "  --stats\tPrint the library performance counters\n");
 	fprintf(f, "\n");
 }
 
+void stats(FILE * f, char * prog)
+{
+	struct fast5_perf perf;
+	unsigned int i;
+
+	if (fast5_perf_counters(&perf) < 0) {
+		fprintf(f, "%s: performance counters not available, "
+				"configure with --enable-perf\n", prog);
+		return;
+	}
+
+	fprintf(f, "%-22s %10s %12s %10s\n", "call", "count", "total(ms)", 
+			"avg(us)");
+	for (i = 0; i < FAST5_PERF_CALL_MAX; ++i) {
+		uint64_t cnt = perf.call[i].count;
+		uint64_t ns = perf.call[i].ns;
+
+		fprintf(f, "%-22s %10" PRIu64 " %12.3f %10.3f\n", 
+				fast5_perf_call_name(i), cnt, ns / 1e6, 
+				cnt ? (ns / 1e3) / cnt : 0.0);
+	}
+	fprintf(f, "\n");
+	fprintf(f, "    bytes read: %" PRIu64 "\n", perf.bytes_read);
+	fprintf(f, "  HDF5 handles: %" PRIu64 " opened, %" PRIu64 " closed\n", 
+			perf.h5_open, perf.h5_close);
+	fprintf(f, "   allocations: %" PRIu64 " (%" PRIu64 " bytes)\n", 
+			perf.alloc, perf.alloc_bytes);
+}
+
 void version(char * prog)
 {
 	fprintf(stderr, "%s\n", PACKAGE_STRING);
@@ -61,6 +119,883 @@ void version(char * prog)
 	exit(1);
 }
 
+/* Raw samples read and filtered at a time */
+#define RAW_CHUNK_LEN 16384
+
+static int16_t raw_chunk[RAW_CHUNK_LEN];
+
+/* Output buffer size for the FASTQ dump */
+#define FASTQ_BUF_SIZE (4 * 1024 * 1024)
+
+/* Write the template FASTQ record of a file */
+static void fastq_record(FILE * f, struct fast5_reader * rd, 
+						 struct fast5 * f5, const char * path)
+{
+	size_t len;
+	char * seq;
+
+	if ((seq = fast5_reader_fastq(rd, f5, FAST5_STRAND_TEMPLATE, 
+								  &len)) == NULL) {
+		if (verbose)
+			fprintf(stderr, "%s: no FASTQ!\n", path);
+	} else if (len > 0) {
+		fwrite(seq, 1, len, f);
+		if (seq[len - 1] != '\n')
+			fputc('\n', f);
+	}
+}
+
+/* Write the template FASTQ records of the files under a directory */
+static int fastq_dir_write(FILE * f, struct fast5_dir_iter * it)
+{
+	char path[PATH_MAX];
+	struct fast5_reader * rd;
+	struct fast5 * f5;
+
+	if ((rd = fast5_reader_new()) == NULL)
+		return -1;
+
+	while ((f5 = fast5_dir_iter_next(it, path, sizeof(path))) != NULL) {
+		fastq_record(f, rd, f5, path);
+		fast5_close(f5);
+	}
+
+	fast5_reader_free(rd);
+
+	if (fflush(f) != 0)
+		return -1;
+
+	return 0;
+}
+
+/* Write the template FASTQ records of a set of files */
+static int fastq_write(FILE * f, char ** path, int cnt)
+{
+	struct fast5_reader * rd;
+	struct fast5 * f5;
+	int i;
+
+	if ((rd = fast5_reader_new()) == NULL)
+		return -1;
+
+	for (i = 0; i < cnt; ++i) {
+		/* Only the basecall group is needed, skip the validation */
+		if ((f5 = fast5_open_flags(path[i], FAST5_LAZY)) == NULL) {
+			fprintf(stderr, "%s: %s, skipped\n", path[i], 
+					fast5_strerror(fast5_error()));
+			continue;
+		}
+
+		fastq_record(f, rd, f5, path[i]);
+		fast5_close(f5);
+	}
+
+	fast5_reader_free(rd);
+
+	if (fflush(f) != 0)
+		return -1;
+
+	return 0;
+}
+
+/* Dump the FASTQ records of all files to stdout, in the input order */
+static int fastq_dump(char ** path, int cnt, int jobs)
+{
+	static char buf[FASTQ_BUF_SIZE];
+	FILE ** tmp;
+	int first = 0;
+	int err = 0;
+	int status;
+	size_t n;
+	int i;
+
+	if (jobs > cnt)
+		jobs = cnt;
+
+	if (jobs <= 1)
+		return fastq_write(stdout, path, cnt);
+
+	if ((tmp = calloc(jobs, sizeof(FILE *))) == NULL)
+		return -1;
+
+	/* One worker process per slice of the input files (see "Threads" in 
+	   fast5.h). Each worker writes to its own temporary file, which is 
+	   then copied to the output. */
+	fflush(stdout);
+	for (i = 0; i < jobs; ++i) {
+		int n = cnt / jobs + ((i < cnt % jobs) ? 1 : 0);
+		pid_t pid;
+
+		if ((tmp[i] = tmpfile()) == NULL) {
+			fprintf(stderr, "tmpfile(): %s\n", strerror(errno));
+			err++;
+			break;
+		}
+
+		if ((pid = fork()) == 0) {
+			setvbuf(tmp[i], NULL, _IOFBF, FASTQ_BUF_SIZE);
+			exit(fastq_write(tmp[i], &path[first], n) < 0 ? 1 : 0);
+		}
+
+		if (pid < 0) {
+			fprintf(stderr, "fork(): %s\n", strerror(errno));
+			err++;
+			break;
+		}
+
+		first += n;
+	}
+
+	while (wait(&status) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			err++;
+	}
+
+	for (i = 0; i < jobs && tmp[i] != NULL; ++i) {
+		rewind(tmp[i]);
+		while ((n = fread(buf, 1, sizeof(buf), tmp[i])) > 0)
+			fwrite(buf, 1, n, stdout);
+		fclose(tmp[i]);
+	}
+
+	free(tmp);
+
+	return err ? -1 : 0;
+}
+
+/* Read summary, one row per read */
+struct summary_row {
+	/* the base name, it always fits */
+	char filename[NAME_MAX + 1];
+	char read_id[FAST5_UUID_MAX + 1];
+	char channel_number[16];
+	double digitisation;
+	double offset;
+	double range;
+	double sampling_rate;
+	uint32_t read_number;
+	uint8_t has_raw;
+	uint8_t has_events;
+	uint32_t raw_duration;
+	double raw_median_before;
+	int32_t raw_start_mux;
+	uint64_t raw_start_time;
+	uint64_t raw_length;
+	uint32_t events_duration;
+	double events_median_before;
+	int64_t events_scaling_used;
+	int32_t events_start_mux;
+	double events_start_time;
+	uint64_t events_length;
+};
+
+#define SUMMARY_COL(NAME, TYPE) { #NAME, TYPE, \
+	sizeof(((struct summary_row *)0)->NAME), \
+	offsetof(struct summary_row, NAME) }
+
+static const struct {
+	const char * name;
+	unsigned int type;
+	size_t size;
+	size_t offset;
+} summary_cols[] = {
+	SUMMARY_COL(filename, FTAB_STR),
+	SUMMARY_COL(read_id, FTAB_STR),
+	SUMMARY_COL(read_number, FTAB_U32),
+	SUMMARY_COL(channel_number, FTAB_STR),
+	SUMMARY_COL(digitisation, FTAB_F64),
+	SUMMARY_COL(offset, FTAB_F64),
+	SUMMARY_COL(range, FTAB_F64),
+	SUMMARY_COL(sampling_rate, FTAB_F64),
+	SUMMARY_COL(has_raw, FTAB_U8),
+	SUMMARY_COL(raw_duration, FTAB_U32),
+	SUMMARY_COL(raw_median_before, FTAB_F64),
+	SUMMARY_COL(raw_start_mux, FTAB_I32),
+	SUMMARY_COL(raw_start_time, FTAB_U64),
+	SUMMARY_COL(raw_length, FTAB_U64),
+	SUMMARY_COL(has_events, FTAB_U8),
+	SUMMARY_COL(events_duration, FTAB_U32),
+	SUMMARY_COL(events_median_before, FTAB_F64),
+	SUMMARY_COL(events_scaling_used, FTAB_I64),
+	SUMMARY_COL(events_start_mux, FTAB_I32),
+	SUMMARY_COL(events_start_time, FTAB_F64),
+	SUMMARY_COL(events_length, FTAB_U64),
+};
+
+/* Summary rows collected before a write */
+#define SUMMARY_BATCH_ROWS 4096
+
+/* A batch of summary rows, appended to the table or, in a worker 
+   process, written as they are to a temporary file */
+struct summary_buf {
+	struct ftab * tab;
+	FILE * f;
+	unsigned int cnt;
+	struct summary_row row[SUMMARY_BATCH_ROWS];
+};
+
+static int summary_flush(struct summary_buf * sb)
+{
+	int ret = 0;
+
+	if (sb->cnt == 0)
+		return 0;
+
+	if (sb->tab != NULL)
+		ret = ftab_append(sb->tab, sb->row, sizeof(struct summary_row), 
+						  sb->cnt);
+	else if (fwrite(sb->row, sizeof(struct summary_row), sb->cnt, 
+					sb->f) != sb->cnt)
+		ret = -1;
+
+	sb->cnt = 0;
+
+	return ret;
+}
+
+/* Copy a string to a NUL padded column, truncated if needed */
+static void summary_str(char * dst, size_t size, const char * src)
+{
+	size_t n = strnlen(src, size - 1);
+
+	memcpy(dst, src, n);
+	memset(dst + n, 0, size - n);
+}
+
+/* Add the rows of all the reads of a file */
+static int summary_file(struct summary_buf * sb, struct fast5 * f5)
+{
+	struct fast5_events_info ev;
+	struct fast5_channel_id ch;
+	struct fast5_raw raw;
+	struct fast5_info info;
+	struct summary_row * row;
+	int cnt;
+	int i;
+
+	fast5_info(f5, &info);
+
+	cnt = fast5_read_count(f5);
+	for (i = 0; i < cnt; ++i) {
+		if (fast5_read_select(f5, i) < 0)
+			continue;
+
+		if ((sb->cnt == SUMMARY_BATCH_ROWS) && (summary_flush(sb) < 0))
+			return -1;
+
+		row = &sb->row[sb->cnt++];
+		/* zero the string padding as well, it goes to the output */
+		memset(row, 0, sizeof(struct summary_row));
+		summary_str(row->filename, sizeof(row->filename), info.filename);
+
+		if (fast5_channel_id(f5, &ch) == 0) {
+			summary_str(row->channel_number, sizeof(row->channel_number), 
+						ch.channel_number);
+			row->digitisation = ch.digitisation;
+			row->offset = ch.offset;
+			row->range = ch.range;
+			row->sampling_rate = ch.sampling_rate;
+		}
+
+		if (fast5_raw_read_info(f5, &raw) == 0) {
+			row->has_raw = 1;
+			memcpy(row->read_id, raw.read_id, sizeof(row->read_id));
+			row->read_number = raw.read_number;
+			row->raw_duration = raw.duration;
+			row->raw_median_before = raw.median_before;
+			row->raw_start_mux = raw.start_mux;
+			row->raw_start_time = raw.start_time;
+			row->raw_length = raw.length;
+		}
+
+		if (fast5_events_info(f5, &ev) == 0) {
+			row->has_events = 1;
+			if (!row->has_raw) {
+				memcpy(row->read_id, ev.read_id, sizeof(row->read_id));
+				row->read_number = ev.read_number;
+			}
+			row->events_duration = ev.duration;
+			row->events_median_before = ev.median_before;
+			row->events_scaling_used = ev.scaling_used;
+			row->events_start_mux = ev.start_mux;
+			row->events_start_time = ev.start_time;
+			row->events_length = ev.length;
+		}
+	}
+
+	return 0;
+}
+
+/* Summary rows of a set of files */
+static int summary_write(struct summary_buf * sb, char ** path, int cnt)
+{
+	struct fast5 * f5;
+	int i;
+
+	for (i = 0; i < cnt; ++i) {
+		if ((f5 = fast5_open(path[i])) == NULL) {
+			fprintf(stderr, "%s: %s, skipped\n", path[i], 
+					fast5_strerror(fast5_error()));
+			continue;
+		}
+
+		summary_file(sb, f5);
+		fast5_close(f5);
+	}
+
+	return summary_flush(sb);
+}
+
+/* Summary rows of the part-th of every nparts files under dir */
+static int summary_dir(struct summary_buf * sb, const char * dir, 
+					   int part, int nparts)
+{
+	struct fast5_dir_opt opt;
+	struct fast5_dir_iter * it;
+	struct fast5 * f5;
+	int err = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.part = part;
+	opt.nparts = nparts;
+	if ((it = fast5_dir_iter_new(dir, &opt)) == NULL) {
+		fprintf(stderr, "%s: %s\n", dir, fast5_strerror(fast5_error()));
+		return -1;
+	}
+
+	while ((f5 = fast5_dir_iter_next(it, NULL, 0)) != NULL) {
+		if (summary_file(sb, f5) < 0)
+			err++;
+		fast5_close(f5);
+	}
+
+	fast5_dir_iter_free(it);
+
+	if (summary_flush(sb) < 0)
+		err++;
+
+	return err ? -1 : 0;
+}
+
+/* Write the read summary table of the files in the list, in the input 
+   order, or of the files under dir. Each worker of a directory walks 
+   the tree and takes every jobs-th file, as f5stats does, the rows are 
+   in walk order within the files of a worker. */
+static int summary_dump(const char * out, unsigned int fmt, 
+						const char * dir, char ** path, int cnt, int jobs)
+{
+	struct summary_buf * sb;
+	struct ftab * tab;
+	FILE ** tmp = NULL;
+	int first = 0;
+	int err = 0;
+	int status;
+	size_t n;
+	int i;
+
+	if ((out != NULL) && (strcmp(out, "-") == 0))
+		out = NULL;
+
+	if ((tab = ftab_create(out, fmt)) == NULL) {
+		fprintf(stderr, "%s: %s\n", out, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < (int)(sizeof(summary_cols) / sizeof(summary_cols[0])); 
+		 ++i) {
+		if (ftab_col_new(tab, summary_cols[i].name, summary_cols[i].type, 
+						 summary_cols[i].size, summary_cols[i].offset) < 0) {
+			ftab_close(tab);
+			return -1;
+		}
+	}
+
+	if ((sb = calloc(1, sizeof(struct summary_buf))) == NULL) {
+		ftab_close(tab);
+		return -1;
+	}
+	sb->tab = tab;
+
+	if ((dir == NULL) && (jobs > cnt))
+		jobs = cnt;
+
+	if (jobs <= 1) {
+		if (((dir != NULL) ? summary_dir(sb, dir, 0, 1) : 
+			 summary_write(sb, path, cnt)) < 0)
+			err++;
+	} else if ((tmp = calloc(jobs, sizeof(FILE *))) == NULL) {
+		err++;
+	} else {
+		/* Same as the FASTQ dump: one worker process per slice of the 
+		   input files or part of the tree, each writes its rows to a 
+		   temporary file. */
+		fflush(stdout);
+		for (i = 0; i < jobs; ++i) {
+			int n = cnt / jobs + ((i < cnt % jobs) ? 1 : 0);
+			pid_t pid;
+
+			if ((tmp[i] = tmpfile()) == NULL) {
+				fprintf(stderr, "tmpfile(): %s\n", strerror(errno));
+				err++;
+				break;
+			}
+
+			if ((pid = fork()) == 0) {
+				sb->tab = NULL;
+				sb->f = tmp[i];
+				if (dir != NULL)
+					err = summary_dir(sb, dir, i, jobs);
+				else
+					err = summary_write(sb, &path[first], n);
+				exit((err < 0) || (fflush(tmp[i]) != 0) ? 1 : 0);
+			}
+
+			if (pid < 0) {
+				fprintf(stderr, "fork(): %s\n", strerror(errno));
+				err++;
+				break;
+			}
+
+			first += n;
+		}
+
+		while (wait(&status) > 0) {
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				err++;
+		}
+
+		for (i = 0; i < jobs && tmp[i] != NULL; ++i) {
+			rewind(tmp[i]);
+			while ((n = fread(sb->row, sizeof(struct summary_row), 
+							  SUMMARY_BATCH_ROWS, tmp[i])) > 0) {
+				if (ftab_append(tab, sb->row, sizeof(struct summary_row), 
+								n) < 0)
+					err++;
+			}
+			fclose(tmp[i]);
+		}
+
+		free(tmp);
+	}
+
+	free(sb);
+
+	if (ftab_close(tab) < 0)
+		err++;
+
+	return err ? -1 : 0;
+}
+
+/* Dump the raw samples of a channel in a time window. The reads are 
+   looked up in the index, only the overlapping ones are opened. */
+static int query_dump(const char * spec, const char * index, 
+					  struct fast5_dir_iter * it, char ** path, int cnt)
+{
+	struct fast5_index_hit * hit = NULL;
+	struct fast5_index * idx;
+	struct fast5 * f5 = NULL;
+	const char * f5_path = NULL;
+	char fpath[PATH_MAX];
+	int16_t * raw = NULL;
+	size_t raw_len = 0;
+	unsigned int chan;
+	uint64_t t0;
+	uint64_t t1;
+	char * cp;
+	int err = 0;
+	int nhits;
+	int n;
+	int i;
+	int j;
+	FILE * f;
+
+	chan = strtoul(spec, &cp, 10);
+	if (*cp++ != ':')
+		goto invalid;
+	t0 = strtoull(cp, &cp, 0);
+	if (*cp++ != ':')
+		goto invalid;
+	t1 = strtoull(cp, &cp, 0);
+	if ((*cp != '\0') || (t1 <= t0))
+		goto invalid;
+
+	if (index != NULL) {
+		if ((f = fopen(index, "rb")) == NULL) {
+			fprintf(stderr, "%s: %s\n", index, strerror(errno));
+			return -1;
+		}
+		idx = fast5_index_load(f);
+		fclose(f);
+		if (idx == NULL) {
+			fprintf(stderr, "%s: invalid read index!\n", index);
+			return -1;
+		}
+	} else {
+		/* no saved index, scan the files */
+		if ((idx = fast5_index_new()) == NULL)
+			return -1;
+		for (i = 0; ; ++i) {
+			if (it != NULL) {
+				if ((f5 = fast5_dir_iter_next(it, fpath, 
+											  sizeof(fpath))) == NULL)
+					break;
+			} else {
+				if (i == cnt)
+					break;
+				strncpy(fpath, path[i], sizeof(fpath) - 1);
+				fpath[sizeof(fpath) - 1] = '\0';
+				if ((f5 = fast5_open(path[i])) == NULL) {
+					fprintf(stderr, "%s: %s, skipped\n", path[i], 
+							fast5_strerror(fast5_error()));
+					continue;
+				}
+			}
+			if (fast5_index_add_file(idx, f5, fpath) < 0)
+				err++;
+			fast5_close(f5);
+		}
+		f5 = NULL;
+	}
+
+	nhits = fast5_index_query(idx, chan, t0, t1, NULL, 0);
+	if ((nhits > 0) && 
+		((hit = malloc(nhits * sizeof(struct fast5_index_hit))) == NULL)) {
+		fast5_index_free(idx);
+		return -1;
+	}
+	fast5_index_query(idx, chan, t0, t1, hit, nhits);
+
+	for (i = 0; i < nhits; ++i) {
+		/* the reads of a multi-read file share the handle */
+		if ((f5_path == NULL) || (strcmp(f5_path, hit[i].path) != 0)) {
+			if (f5 != NULL)
+				fast5_close(f5);
+			f5_path = hit[i].path;
+			if ((f5 = fast5_open(f5_path)) == NULL) {
+				fprintf(stderr, "%s: %s, skipped\n", f5_path, 
+						fast5_strerror(fast5_error()));
+				err++;
+				continue;
+			}
+		}
+		if (f5 == NULL)
+			continue;
+
+		if (hit[i].count > raw_len) {
+			free(raw);
+			raw_len = hit[i].count;
+			if ((raw = malloc(raw_len * sizeof(int16_t))) == NULL) {
+				err++;
+				break;
+			}
+		}
+
+		if ((n = fast5_index_hit_read(f5, &hit[i], raw)) < 0) {
+			fprintf(stderr, "%s: read %u: %s\n", f5_path, hit[i].read, 
+					fast5_strerror(n));
+			err++;
+			continue;
+		}
+
+		if (verbose)
+			printf("# %s read %u: %" PRIu64 " samples from %" PRIu64 
+				   " (%" PRIu64 ")\n", f5_path, hit[i].read, 
+				   (uint64_t)n, hit[i].offset, hit[i].start + hit[i].offset);
+		for (j = 0; j < n; ++j)
+			printf("%d\n", raw[j]);
+	}
+
+	if (f5 != NULL)
+		fast5_close(f5);
+	free(raw);
+	free(hit);
+	fast5_index_free(idx);
+
+	return err ? -1 : 0;
+
+invalid:
+	fprintf(stderr, "invalid query: %s\n", spec);
+	return -1;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Scans of the loaded signals */
+#define BENCH_PASSES 8
+
+struct bench_read {
+	int16_t * raw;
+	size_t len;
+};
+
+struct bench_job {
+	pthread_t thread;
+	pthread_barrier_t * barrier;
+	/* the HDF5 calls of the workers are serialized */
+	pthread_mutex_t * io_mutex;
+	char ** path;
+	int cnt;
+	int part;
+	int jobs;
+	/* fast5_arena_new() flags, -1 for the heap */
+	int arena;
+	struct bench_read * read;
+	unsigned int nreads;
+	uint64_t bytes;
+	int64_t sum;
+	int err;
+};
+
+static int bench_load(struct bench_job * job, 
+					  const struct fast5_allocator * a)
+{
+	struct fast5_raw raw_read;
+	struct bench_read * tmp;
+	struct fast5 * f5;
+	unsigned int size = 0;
+	int16_t * raw;
+	int n;
+	int i;
+	int j;
+
+	for (i = job->part; i < job->cnt; i += job->jobs) {
+		pthread_mutex_lock(job->io_mutex);
+		if ((f5 = fast5_open(job->path[i])) == NULL) {
+			pthread_mutex_unlock(job->io_mutex);
+			continue;
+		}
+
+		n = fast5_read_count(f5);
+		for (j = 0; j < n; ++j) {
+			if ((fast5_read_select(f5, j) < 0) ||
+				(fast5_raw_read_info_mask(f5, &raw_read, 
+										  FAST5_F_LENGTH) < 0) ||
+				(raw_read.length == 0))
+				continue;
+
+			if (job->nreads == size) {
+				size = size ? 2 * size : 1024;
+				if ((tmp = realloc(job->read, size * 
+								   sizeof(struct bench_read))) == NULL)
+					break;
+				job->read = tmp;
+			}
+
+			if ((raw = a->alloc(a->arg, raw_read.length * 
+								sizeof(int16_t))) == NULL)
+				break;
+
+			if (fast5_raw_read(f5, raw, raw_read.length) < 0) {
+				a->free(a->arg, raw, raw_read.length * sizeof(int16_t));
+				job->err++;
+				continue;
+			}
+
+			job->read[job->nreads].raw = raw;
+			job->read[job->nreads].len = raw_read.length;
+			job->nreads++;
+			job->bytes += raw_read.length * sizeof(int16_t);
+		}
+
+		fast5_close(f5);
+		pthread_mutex_unlock(job->io_mutex);
+
+		if (j < n) {
+			job->err++;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void * bench_thread(void * arg)
+{
+	struct bench_job * job = (struct bench_job *)arg;
+	const struct fast5_allocator * a = &fast5_heap_allocator;
+	struct fast5_arena * ar = NULL;
+	int64_t sum = 0;
+	unsigned int i;
+	size_t j;
+	int k;
+
+	/* the arena is created and first touched by its worker */
+	if ((job->arena >= 0) && 
+		((ar = fast5_arena_new(0, job->arena)) != NULL))
+		a = fast5_arena_allocator(ar);
+	else if (job->arena >= 0)
+		job->err++;
+
+	bench_load(job, a);
+
+	/* loaded */
+	pthread_barrier_wait(job->barrier);
+	/* scan */
+	pthread_barrier_wait(job->barrier);
+
+	for (k = 0; k < BENCH_PASSES; ++k) {
+		for (i = 0; i < job->nreads; ++i) {
+			const int16_t * raw = job->read[i].raw;
+			size_t len = job->read[i].len;
+
+			for (j = 0; j < len; ++j)
+				sum += raw[j];
+		}
+	}
+	job->sum = sum;
+
+	/* scanned */
+	pthread_barrier_wait(job->barrier);
+
+	if (ar != NULL) {
+		fast5_arena_free(ar);
+	} else {
+		for (i = 0; i < job->nreads; ++i)
+			a->free(a->arg, job->read[i].raw, 
+					job->read[i].len * sizeof(int16_t));
+	}
+	free(job->read);
+
+	return NULL;
+}
+
+/* Load the raw signals of all the files in memory, taken from each 
+   allocator, and time the scans of the signals. Each of the jobs 
+   threads loads and scans a part of the files. */
+static int bench(char ** path, int cnt, int jobs)
+{
+	static const struct {
+		const char * name;
+		int arena;
+	} alloc[] = {
+		{ "heap", -1 },
+		{ "arena", 0 },
+		{ "arena+hugepage", FAST5_ARENA_HUGEPAGE },
+		{ "arena+first-touch", FAST5_ARENA_FIRST_TOUCH },
+		{ "arena+hugepage+first-touch", 
+			FAST5_ARENA_HUGEPAGE | FAST5_ARENA_FIRST_TOUCH },
+	};
+	pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_barrier_t barrier;
+	struct bench_job * job;
+	uint64_t bytes;
+	int64_t sum;
+	double t0;
+	double t1;
+	double t2;
+	double t3;
+	int err = 0;
+	int i;
+	int k;
+
+	if (jobs < 1)
+		jobs = 1;
+
+	if ((job = calloc(jobs, sizeof(struct bench_job))) == NULL)
+		return -1;
+
+	printf("%d files, %d threads, %d passes\n", cnt, jobs, BENCH_PASSES);
+
+	for (k = 0; k < (int)(sizeof(alloc) / sizeof(alloc[0])); ++k) {
+		pthread_barrier_init(&barrier, NULL, jobs + 1);
+		memset(job, 0, jobs * sizeof(struct bench_job));
+
+		t0 = now();
+		for (i = 0; i < jobs; ++i) {
+			job[i].barrier = &barrier;
+			job[i].io_mutex = &io_mutex;
+			job[i].path = path;
+			job[i].cnt = cnt;
+			job[i].part = i;
+			job[i].jobs = jobs;
+			job[i].arena = alloc[k].arena;
+			if (pthread_create(&job[i].thread, NULL, bench_thread, 
+							   &job[i]) != 0) {
+				fprintf(stderr, "pthread_create(): %s\n", strerror(errno));
+				exit(3);
+			}
+		}
+
+		pthread_barrier_wait(&barrier);
+		t1 = now();
+		pthread_barrier_wait(&barrier);
+		t2 = now();
+		pthread_barrier_wait(&barrier);
+		t3 = now();
+
+		bytes = 0;
+		sum = 0;
+		for (i = 0; i < jobs; ++i) {
+			pthread_join(job[i].thread, NULL);
+			bytes += job[i].bytes;
+			sum += job[i].sum;
+			err += job[i].err;
+		}
+		pthread_barrier_destroy(&barrier);
+
+		printf("%-28s %9.1f MB  load %7.3f s  scan %7.2f GB/s  "
+			   "(sum %" PRIi64 ")\n", alloc[k].name, bytes / 1e6, 
+			   t1 - t0, (t3 > t2) ? bytes * BENCH_PASSES / 
+			   (t3 - t2) / 1e9 : 0.0, sum);
+	}
+
+	free(job);
+
+	return err ? -1 : 0;
+}
+
+/* Benchmark of the files under a directory */
+static int bench_dir(struct fast5_dir_iter * it, int jobs)
+{
+	char path[PATH_MAX];
+	struct fast5 * f5;
+	char ** lst = NULL;
+	char ** tmp;
+	int size = 0;
+	int cnt = 0;
+	int ret = -1;
+
+	while ((f5 = fast5_dir_iter_next(it, path, sizeof(path))) != NULL) {
+		fast5_close(f5);
+		if (cnt == size) {
+			size = size ? 2 * size : 256;
+			if ((tmp = realloc(lst, size * sizeof(char *))) == NULL)
+				goto done;
+			lst = tmp;
+		}
+		if ((lst[cnt] = strdup(path)) == NULL)
+			goto done;
+		cnt++;
+	}
+
+	ret = bench(lst, cnt, jobs);
+
+done:
+	while (cnt > 0)
+		free(lst[--cnt]);
+	free(lst);
+
+	return ret;
+}
+
+static const struct option long_opts[] = {
+	{ "stats", no_argument, NULL, 'S' },
+	{ "filter", required_argument, NULL, 'f' },
+	{ "recursive", required_argument, NULL, 'R' },
+	{ "summary", required_argument, NULL, 's' },
+	{ "tsv", no_argument, NULL, 'T' },
+	{ "query", required_argument, NULL, 'Q' },
+	{ "index", required_argument, NULL, 'X' },
+	{ "bench", no_argument, NULL, 'B' },
+	{ NULL, 0, NULL, 0 }
+};
+
 int main(int argc,  char **argv)
 {
 	extern char *optarg;	/* getopt */
@@ -71,21 +1006,49 @@ int main(int argc,  char **argv)
 	struct fast5_raw raw_read;
 	struct fast5_events_info events_info;
 	struct fast5_channel_id channel_id;
+	struct fast5_reader * rd;
 	char * path; /* fast5 input file */
 	int c;
 	int16_t * raw;
 	struct fast5_event * event;
 	int cnt;
+	int n;
 	int i;
 	bool dump_raw = false;
 	bool dump_events = false;
+	bool dump_stats = false;
+	bool dump_fastq = false;
+	char * analysis = NULL;
+	struct fast5_filter * flt = NULL;
+	int16_t * flt_out = NULL;
+	size_t pos;
+	size_t trim = 0;
+	bool do_trim = false;
+	struct fast5_event_index * idx;
+	struct fast5_dset_info ds_info;
+	struct fast5_dset * ds;
+	uint64_t win_first = 0;
+	uint64_t win_cnt = 0;
+	long first;
+	long last;
+	char * cp;
+	struct fast5_analysis an;
+	int jobs = 1;
+	struct fast5_dir_opt dir_opt;
+	struct fast5_dir_iter * it = NULL;
+	char * dir = NULL;
+	char * summary = NULL;
+	unsigned int summary_fmt = FTAB_FMT_BIN;
+	char * query = NULL;
+	char * index = NULL;
+	bool do_bench = false;
 
 	/* the prog name start just after the last lash */
 	if ((prog = (char *)basename(argv[0])) == NULL)
 		prog = argv[0];
 
 	/* parse the command line options */
-	while ((c = getopt(argc, argv, "V?vre")) > 0) {
+	while ((c = getopt_long(argc, argv, "V?vretqj:a:w:R:", long_opts, NULL)) > 0) {
 		switch (c) {
 		case 'V':
 			version(prog);
@@ -107,24 +1070,154 @@ int main(int argc,  char **argv)
 			dump_events = true;
 			break;
 
+		case 't':
+			do_trim = true;
+			break;
+
+		case 'q':
+			dump_fastq = true;
+			break;
+
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+
+		case 'a':
+			analysis = optarg;
+			break;
+
+		case 'w':
+			win_first = strtoull(optarg, &cp, 0);
+			win_cnt = (*cp == ',') ? strtoull(cp + 1, NULL, 0) : 1;
+			break;
+
+		case 'S':
+			dump_stats = true;
+			break;
+
+		case 'R':
+			dir = optarg;
+			break;
+
+		case 's':
+			summary = optarg;
+			break;
+
+		case 'T':
+			summary_fmt = FTAB_FMT_TSV;
+			break;
+
+		case 'Q':
+			query = optarg;
+			break;
+
+		case 'X':
+			index = optarg;
+			break;
+
+		case 'B':
+			do_bench = true;
+			break;
+
+		case 'f':
+			if ((flt = fast5_filter_new(optarg)) == NULL) {
+				fprintf(stderr, "%s: invalid filter: %s\n", prog, optarg);
+				return 1;
+			}
+			break;
+
 		default:
 			fprintf(stderr, "%s: invalid option %s\n", prog, optarg);
 			return 1;
 		}
 	}
 
-	if (optind == argc) {
+	if ((optind == argc) && (dir == NULL) && 
+		((query == NULL) || (index == NULL))) {
 		fprintf(stderr, "%s: missing filename.\n\n", prog);
 		usage(stderr, prog);
 		return 2;
 	}
 
-	while (optind < argc) {
-		path = argv[optind++];
+	/* the summary workers walk the directory each */
+	if (summary != NULL) {
+		c = summary_dump(summary, summary_fmt, dir, &argv[optind], 
+						 argc - optind, jobs);
+		if (dump_stats)
+			stats(stderr, prog);
+		return (c < 0) ? 3 : 0;
+	}
 
-		if ((f5 = fast5_open(path)) == NULL) {
-			fprintf(stderr, "%s: Not a FAST5 file!\n", prog);
-			return 3;
+	if (dir != NULL) {
+		memset(&dir_opt, 0, sizeof(dir_opt));
+		/* Only the basecall group is needed for the FASTQ dump */
+		dir_opt.flags = dump_fastq ? FAST5_LAZY : 0;
+		if ((it = fast5_dir_iter_new(dir, &dir_opt)) == NULL) {
+			fprintf(stderr, "%s: %s: %s\n", prog, dir, 
+					fast5_strerror(fast5_error()));
+			return 2;
+		}
+	}
+
+	if (do_bench) {
+		if (it != NULL) {
+			c = bench_dir(it, jobs);
+			fast5_dir_iter_free(it);
+		} else
+			c = bench(&argv[optind], argc - optind, jobs);
+		if (dump_stats)
+			stats(stderr, prog);
+		return (c < 0) ? 3 : 0;
+	}
+
+	if (query != NULL) {
+		c = query_dump(query, index, it, &argv[optind], argc - optind);
+		if (it != NULL)
+			fast5_dir_iter_free(it);
+		if (dump_stats)
+			stats(stderr, prog);
+		return (c < 0) ? 3 : 0;
+	}
+
+	if (dump_fastq && (it != NULL)) {
+		setvbuf(stdout, NULL, _IOFBF, FASTQ_BUF_SIZE);
+		c = fastq_dir_write(stdout, it);
+		fast5_dir_iter_free(it);
+		if (dump_stats)
+			stats(stderr, prog);
+		return (c < 0) ? 3 : 0;
+	}
+
+	if (dump_fastq) {
+		setvbuf(stdout, NULL, _IOFBF, FASTQ_BUF_SIZE);
+		c = fastq_dump(&argv[optind], argc - optind, jobs);
+		fflush(stdout);
+		if (dump_stats)
+			stats(stderr, prog);
+		return (c < 0) ? 3 : 0;
+	}
+
+	if ((rd = fast5_reader_new()) == NULL) {
+		fprintf(stderr, "%s: can't allocate reader!\n", prog);
+		return 3;
+	}
+
+	for (;;) {
+		if (it != NULL) {
+			/* the files under DIR, in path order */
+			if ((f5 = fast5_dir_iter_next(it, NULL, 0)) == NULL)
+				break;
+		} else {
+			if (optind == argc)
+				break;
+			path = argv[optind++];
+
+			/* junk files are skipped, the run goes on */
+			if ((f5 = fast5_open(path)) == NULL) {
+				fprintf(stderr, "%s: %s: %s, skipped\n", prog, path, 
+						fast5_strerror(fast5_error()));
+				continue;
+			}
 		}
 
 		fast5_info(f5, &info);
@@ -134,6 +1227,19 @@ int main(int argc,  char **argv)
 				   info.version.minor);
 		}
 
+		if ((analysis != NULL) && 
+			(fast5_analysis_select(f5, analysis) < 0)) {
+			fprintf(stderr, "%s: no analysis \"%s\"!\n", prog, analysis);
+			return 3;
+		}
+
+		if (verbose) {
+			for (i = 0; fast5_analysis_get(f5, i, &an) == 0; ++i) {
+				printf("       analysis: %-24s %c\n", an.name, 
+					   an.selected ? '*' : ' ');
+			}
+		}
+
 		if (fast5_channel_id(f5, &channel_id) < 0) {
 			fprintf(stderr, "%s: channel_id error!\n", prog);
 			return 3;
@@ -160,6 +1266,22 @@ int main(int argc,  char **argv)
 			printf("         length: %u\n", (int)raw_read.length);
 		}
 
+		if (verbose && ((ds = fast5_raw_open(f5)) != NULL)) {
+			fast5_dset_info(ds, &ds_info);
+			fast5_dset_close(ds);
+			printf("        storage: %s", 
+				   (ds_info.layout == FAST5_LAYOUT_CHUNKED) ? "chunked" : 
+				   (ds_info.layout == FAST5_LAYOUT_COMPACT) ? "compact" : 
+				   "contiguous");
+			if (ds_info.chunk)
+				printf(" %zu", ds_info.chunk);
+			if (ds_info.filters & FAST5_FILTER_SHUFFLE)
+				printf(", shuffle");
+			if (ds_info.filters & FAST5_FILTER_DEFLATE)
+				printf(", deflate");
+			printf(", %" PRIu64 " bytes\n", ds_info.storage);
+		}
+
 		if (fast5_events_info(f5, &events_info) < 0) {
 			//fprintf(stderr, "%s: events info error!\n", prog);
 		} else if (verbose) {
@@ -174,28 +1296,96 @@ int main(int argc,  char **argv)
 			printf("         length: %d\n", (int)events_info.length);
 		}
 
-		if (dump_raw) {
-			if ((cnt = raw_read.length) > 0) {
-				raw = malloc(cnt*sizeof(int16_t));;
+		trim = 0;
+		if (do_trim && (raw_read.length > 0)) {
+			if (fast5_raw_trim(f5, NULL, &trim) < 0) {
+				fprintf(stderr, "%s: raw data read error!\n", prog);
+				return 3;
+			}
+			if (verbose)
+				printf("           trim: %zu\n", trim);
+		}
 
-				if (fast5_raw_read(f5, raw, cnt) < 0) {
+		if (dump_raw && (flt != NULL)) {
+			/* read, filter and print one chunk at a time, the 
+			   resampling stages need the read's sampling rate */
+			fast5_filter_rate(flt, channel_id.sampling_rate);
+			n = fast5_filter_len(flt, RAW_CHUNK_LEN);
+			if ((raw = realloc(flt_out, n * sizeof(int16_t))) == NULL)
+				return 3;
+			flt_out = raw;
+			/* the signal is opened once for all the chunks */
+			ds = NULL;
+			if ((raw_read.length > trim) && 
+				((ds = fast5_raw_open(f5)) == NULL)) {
+				fprintf(stderr, "%s: raw data read error!\n", prog);
+				return 3;
+			}
+			for (pos = trim; pos < raw_read.length; pos += cnt) {
+				cnt = raw_read.length - pos;
+				if (cnt > RAW_CHUNK_LEN)
+					cnt = RAW_CHUNK_LEN;
+				if ((fast5_dset_read(ds, raw_chunk, pos, cnt) < 0) ||
+					((n = fast5_filter_process(flt, raw_chunk, cnt, 
+											   flt_out)) < 0)) {
+					fprintf(stderr, "%s: raw data read error!\n", prog);
+					return 3;
+				}
+				for (i = 0; i < n; ++i) {
+					printf("%d\n", flt_out[i]);
+				}
+			}
+			if (ds != NULL)
+				fast5_dset_close(ds);
+		} else if (dump_raw) {
+			if ((cnt = raw_read.length) > 0) {
+				if ((raw = fast5_reader_raw(rd, f5, cnt)) == NULL) {
 					fprintf(stderr, "%s: raw data read error!\n", prog);
 					return 3;
 				} 
-				for (i = 0; i < cnt; ++i) {
+				for (i = trim; i < cnt; ++i) {
 					printf("%d\n", raw[i]);
 				}
-
-				free(raw);
 			}
 		}
 
-		if (dump_events) {
-			if ((cnt = events_info.length) > 0) {
+		if (dump_events && (win_cnt > 0)) {
+			/* the window is in samples of the raw signal, the events 
+			   start field counts samples from the beginning of the run, 
+			   as the raw read start_time does */
+			win_first += raw_read.start_time;
+			if ((idx = fast5_event_index_new(f5, 0)) == NULL) {
+				fprintf(stderr, "%s: events index error!\n", prog);
+				return 3;
+			}
+			first = fast5_event_index_lookup(idx, win_first);
+			last = fast5_event_index_lookup(idx, win_first + win_cnt - 1);
+			fast5_event_index_free(idx);
+			win_first -= raw_read.start_time;
 
-				event = malloc(cnt*sizeof(struct fast5_event));;
+			if ((first < 0) || (last < 0)) {
+				fprintf(stderr, "%s: window not covered by events!\n", prog);
+				return 3;
+			}
+
+			cnt = last - first + 1;
+			if ((event = malloc(cnt * sizeof(struct fast5_event))) == NULL)
+				return 3;
+			memset(event, 0, cnt * sizeof(struct fast5_event));
+			if (fast5_events_read_range(f5, event, first, cnt) < 0) {
+				fprintf(stderr, "%s: events data read error!\n", prog);
+				return 3;
+			}
 
-				if (fast5_events_read(f5, event, cnt) < 0) {
+			for (i = 0; i < cnt; ++i) {
+				printf("%6" PRIi64 " %3" PRIi64 " %8.3f %6.3f %6.3f\n", 
+					   event[i].start, event[i].length, 
+					   event[i].mean, event[i].stdv, event[i].variance);
+			}
+			free(event);
+		} else if (dump_events) {
+			if ((cnt = events_info.length) > 0) {
+				if ((event = fast5_reader_events(rd, f5, cnt)) == NULL) {
 					fprintf(stderr, "%s: events data read error!\n", prog);
 					return 3;
 				}
@@ -205,8 +1395,6 @@ int main(int argc,  char **argv)
 						   event[i].start, event[i].length, 
 						   event[i].mean, event[i].stdv, event[i].variance);
 				}
-
-				free(event);
 			}
 		}
 
@@ -217,6 +1405,18 @@ int main(int argc,  char **argv)
 		fast5_close(f5);
 	}
 
+	fast5_reader_free(rd);
+
+	if (it != NULL)
+		fast5_dir_iter_free(it);
+
+	if (flt != NULL)
+		fast5_filter_free(flt);
+	free(flt_out);
+
+	if (dump_stats)
+		stats(stderr, prog);
+
 	return 0;
 }
 
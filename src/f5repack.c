@@ -0,0 +1,444 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      f5repack.c
+ * \brief     FAST5 merge, rechunk and repack tool
+ * \author    Robinson Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "fast5.h"
+
+int verbose = 0;
+
+void usage(FILE * f, char * prog)
+{
+	fprintf(f, "Usage: %s [OPTION...] FILE...\n", prog);
+	fprintf(f, "Merge, rechunk and repack FAST5 files.\n");
+	fprintf(f, "\n");
+	fprintf(f, "  -?        \tShow this help message\n");
+	fprintf(f, "  -v[v]     \tVerbosity level\n");
+	fprintf(f, "  -o PREFIX \tOutput files prefix (default: repack)\n");
+	fprintf(f, "  -n FILES  \tInput files per output file (default: 4000)\n");
+	fprintf(f, "  -c SAMPLES\tChunk size, 0 for contiguous (default: 0)\n");
+	fprintf(f, "  -z LEVEL  \tDeflate level, 0 for none (default: 0)\n");
+	fprintf(f, "  -s        \tShuffle before deflate\n");
+	fprintf(f, "  -m BYTES  \tMetadata block size (default: 1048576)\n");
+	fprintf(f, "  -j JOBS   \tParallel jobs (default: 1)\n");
+	fprintf(f, "  -b        \tBenchmark raw reads before and after\n");
+	fprintf(f, "\n");
+}
+
+void version(char * prog)
+{
+	fprintf(stderr, "%s\n", PACKAGE_STRING);
+	fprintf(stderr, "(C)Copyright, Bob Mittmann.\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Output file of a repack job */
+struct repack_out {
+	struct fast5 * f5;
+	const char * name;
+	/* reads started, with raw signals or events only. An output file 
+	   holds one kind or the other. */
+	unsigned int raw;
+	unsigned int events;
+	/* reads written completely, and not */
+	unsigned int reads;
+	unsigned int dropped;
+};
+
+/* Copy the selected read of f5, returns -1 if it was not written 
+   completely */
+static int repack_read(struct repack_out * out, struct fast5_reader * rd,
+					   struct fast5 * f5, const char * path, int idx)
+{
+	struct fast5_raw raw_read;
+	struct fast5_events_info events_info;
+	struct fast5_channel_id channel_id;
+	struct fast5_event * event = NULL;
+	bool has_channel;
+	bool has_raw;
+	int16_t * raw = NULL;
+
+	has_raw = (fast5_raw_read_info(f5, &raw_read) == 0);
+	has_channel = (fast5_channel_id(f5, &channel_id) == 0);
+
+	if ((fast5_events_info(f5, &events_info) == 0) &&
+		((event = fast5_reader_events(rd, f5, 
+									  events_info.length)) == NULL)) {
+		fprintf(stderr, "%s: read %d: events read error!\n", path, idx);
+		return -1;
+	}
+
+	if (!has_raw && (event == NULL)) {
+		fprintf(stderr, "%s: read %d: no raw signal or events!\n", 
+				path, idx);
+		return -1;
+	}
+
+	if (has_raw ? (out->events > 0) : (out->raw > 0)) {
+		fprintf(stderr, "%s: read %d: %s read, %s has %s reads!\n", path, 
+				idx, has_raw ? "raw" : "events only", out->name, 
+				has_raw ? "events only" : "raw");
+		return -1;
+	}
+
+	if (has_raw) {
+		if ((raw = fast5_reader_raw(rd, f5, raw_read.length)) == NULL) {
+			fprintf(stderr, "%s: read %d: raw data read error!\n", 
+					path, idx);
+			return -1;
+		}
+
+		if (fast5_raw_write(out->f5, &raw_read, raw, 
+							raw_read.length) < 0) {
+			fprintf(stderr, "%s: read %d: raw data write error: %s!\n", 
+					path, idx, fast5_strerror(fast5_error()));
+			return -1;
+		}
+		out->raw++;
+	}
+
+	if ((event != NULL) && 
+		(fast5_events_write(out->f5, &events_info, event, 
+							events_info.length) < 0)) {
+		fprintf(stderr, "%s: read %d: events write error: %s!\n", 
+				path, idx, fast5_strerror(fast5_error()));
+		return -1;
+	}
+
+	if (!has_raw)
+		out->events++;
+
+	/* the channel_id goes to the read just started */
+	if (has_channel && (fast5_channel_id_write(out->f5, &channel_id) < 0)) {
+		fprintf(stderr, "%s: read %d: channel_id write error: %s!\n", 
+				path, idx, fast5_strerror(fast5_error()));
+		return -1;
+	}
+
+	out->reads++;
+
+	return 0;
+}
+
+/* Copy all the reads of an input file into the output file */
+static int repack_copy(struct repack_out * out, struct fast5_reader * rd,
+					   const char * path)
+{
+	struct fast5 * f5;
+	int cnt;
+	int i;
+
+	if ((f5 = fast5_open(path)) == NULL) {
+		fprintf(stderr, "%s: Not a FAST5 file!\n", path);
+		return -1;
+	}
+
+	cnt = fast5_read_count(f5);
+	for (i = 0; i < cnt; ++i) {
+		if ((fast5_read_select(f5, i) < 0) ||
+			(repack_read(out, rd, f5, path, i) < 0))
+			out->dropped++;
+	}
+
+	fast5_close(f5);
+
+	return 0;
+}
+
+/* Write one output file from a group of inputs */
+static int repack_job(const char * outname, char ** in, int cnt,
+					  const struct fast5_wr_opt * opt)
+{
+	struct fast5_reader * rd;
+	struct repack_out out;
+	int err = 0;
+	int i;
+
+	memset(&out, 0, sizeof(out));
+	out.name = outname;
+
+	if ((out.f5 = fast5_create(outname, opt)) == NULL) {
+		fprintf(stderr, "%s: can't create file!\n", outname);
+		return -1;
+	}
+
+	if ((rd = fast5_reader_new()) == NULL) {
+		fast5_close(out.f5);
+		return -1;
+	}
+
+	for (i = 0; i < cnt; ++i) {
+		if (verbose > 1)
+			printf("%s <- %s\n", outname, in[i]);
+		if (repack_copy(&out, rd, in[i]) < 0)
+			err++;
+	}
+
+	fast5_reader_free(rd);
+	fast5_close(out.f5);
+
+	if (verbose || out.dropped)
+		printf("%s: %d files, %d errors, %u reads, %u dropped\n", outname, 
+			   cnt, err, out.reads, out.dropped);
+
+	return (err || out.dropped) ? -1 : 0;
+}
+
+/* Read all the raw signals of a set of files */
+static void bench(const char * label, char ** path, int cnt)
+{
+	struct fast5_reader * rd;
+	struct fast5_raw raw_read;
+	struct fast5 * f5;
+	uint64_t samples = 0;
+	unsigned int reads = 0;
+	double t0;
+	double dt;
+	int n;
+	int i;
+	int j;
+
+	rd = fast5_reader_new();
+	t0 = now();
+
+	for (i = 0; i < cnt; ++i) {
+		if ((f5 = fast5_open(path[i])) == NULL)
+			continue;
+
+		n = fast5_read_count(f5);
+		for (j = 0; j < n; ++j) {
+			fast5_read_select(f5, j);
+			if (fast5_raw_read_info_mask(f5, &raw_read, FAST5_F_LENGTH) < 0)
+				continue;
+			if (fast5_reader_raw(rd, f5, raw_read.length) == NULL)
+				continue;
+			samples += raw_read.length;
+			reads++;
+		}
+
+		fast5_close(f5);
+	}
+
+	dt = now() - t0;
+	fast5_reader_free(rd);
+
+	printf("%s: %d files, %u reads, %" PRIu64 " samples, %.3f s, "
+		   "%.2f Msamples/s\n", label, cnt, reads, samples, dt,
+		   dt > 0 ? samples / dt / 1e6 : 0.0);
+}
+
+int main(int argc,  char **argv)
+{
+	extern char *optarg;	/* getopt */
+	extern int optind;	/* getopt */
+	struct fast5_wr_opt opt;
+	char * prefix = "repack";
+	char ** outname;
+	char ** in;
+	char * prog;
+	bool benchmark = false;
+	bool shuffle = false;
+	int per_file = 4000;
+	int jobs = 1;
+	int running = 0;
+	int nout;
+	int nin;
+	int err = 0;
+	int status;
+	int c;
+	int i;
+
+	/* the prog name start just after the last lash */
+	if ((prog = (char *)basename(argv[0])) == NULL)
+		prog = argv[0];
+
+	memset(&opt, 0, sizeof(opt));
+	opt.meta_block = 1024 * 1024;
+	opt.bufsize = 16 * 1024 * 1024;
+
+	/* parse the command line options */
+	while ((c = getopt(argc, argv, "V?vo:n:c:z:sm:j:b")) > 0) {
+		switch (c) {
+		case 'V':
+			version(prog);
+			break;
+
+		case '?':
+			usage(stdout, prog);
+			return 0;
+
+		case 'v':
+			verbose++;
+			break;
+
+		case 'o':
+			prefix = optarg;
+			break;
+
+		case 'n':
+			per_file = strtol(optarg, NULL, 0);
+			break;
+
+		case 'c':
+			opt.chunk = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'z':
+			opt.level = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			shuffle = true;
+			break;
+
+		case 'm':
+			opt.meta_block = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+
+		case 'b':
+			benchmark = true;
+			break;
+
+		default:
+			fprintf(stderr, "%s: invalid option %s\n", prog, optarg);
+			return 1;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "%s: missing filename.\n\n", prog);
+		usage(stderr, prog);
+		return 2;
+	}
+
+	if ((per_file < 1) || (jobs < 1)) {
+		fprintf(stderr, "%s: invalid reads per file or jobs.\n", prog);
+		return 1;
+	}
+
+	if (opt.level > 0)
+		opt.codec = shuffle ? FAST5_CODEC_SHUFFLE_DEFLATE :
+			FAST5_CODEC_DEFLATE;
+
+	if ((opt.codec != FAST5_CODEC_NONE) && (opt.chunk == 0)) {
+		fprintf(stderr, "%s: compression requires a chunk size (-c).\n",
+				prog);
+		return 1;
+	}
+
+	in = &argv[optind];
+	nin = argc - optind;
+	nout = (nin + per_file - 1) / per_file;
+
+	if ((outname = calloc(nout, sizeof(char *))) == NULL)
+		return 3;
+
+	for (i = 0; i < nout; ++i) {
+		size_t n = strlen(prefix) + 32;
+
+		if ((outname[i] = malloc(n)) == NULL)
+			return 3;
+		snprintf(outname[i], n, "%s_%04d.fast5", prefix, i);
+	}
+
+	if (benchmark)
+		bench("before", in, nin);
+
+	/* One worker process per output file, see "Threads" in fast5.h */
+	for (i = 0; i < nout; ++i) {
+		int cnt = (i < nout - 1) ? per_file : nin - i * per_file;
+		pid_t pid;
+
+		if (jobs == 1) {
+			if (repack_job(outname[i], &in[i * per_file], cnt, &opt) < 0)
+				err++;
+			continue;
+		}
+
+		if (running == jobs) {
+			if ((wait(&status) > 0) &&
+				(!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+				err++;
+			running--;
+		}
+
+		fflush(stdout);
+		if ((pid = fork()) == 0) {
+			exit(repack_job(outname[i], &in[i * per_file], cnt, &opt)
+				 < 0 ? 1 : 0);
+		}
+
+		if (pid < 0) {
+			fprintf(stderr, "%s: fork(): %s\n", prog, strerror(errno));
+			err++;
+		} else
+			running++;
+	}
+
+	while (running > 0) {
+		if ((wait(&status) > 0) &&
+			(!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+			err++;
+		running--;
+	}
+
+	if (benchmark)
+		bench("after", outname, nout);
+
+	for (i = 0; i < nout; ++i)
+		free(outname[i]);
+	free(outname);
+
+	return err ? 3 : 0;
+}
+
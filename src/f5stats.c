@@ -0,0 +1,309 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      f5stats.c
+ * \brief     FAST5 run statistics tool
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "fast5.h"
+#include "fast5_stats.h"
+#include "fast5_index.h"
+
+int verbose = 0;
+
+void usage(FILE * f, char * prog)
+{
+	fprintf(f, "Usage: %s [OPTION...] FILE...\n", prog);
+	fprintf(f, "   or: %s [OPTION...] -R DIR\n", prog);
+	fprintf(f, "Run level statistics of a set of FAST5 files.\n");
+	fprintf(f, "\n");
+	fprintf(f, "  -?     \tShow this help message\n");
+	fprintf(f, "  -v[v]  \tVerbosity level\n");
+	fprintf(f, "  -R DIR \tAll the .fast5 files under DIR, recursively\n");
+	fprintf(f, "  -j JOBS\tParallel jobs (default: one per CPU)\n");
+	fprintf(f, "  -x FILE\tAlso write the read index of the run to FILE\n");
+	fprintf(f, "\n");
+}
+
+void version(char * prog)
+{
+	fprintf(stderr, "%s\n", PACKAGE_STRING);
+	fprintf(stderr, "(C)Copyright, Bob Mittmann.\n");
+	exit(1);
+}
+
+/* Fold the part-th of every jobs files into st, and add their reads to 
+   idx if not NULL */
+static int stats_job(struct fast5_stats * st, struct fast5_index * idx, 
+					 char ** path, int cnt, const char * dir, int part, 
+					 int jobs)
+{
+	struct fast5_dir_opt opt;
+	struct fast5_dir_iter * it;
+	struct fast5 * f5;
+	char fpath[PATH_MAX];
+	int i;
+
+	if (dir == NULL) {
+		for (i = part; i < cnt; i += jobs) {
+			if ((f5 = fast5_open(path[i])) == NULL) {
+				if (verbose)
+					fprintf(stderr, "%s: %s, skipped\n", path[i],
+							fast5_strerror(fast5_error()));
+				continue;
+			}
+			fast5_stats_add_file(st, f5);
+			if ((idx != NULL) && (fast5_index_add_file(idx, f5, path[i]) < 0))
+				return -1;
+			fast5_close(f5);
+		}
+		return 0;
+	}
+
+	memset(&opt, 0, sizeof(opt));
+	opt.part = part;
+	opt.nparts = jobs;
+	if ((it = fast5_dir_iter_new(dir, &opt)) == NULL) {
+		fprintf(stderr, "%s: %s\n", dir, fast5_strerror(fast5_error()));
+		return -1;
+	}
+
+	while ((f5 = fast5_dir_iter_next(it, fpath, sizeof(fpath))) != NULL) {
+		fast5_stats_add_file(st, f5);
+		if ((idx != NULL) && (fast5_index_add_file(idx, f5, fpath) < 0)) {
+			fast5_close(f5);
+			fast5_dir_iter_free(it);
+			return -1;
+		}
+		fast5_close(f5);
+	}
+
+	if (verbose && (fast5_dir_iter_skipped(it) > 0))
+		fprintf(stderr, "%s: %lu files skipped\n", dir,
+				fast5_dir_iter_skipped(it));
+
+	fast5_dir_iter_free(it);
+
+	return 0;
+}
+
+static int index_write(struct fast5_index * idx, const char * path)
+{
+	FILE * f;
+	int ret;
+
+	if ((f = fopen(path, "wb")) == NULL) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	ret = fast5_index_save(idx, f);
+	if (fclose(f) != 0)
+		ret = -1;
+
+	if (verbose)
+		fprintf(stderr, "%s: %zu reads\n", path, fast5_index_count(idx));
+
+	return ret;
+}
+
+int main(int argc,  char **argv)
+{
+	extern char *optarg;	/* getopt */
+	extern int optind;	/* getopt */
+	struct fast5_stats ** part;
+	struct fast5_stats * st;
+	struct fast5_index * idx = NULL;
+	struct fast5_index * tmp;
+	FILE ** idx_tmp = NULL;
+	char * idx_path = NULL;
+	char * dir = NULL;
+	char * prog;
+	int jobs = 0;
+	int err = 0;
+	int status;
+	int cnt;
+	int c;
+	int i;
+
+	/* the prog name start just after the last lash */
+	if ((prog = (char *)basename(argv[0])) == NULL)
+		prog = argv[0];
+
+	/* parse the command line options */
+	while ((c = getopt(argc, argv, "V?vR:j:x:")) > 0) {
+		switch (c) {
+		case 'V':
+			version(prog);
+			break;
+
+		case '?':
+			usage(stdout, prog);
+			return 0;
+
+		case 'v':
+			verbose++;
+			break;
+
+		case 'R':
+			dir = optarg;
+			break;
+
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+
+		case 'x':
+			idx_path = optarg;
+			break;
+
+		default:
+			fprintf(stderr, "%s: invalid option %s\n", prog, optarg);
+			return 1;
+		}
+	}
+
+	cnt = argc - optind;
+	if ((cnt == 0) && (dir == NULL)) {
+		fprintf(stderr, "%s: missing filename.\n\n", prog);
+		usage(stderr, prog);
+		return 2;
+	}
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if ((dir == NULL) && (jobs > cnt))
+		jobs = cnt;
+	if (jobs < 1)
+		jobs = 1;
+
+	if ((st = fast5_stats_new(0)) == NULL)
+		return 3;
+
+	if ((idx_path != NULL) && ((idx = fast5_index_new()) == NULL))
+		return 3;
+
+	if (jobs == 1) {
+		err = stats_job(st, idx, &argv[optind], cnt, dir, 0, 1);
+		if ((idx != NULL) && (index_write(idx, idx_path) < 0))
+			err++;
+		fast5_stats_report(st, stdout);
+		fast5_stats_free(st);
+		if (idx != NULL)
+			fast5_index_free(idx);
+		return err ? 3 : 0;
+	}
+
+	if ((part = calloc(jobs, sizeof(struct fast5_stats *))) == NULL)
+		return 3;
+
+	if ((idx != NULL) && ((idx_tmp = calloc(jobs, sizeof(FILE *))) == NULL))
+		return 3;
+
+	/* One worker process per part of the files (see "Threads" in 
+	   fast5.h). Each worker fills its own accumulator, in memory shared 
+	   with the parent. The read index of a part is saved to a temporary 
+	   file. */
+	fflush(stdout);
+	for (i = 0; i < jobs; ++i) {
+		pid_t pid;
+
+		if ((part[i] = fast5_stats_new(FAST5_STATS_SHARED)) == NULL) {
+			fprintf(stderr, "%s: can't allocate statistics!\n", prog);
+			err++;
+			break;
+		}
+
+		if ((idx != NULL) && ((idx_tmp[i] = tmpfile()) == NULL)) {
+			fprintf(stderr, "%s: tmpfile(): %s\n", prog, strerror(errno));
+			fast5_stats_free(part[i]);
+			part[i] = NULL;
+			err++;
+			break;
+		}
+
+		if ((pid = fork()) == 0) {
+			if ((stats_job(part[i], idx, &argv[optind], cnt, dir, i, 
+						   jobs) < 0) ||
+				((idx != NULL) && 
+				 ((fast5_index_save(idx, idx_tmp[i]) < 0) ||
+				  (fflush(idx_tmp[i]) != 0))))
+				exit(1);
+			exit(0);
+		}
+
+		if (pid < 0) {
+			fprintf(stderr, "%s: fork(): %s\n", prog, strerror(errno));
+			err++;
+			break;
+		}
+	}
+
+	while (wait(&status) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			err++;
+	}
+
+	/* reduce */
+	for (i = 0; i < jobs && part[i] != NULL; ++i) {
+		fast5_stats_merge(st, part[i]);
+		fast5_stats_free(part[i]);
+		if (idx == NULL)
+			continue;
+		rewind(idx_tmp[i]);
+		if (((tmp = fast5_index_load(idx_tmp[i])) == NULL) ||
+			(fast5_index_merge(idx, tmp) < 0))
+			err++;
+		if (tmp != NULL)
+			fast5_index_free(tmp);
+		fclose(idx_tmp[i]);
+	}
+	free(part);
+
+	if (idx != NULL) {
+		if (index_write(idx, idx_path) < 0)
+			err++;
+		fast5_index_free(idx);
+		free(idx_tmp);
+	}
+
+	fast5_stats_report(st, stdout);
+	fast5_stats_free(st);
+
+	return err ? 3 : 0;
+}
+
@@ -27,6 +27,7 @@
  */ 
 
 #include <unistd.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -40,6 +41,8 @@
 #include "config.h"
 #include "fast5.h"
 #include "vcd.h"
+#include "wave.h"
+#include "fast5_filter.h"
 
 int verbose = 0;
 
@@ -53,6 +56,9 @@ void usage(FILE * f, char * prog)
 	fprintf(f, "  -r     \tRaw data dump\n");
 	fprintf(f, "  -e     \tEvents dump\n");
 	fprintf(f, "  -o FILE\toutput\n");
+	fprintf(f, "  -F FMT \toutput format: vcd (default) or wave\n");
+	fprintf(f, "  --filter SPEC\tFilter the raw data (e.g. mad:4,median:5,"
+			"fir:31:0.1)\n");
 	fprintf(f, "\n");
 }
 
@@ -63,6 +69,16 @@ void version(char * prog)
 	exit(1);
 }
 
+static const struct option long_opts[] = {
+	{ "filter", required_argument, NULL, 'f' },
+	{ NULL, 0, NULL, 0 }
+};
+
+/* Raw samples read and filtered at a time */
+#define RAW_CHUNK_LEN 16384
+
+static int16_t raw_chunk[RAW_CHUNK_LEN];
+
 int main(int argc,  char **argv)
 {
 	extern char *optarg;	/* getopt */
@@ -73,6 +89,7 @@ int main(int argc,  char **argv)
 	struct fast5_raw raw_read;
 	struct fast5_events_info events_info;
 	struct fast5_channel_id channel_id;
+	struct fast5_reader * rd;
 	char * path; /* fast5 input file */
 	int c;
 	int16_t * raw;
@@ -82,14 +99,21 @@ int main(int argc,  char **argv)
 	bool dump_raw = false;
 	bool dump_events = false;
 	char * outname = NULL;
-	struct vcd * vcd;
+	struct vcd * vcd = NULL;
+	struct wave * wv = NULL;
+	bool fmt_wave = false;
+	struct fast5_filter * flt = NULL;
+	struct fast5_dset * ds;
+	int16_t * flt_out = NULL;
+	size_t pos;
 
 	/* the prog name start just after the last lash */
 	if ((prog = (char *)basename(argv[0])) == NULL)
 		prog = argv[0];
 
 	/* parse the command line options */
-	while ((c = getopt(argc, argv, "V?vreo:")) > 0) {
+	while ((c = getopt_long(argc, argv, "V?vreo:F:", long_opts, 
+								NULL)) > 0) {
 		switch (c) {
 		case 'V':
 			version(prog);
@@ -115,6 +139,23 @@ int main(int argc,  char **argv)
 			outname = optarg;
 			break;
 
+		case 'F':
+			if (strcmp(optarg, "wave") == 0)
+				fmt_wave = true;
+			else if (strcmp(optarg, "vcd") == 0)
+				fmt_wave = false;
+			else {
+				fprintf(stderr, "%s: invalid format: %s\n", prog, optarg);
+				return 1;
+			}
+			break;
+
+		case 'f':
+			if ((flt = fast5_filter_new(optarg)) == NULL) {
+				fprintf(stderr, "%s: invalid filter: %s\n", prog, optarg);
+				return 1;
+			}
+			break;
 
 		default:
 			fprintf(stderr, "%s: invalid option %s\n", prog, optarg);
@@ -128,12 +169,23 @@ int main(int argc,  char **argv)
 		return 2;
 	}
 
-	if ((vcd = vcd_create(outname, 1e-6)) == NULL) {
+	if (fmt_wave) {
+		if ((wv = wave_create(outname, 1e-6)) == NULL) {
+			fprintf(stderr, "%s: can't create/acces wave file.\n\n", prog);
+			usage(stderr, prog);
+			return 3;
+		}
+	} else if ((vcd = vcd_create(outname, 1e-6)) == NULL) {
 		fprintf(stderr, "%s: can't create/acces VCD file.\n\n", prog);
 		usage(stderr, prog);
 		return 3;
 	}
 
+	if ((rd = fast5_reader_new()) == NULL) {
+		fprintf(stderr, "%s: can't allocate reader!\n", prog);
+		return 3;
+	}
+
 	while (optind < argc) {
 		path = argv[optind++];
 
@@ -189,29 +241,73 @@ int main(int argc,  char **argv)
 			printf("         length: %d\n", (int)events_info.length);
 		}
 
-		if (dump_raw) {
+		if (dump_raw && (flt != NULL)) {
+			struct wave_var * wvar = NULL; 
+			struct vcd_var * vvar = NULL; 
+			double rate;
+			size_t n;
+
+			/* the resampling stages change the rate of the variable */
+			rate = fast5_filter_rate(flt, channel_id.sampling_rate);
+			n = fast5_filter_len(flt, RAW_CHUNK_LEN);
+			if ((raw = realloc(flt_out, n * sizeof(int16_t))) == NULL)
+				return 3;
+			flt_out = raw;
+
+			if (fmt_wave)
+				wvar = wave_var_new(wv, "raw", rate);
+			else
+				vvar = vcd_var_new(vcd, "raw", rate);
+
+			/* read, filter and append one chunk at a time, the signal 
+			   is opened once for all the chunks */
+			ds = NULL;
+			if ((raw_read.length > 0) && 
+				((ds = fast5_raw_open(f5)) == NULL)) {
+				fprintf(stderr, "%s: raw data read error!\n", prog);
+				return 3;
+			}
+			for (pos = 0; pos < raw_read.length; pos += cnt) {
+				cnt = raw_read.length - pos;
+				if (cnt > RAW_CHUNK_LEN)
+					cnt = RAW_CHUNK_LEN;
+				if ((fast5_dset_read(ds, raw_chunk, pos, cnt) < 0) ||
+					((i = fast5_filter_process(flt, raw_chunk, cnt, 
+											   flt_out)) < 0)) {
+					fprintf(stderr, "%s: raw data read error!\n", prog);
+					return 3;
+				}
+				if (wvar != NULL)
+					wave_var_append(wvar, flt_out, i);
+				if (vvar != NULL)
+					vcd_var_append(vvar, flt_out, i);
+			}
+			if (ds != NULL)
+				fast5_dset_close(ds);
+		} else if (dump_raw) {
 			if ((cnt = raw_read.length) > 0) {
-				struct vcd_var * var; 
-				raw = malloc(cnt*sizeof(int16_t));;
-
-				if (fast5_raw_read(f5, raw, cnt) < 0) {
+				if ((raw = fast5_reader_raw(rd, f5, cnt)) == NULL) {
 					fprintf(stderr, "%s: raw data read error!\n", prog);
 					return 3;
 				} 
 
-				var = vcd_var_new(vcd, "raw", channel_id.sampling_rate);
-				vcd_var_append(var, raw, cnt);
-
-				free(raw);
+				if (fmt_wave) {
+					struct wave_var * var; 
+					if ((var = wave_var_new(wv, "raw", 
+											channel_id.sampling_rate)) != NULL)
+						wave_var_append(var, raw, cnt);
+				} else {
+					struct vcd_var * var; 
+					if ((var = vcd_var_new(vcd, "raw", 
+											channel_id.sampling_rate)) != NULL)
+						vcd_var_append(var, raw, cnt);
+				}
 			}
 		}
 
 		if (dump_events) {
 			if ((cnt = events_info.length) > 0) {
-
-				event = malloc(cnt*sizeof(struct fast5_event));;
-
-				if (fast5_events_read(f5, event, cnt) < 0) {
+				if ((event = fast5_reader_events(rd, f5, cnt)) == NULL) {
 					fprintf(stderr, "%s: events data read error!\n", prog);
 					return 3;
 				}
@@ -221,8 +317,6 @@ int main(int argc,  char **argv)
 						   event[i].start, event[i].length, 
 						   event[i].mean, event[i].stdv, event[i].variance);
 				}
-
-				free(event);
 			}
 		}
 
@@ -233,6 +327,17 @@ int main(int argc,  char **argv)
 		fast5_close(f5);
 	}
 
+	if (fmt_wave)
+		wave_close(wv);
+	else
+		vcd_close(vcd);
+
+	fast5_reader_free(rd);
+
+	if (flt != NULL)
+		fast5_filter_free(flt);
+	free(flt_out);
+
 	return 0;
 }
 
@@ -40,11 +40,206 @@
 
 #include "config.h"
 #include "debug.h"
+#include "fast5.h"
+
+/* Top level groups tracked by the probe cache */
+#define FAST5_GRP_UNIQUE_GLOBAL_KEY (1 << 0)
+#define FAST5_GRP_ANALYSES          (1 << 1)
+#define FAST5_GRP_SEQUENCES         (1 << 2)
+#define FAST5_GRP_RAW               (1 << 3)
+/* Not a group, the root "file_version" attribute was loaded */
+#define FAST5_GRP_VERSION           (1 << 7)
+
+/* Private fast5_open_flags() flags */
+/* The file is an in memory image, it can't be mapped */
+#define FAST5_MEMORY                (1 << 15)
+
+/* Attribute memory types */
+#define FAST5_T_U32  0
+#define FAST5_T_I32  1
+#define FAST5_T_U64  2
+#define FAST5_T_I64  3
+#define FAST5_T_F64  4
+/* fixed length string, NUL terminated */
+#define FAST5_T_STR  5
+/* variable length string, copied and NUL terminated */
+#define FAST5_T_VSTR 6
+#define FAST5_T_CNT  7
+
+/* One attribute of a group */
+struct fast5_attr_desc {
+	const char * name;
+	/* FAST5_F_xxx selection bit */
+	uint32_t field;
+	uint8_t type;
+	/* destination in the info structure */
+	uint16_t offset;
+	uint16_t size;
+};
+
+struct fast5_attr_list {
+	const struct fast5_attr_desc * attr;
+	unsigned int cnt;
+};
+
+/* Attributes of the groups of a file version, see fast5_schema.c */
+struct fast5_schema {
+	uint16_t major;
+	uint16_t minor;
+	/* read attributes, an empty list if the version has no raw reads */
+	struct fast5_attr_list raw;
+	struct fast5_attr_list events;
+	struct fast5_attr_list channel_id;
+};
+
+struct fast5
+{
+	struct fast5_info info;
+	unsigned int flags;
+	/* groups already looked up */
+	uint8_t probed;
+	/* groups found in the file */
+	uint8_t present;
+	/* selected read of a multi-read file */
+	unsigned int read_idx;
+	/* number of reads, -1 if not yet known */
+	int nreads;
+	/* writer: name of the last read group written */
+	char wr_read[FAST5_OBJ_PATH_MAX + 1];
+	/* writer: options */
+	struct fast5_wr_opt wr_opt;
+	/* fast5_raw_map() mapping, or copy */
+	struct {
+		void * addr;
+		size_t size;
+		int16_t * buf;
+	} map;
+	/* /Analyses groups, nan is -1 until the group is listed */
+	struct fast5_analysis * an;
+	int nan;
+	int an_size;
+	/* attributes layout, NULL until first needed */
+	const struct fast5_schema * schema;
+	hid_t file;
+};
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+hid_t fast5_event_type_create(void);
+
+/* Last error of the calling thread, see fast5_error() */
+extern __thread int __fast5_errno;
+
+/* Record an error code, evaluates to the code */
+#define FAST5_ERR(CODE) (__fast5_errno = (CODE))
+
+struct fast5 * fast5_handle_alloc(hid_t file, const char * name, 
+								  unsigned int flags);
+
+int fast5_path(char * buf, const char * fmt, ...) 
+	__attribute__((format(printf, 2, 3)));
+
+/* Schema of the highest version not newer than major.minor */
+const struct fast5_schema * fast5_schema_lookup(unsigned int major,
+												unsigned int minor);
+
+const struct fast5_schema * fast5_schema_latest(void);
+
+/* Read the attributes of a list selected by mask into dst. Missing 
+   attributes are left untouched. */
+int fast5_attrs_read(hid_t obj, const struct fast5_attr_list * lst,
+					 void * dst, unsigned int mask);
+
+/* -------------------------------------------------------------------------
+ * Performance counters
+ * 
+ * Like the DBG() macros, the PERF_*() macros expand to nothing unless
+ * the library is configured with --enable-perf. When enabled they only
+ * update in memory counters, there is no output.
+ * ------------------------------------------------------------------------- */ 
+
+#ifdef FAST5_PERF
+
+#include <time.h>
+
+extern struct fast5_perf __fast5_perf;
+
+static inline uint64_t __perf_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000LL + (uint64_t)ts.tv_nsec;
+}
+
+struct __perf_call {
+	uint64_t t0;
+	unsigned int id;
+};
+
+static inline void __perf_call_end(struct __perf_call * call)
+{
+	__atomic_fetch_add(&__fast5_perf.call[call->id].count, 1, 
+					   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&__fast5_perf.call[call->id].ns, 
+					   __perf_ns() - call->t0, __ATOMIC_RELAXED);
+}
+
+static inline hid_t __perf_h5_open(hid_t id)
+{
+	if (id >= 0)
+		__atomic_fetch_add(&__fast5_perf.h5_open, 1, __ATOMIC_RELAXED);
+	return id;
+}
+
+/* Account the call and the time spent until the enclosing 
+   function returns. */
+#define PERF_CALL(ID) struct __perf_call __perf_call \
+	__attribute__((cleanup(__perf_call_end))) = { __perf_ns(), (ID) }
+
+#define PERF_ADD(FIELD, N) \
+	__atomic_fetch_add(&__fast5_perf.FIELD, (N), __ATOMIC_RELAXED)
+
+#define PERF_INC(FIELD) PERF_ADD(FIELD, 1)
+
+/* Count HDF5 handles acquired and released */
+#define PERF_H5_OPEN(X) __perf_h5_open(X)
+#define PERF_H5_CLOSE(X) (PERF_INC(h5_close), (X))
+
+/* Interpose the HDF5 calls that create or release handles, so that every
+   call site in the library is accounted for. A function-like macro is not
+   expanded again inside its own replacement, the real functions are 
+   still the ones called. */
+#define H5Fopen(...) PERF_H5_OPEN(H5Fopen(__VA_ARGS__))
+#define H5Fcreate(...) PERF_H5_OPEN(H5Fcreate(__VA_ARGS__))
+#define H5Gcreate2(...) PERF_H5_OPEN(H5Gcreate2(__VA_ARGS__))
+#define H5Dcreate2(...) PERF_H5_OPEN(H5Dcreate2(__VA_ARGS__))
+#define H5Acreate2(...) PERF_H5_OPEN(H5Acreate2(__VA_ARGS__))
+#define H5Pcreate(...) PERF_H5_OPEN(H5Pcreate(__VA_ARGS__))
+#define H5Screate(...) PERF_H5_OPEN(H5Screate(__VA_ARGS__))
+#define H5Gopen2(...) PERF_H5_OPEN(H5Gopen2(__VA_ARGS__))
+#define H5Dopen2(...) PERF_H5_OPEN(H5Dopen2(__VA_ARGS__))
+#define H5Aopen(...) PERF_H5_OPEN(H5Aopen(__VA_ARGS__))
+#define H5Tcopy(...) PERF_H5_OPEN(H5Tcopy(__VA_ARGS__))
+#define H5Tcreate(...) PERF_H5_OPEN(H5Tcreate(__VA_ARGS__))
+#define H5Screate_simple(...) PERF_H5_OPEN(H5Screate_simple(__VA_ARGS__))
+#define H5Dget_space(...) PERF_H5_OPEN(H5Dget_space(__VA_ARGS__))
+#define H5Dget_type(...) PERF_H5_OPEN(H5Dget_type(__VA_ARGS__))
+#define H5Dget_create_plist(...) PERF_H5_OPEN(H5Dget_create_plist(__VA_ARGS__))
+#define H5Fclose(...) PERF_H5_CLOSE(H5Fclose(__VA_ARGS__))
+#define H5Gclose(...) PERF_H5_CLOSE(H5Gclose(__VA_ARGS__))
+#define H5Dclose(...) PERF_H5_CLOSE(H5Dclose(__VA_ARGS__))
+#define H5Aclose(...) PERF_H5_CLOSE(H5Aclose(__VA_ARGS__))
+#define H5Tclose(...) PERF_H5_CLOSE(H5Tclose(__VA_ARGS__))
+#define H5Sclose(...) PERF_H5_CLOSE(H5Sclose(__VA_ARGS__))
+#define H5Pclose(...) PERF_H5_CLOSE(H5Pclose(__VA_ARGS__))
+
+#else /* not FAST5_PERF */
+#define PERF_CALL(ID)
+#define PERF_ADD(FIELD, N)
+#define PERF_INC(FIELD)
+#endif /* not FAST5_PERF */
 
 #ifdef __cplusplus
 }
@@ -31,85 +31,236 @@
 #define DEBUG_LEVEL DBG_TRACE
 #include "fast5-i.h"
 #include <assert.h>
+#include <string.h>
 #include <fast5.h>
-#include <libgen.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const char * const fast5_grp_path[] = {
+	"/UniqueGlobalKey",
+	"/Analyses",
+	"/Sequences",
+	"/Raw"
+};
 
-struct fast5
+/* Check if a top level group exists in the file. The result is cached 
+   so each group is looked up at most once per handle. */
+static bool fast5_has(struct fast5 * f5, unsigned int grp)
 {
-	struct fast5_info info;
-	bool has_raw;
-	bool has_sequences;
-	hid_t file;
-};
+	const char * path;
+
+	if ((f5->probed & grp) == 0) {
+		path = fast5_grp_path[__builtin_ctz(grp)];
+		if (H5Lexists(f5->file, path, H5P_DEFAULT) > 0)
+			f5->present |= grp;
+		else
+			DBG(DBG_INFO, "Group \"%s\" not found!", path);
+		f5->probed |= grp;
+	}
 
-struct fast5 * fast5_open(const char * path)
+	return (f5->present & grp) ? true : false;
+}
+
+/* Read the root "file_version" attribute. */
+static int fast5_version_load(struct fast5 * f5)
 {
-	struct fast5 * f5;
-	hid_t file;
 	hid_t attr;
 	float ver;
 
-	assert(path != NULL);
+	if (f5->probed & FAST5_GRP_VERSION)
+		return (f5->present & FAST5_GRP_VERSION) ? 0 : 
+			FAST5_ERR(FAST5_ERR_FORMAT);
 
-	if ((file = H5Fopen(path, H5F_ACC_RDONLY, H5P_DEFAULT)) < 0){
-		return NULL;
-	};
+	f5->probed |= FAST5_GRP_VERSION;
 
 	/* Check if attribute /file_version exists in root group. */
-	if ((attr = H5Aopen(file, "file_version", H5P_DEFAULT)) < 0) {
+	if ((attr = H5Aopen(f5->file, "file_version", H5P_DEFAULT)) < 0) {
 		DBG(DBG_WARNING, "Attribute \"/file_version\" not found!");
-		return NULL;
+		return FAST5_ERR(FAST5_ERR_FORMAT);
 	}
 
-	H5Aread(attr, H5T_NATIVE_FLOAT, &ver);
+	if (H5Aread(attr, H5T_NATIVE_FLOAT, &ver) < 0) {
+		H5Aclose(attr);
+		return FAST5_ERR(FAST5_ERR_FORMAT);
+	}
 	H5Aclose(attr);
 
 	DBG(DBG_INFO, "file_version = %0f", ver);
 
-	if ((f5 = (struct fast5 *)malloc(sizeof(struct fast5))) != NULL) {
-		f5->file = file;
-	}
-
-	strcpy(f5->info.filename, basename((char *)path));
-
 	f5->info.version.major = ver;
 	ver -= f5->info.version.major;
 	f5->info.version.minor = ver * 100;
+	f5->present |= FAST5_GRP_VERSION;
 
-	/* Check if group /UniqueGlobalKey exists in the file. */
-	if (H5Lexists(file, "/UniqueGlobalKey", H5P_DEFAULT) <= 0) {
-		DBG(DBG_WARNING, "Group \"/UniqueGlobalKey\" not found!");
+	return 0;
+}
+
+/* Attribute layout of the file, by its version. */
+static const struct fast5_schema * fast5_schema(struct fast5 * f5)
+{
+	if (f5->schema == NULL) {
+		if (fast5_version_load(f5) == 0)
+			f5->schema = fast5_schema_lookup(f5->info.version.major, 
+											 f5->info.version.minor);
+		else
+			f5->schema = fast5_schema_latest();
+	}
+
+	return f5->schema;
+}
+
+/* Allocate a handle for an open file, with empty caches. The file is 
+   closed on errors. */
+struct fast5 * fast5_handle_alloc(hid_t file, const char * name, 
+								  unsigned int flags)
+{
+	struct fast5 * f5;
+	const char * cp;
+
+	if ((f5 = (struct fast5 *)malloc(sizeof(struct fast5))) == NULL) {
+		H5Fclose(file);
+		FAST5_ERR(FAST5_ERR_NOMEM);
 		return NULL;
 	}
+	PERF_INC(alloc);
+	PERF_ADD(alloc_bytes, sizeof(struct fast5));
+
+	f5->file = file;
+	f5->flags = flags;
+	f5->probed = 0;
+	f5->present = 0;
+	f5->read_idx = 0;
+	f5->nreads = -1;
+	f5->wr_read[0] = '\0';
+	f5->map.addr = NULL;
+	f5->map.size = 0;
+	f5->map.buf = NULL;
+	f5->an = NULL;
+	f5->nan = -1;
+	f5->an_size = 0;
+	f5->schema = NULL;
+	memset(&f5->info.version, 0, sizeof(f5->info.version));
+
+	/* basename() may modify its argument */
+	cp = strrchr(name, '/');
+	strncpy(f5->info.filename, (cp != NULL) ? cp + 1 : name, 
+			sizeof(f5->info.filename) - 1);
+	f5->info.filename[sizeof(f5->info.filename) - 1] = '\0';
 
-	/* Check if group /Analyses exists in the file. */
-	if (H5Lexists(file, "/Analyses", H5P_DEFAULT) <= 0) {
-		DBG(DBG_WARNING, "Group \"/Analyses\" not found!");
+	return f5;
+}
+
+/* Set up a handle for an open file. The file is closed on errors. */
+static struct fast5 * fast5_handle_new(hid_t file, const char * name, 
+									   unsigned int flags)
+{
+	struct fast5 * f5;
+
+	if ((f5 = fast5_handle_alloc(file, name, flags)) == NULL)
+		return NULL;
+
+	/* In lazy mode the file is validated by the accessors, when they 
+	   first need a group. */
+	if (flags & FAST5_LAZY)
+		return f5;
+
+	if (fast5_version_load(f5) < 0) {
+		fast5_close(f5);
+		FAST5_ERR(FAST5_ERR_FORMAT);
 		return NULL;
 	}
 
-	/* Check if group /Sequences exists in the file. */
-	if (H5Lexists(file, "/Sequences", H5P_DEFAULT) <= 0) {
-		DBG(DBG_INFO, "Group \"/Sequences\" not found!");
-		f5->has_sequences = true;
-	} else
-		f5->has_sequences = false;
+	if (!fast5_has(f5, FAST5_GRP_UNIQUE_GLOBAL_KEY)) {
+		fast5_close(f5);
+		FAST5_ERR(FAST5_ERR_FORMAT);
+		return NULL;
+	}
 
-	/* Check if group /Raw exists in the file. */
-	if (H5Lexists(file, "/Raw", H5P_DEFAULT) <= 0) {
-		DBG(DBG_INFO, "Group \"/Raw\" not found!");
-		f5->has_raw = true;
-	} else
-		f5->has_raw = false;
+	/* Optional groups, raw only files have no /Analyses. */
+	fast5_has(f5, FAST5_GRP_ANALYSES);
+	fast5_has(f5, FAST5_GRP_SEQUENCES);
+	fast5_has(f5, FAST5_GRP_RAW);
 
 	return f5;
 }
 
+struct fast5 * fast5_open_flags(const char * path, unsigned int flags)
+{
+	hid_t file;
+	PERF_CALL(FAST5_PERF_OPEN);
+
+	assert(path != NULL);
+
+	/* junk files are rejected before the HDF5 library sees them */
+	if (fast5_sniff(path) < 0)
+		return NULL;
+
+	if ((file = H5Fopen(path, H5F_ACC_RDONLY, H5P_DEFAULT)) < 0){
+		FAST5_ERR(FAST5_ERR_HDF5);
+		return NULL;
+	};
+
+	return fast5_handle_new(file, path, flags & ~FAST5_MEMORY);
+}
+
+struct fast5 * fast5_open(const char * path)
+{
+	return fast5_open_flags(path, 0);
+}
+
+struct fast5 * fast5_open_mem(const void * buf, size_t len, 
+							  unsigned int flags)
+{
+	char name[32];
+	hid_t fapl;
+	hid_t file;
+	PERF_CALL(FAST5_PERF_OPEN);
+
+	assert(buf != NULL);
+
+	if ((len == 0) || (fast5_sniff_mem(buf, len) < 0)) {
+		FAST5_ERR(FAST5_ERR_FORMAT);
+		return NULL;
+	}
+
+	/* The core driver opens the image in memory, it is copied so the 
+	   caller's buffer can be released after the call. */
+	fapl = H5Pcreate(H5P_FILE_ACCESS);
+	H5Pset_fapl_core(fapl, 64 * 1024, 0);
+	if (H5Pset_file_image(fapl, (void *)buf, len) < 0) {
+		H5Pclose(fapl);
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	/* the name must be unique among the files open in the process */
+	snprintf(name, sizeof(name), "<memory %p>", buf);
+	file = H5Fopen(name, H5F_ACC_RDONLY, fapl);
+	H5Pclose(fapl);
+
+	if (file < 0) {
+		FAST5_ERR(FAST5_ERR_FORMAT);
+		return NULL;
+	}
+
+	return fast5_handle_new(file, "<memory>", flags | FAST5_MEMORY);
+}
+
 int fast5_close(struct fast5 * f5)
 {
+	PERF_CALL(FAST5_PERF_CLOSE);
+
 	assert(f5 != NULL);
 	assert(f5->file >= 0);
 
+	fast5_raw_unmap(f5);
+
+	if (f5->an != NULL)
+		free(f5->an);
+
 	H5Fclose(f5->file);
 
 	free(f5);
@@ -122,488 +273,2024 @@ int fast5_info(struct fast5 * f5, struct fast5_info * info)
 	assert(f5 != NULL);
 	assert(f5->file >= 0);
 
+	if (fast5_version_load(f5) < 0)
+		return FAST5_ERR_FORMAT;
+
 	memcpy(info, &f5->info, sizeof(struct fast5_info));
 
 	return 0;
 }
 
 /* -------------------------------------------------------------------------
- * Raw signals
+ * Errors
  * ------------------------------------------------------------------------- */ 
 
-/* Get the link name for the raw reads group */
-static int fast5_raw_get_name(struct fast5 * f5, char * name)
-{
-	H5G_info_t  ginfo;
-	hid_t group;
-	int ret;
-	int i;
+__thread int __fast5_errno = FAST5_OK;
 
-	/* Check if group /Raw/Reads exists in the file. */
-	if (H5Lexists(f5->file, "/Raw", H5P_DEFAULT) <= 0)
-		return -1;
+int fast5_error(void)
+{
+	return __fast5_errno;
+}
 
-	/* Check if group /Raw/Reads exists in the file. */
-	if (H5Lexists(f5->file, "/Raw/Reads", H5P_DEFAULT) <= 0)
-		return -1;
+static const char * const fast5_err_nm[] = {
+	[-FAST5_OK] = "Success",
+	[-FAST5_ERR_HDF5] = "HDF5 library error",
+	[-FAST5_ERR_NOMEM] = "Out of memory",
+	[-FAST5_ERR_FORMAT] = "Not a FAST5 file",
+	[-FAST5_ERR_NOENT] = "No such object",
+	[-FAST5_ERR_RANGE] = "Out of range",
+	[-FAST5_ERR_NAME] = "Object name too long",
+	[-FAST5_ERR_INVAL] = "Invalid argument",
+	[-FAST5_ERR_IO] = "I/O error"
+};
 
-	if ((group = H5Gopen(f5->file, "/Raw/Reads", H5P_DEFAULT)) < 0) {
-		DBG(DBG_WARNING, "Can't access group \"/Raw/Reads\"!");
-		return group;
-	}
+const char * fast5_strerror(int err)
+{
+	if ((err > 0) || (-err >= (int)(sizeof(fast5_err_nm) / sizeof(char *))))
+		return "Unknown error";
 
-	if ((ret = H5Gget_info(group, &ginfo)) < 0) {
-		DBG(DBG_WARNING, "Can't access group \"/Raw/Reads\"!");
-		return ret;
-	}
+	return fast5_err_nm[-err];
+}
 
-	if (ginfo.nlinks == 0) {
-		DBG(DBG_WARNING, "Empty group!");
-		return -1;
-	}
+/* -------------------------------------------------------------------------
+ * Attributes and datasets helpers
+ * ------------------------------------------------------------------------- */ 
 
-	if (ginfo.nlinks > 1) {
-		DBG(DBG_WARNING, "Too many raw sub-groups!");
-	}
+/* Build an object path in a FAST5_OBJ_PATH_MAX buffer. Names come from
+   the file, a path that does not fit is an error, never truncated. */
+int fast5_path(char * buf, const char * fmt, ...)
+{
+	va_list ap;
+	int n;
 
-	i = 0;
+	va_start(ap, fmt);
+	n = vsnprintf(buf, FAST5_OBJ_PATH_MAX, fmt, ap);
+	va_end(ap);
 
-	H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, i, 
-					   name, FAST5_OBJ_PATH_MAX, H5P_DEFAULT);
-	H5Gclose(group);
+	if ((n < 0) || (n >= FAST5_OBJ_PATH_MAX)) {
+		DBG(DBG_WARNING, "Object path too long!");
+		buf[0] = '\0';
+		return FAST5_ERR(FAST5_ERR_NAME);
+	}
 
 	return 0;
 }
 
-int fast5_raw_read_info(struct fast5 * f5, struct fast5_raw * info)
+/* Read a scalar attribute. Returns -1 if the attribute does not exist. */
+static int fast5_attr_read(hid_t obj, const char * name, hid_t type, 
+						   void * buf)
 {
-	char gpath[FAST5_OBJ_PATH_MAX];
-	char name[FAST5_OBJ_PATH_MAX];
-	hid_t dataset;  
-	hid_t dspace;
-	hid_t group;
+	herr_t status;
 	hid_t attr;
-	hsize_t dims[16];
-	int ndims;
-	int ret;
-
-	assert(f5 != NULL);
-	assert(f5->file >= 0);
-	assert(info != NULL);
-
-	memset(info, 0, sizeof(struct fast5_raw));
-
-	if ((ret = fast5_raw_get_name(f5, name)) < 0)
-		return ret;
 
-	snprintf(info->dataset, FAST5_OBJ_PATH_MAX, "/Raw/Reads/%s/Signal", name);
-	DBG(DBG_INFO, "Raw signal: %s", info->dataset);
-
-	snprintf(gpath, FAST5_OBJ_PATH_MAX, "/Raw/Reads/%s", name);
-	if ((group = H5Gopen(f5->file, gpath, H5P_DEFAULT)) < 0) {
-		DBG(DBG_WARNING, "Cant open \"%s\" group!", gpath);
+	if ((attr = H5Aopen(obj, name, H5P_DEFAULT)) < 0)
 		return -1;
-	}
-
-	if ((attr = H5Aopen(group, "duration", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_ULONG, &info->duration);
-		H5Aclose(attr);
-	}
-
-	if ((attr = H5Aopen(group, "median_before", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->median_before);
-		H5Aclose(attr);
-	}
-
-	if ((attr = H5Aopen(group, "read_id", H5P_DEFAULT)) >= 0) {
-		/* read a fixed length string */
-		hid_t type = H5Tcopy(H5T_C_S1);
-		H5Tset_size(type, FAST5_UUID_MAX);
-		H5Aread(attr, type, info->read_id);
-		H5Aclose(attr);
-		H5Tclose(type);
-	} else {
-		DBG(DBG_WARNING, "Can't read attribute: \"read_id\"!");
-	}
 
-	if ((attr = H5Aopen(group, "read_number", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_ULONG, &info->read_number);
-		H5Aclose(attr);
-	}
+	status = H5Aread(attr, type, buf);
+	H5Aclose(attr);
 
-	if ((attr = H5Aopen(group, "start_mux", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_LONG, &info->start_mux);
-		H5Aclose(attr);
-	}
+	return status;
+}
 
-	if ((attr = H5Aopen(group, "start_time", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_ULLONG, &info->start_time);
-		H5Aclose(attr);
-	}
+/* Get the number of elements of a one dimension dataset. */
+static int fast5_dset_path_length(struct fast5 * f5, const char * path, 
+							 size_t * length)
+{
+	hid_t dataset;  
+	hid_t dspace;
+	hsize_t dims[16];
+	int ndims;
 
 	/* Open dataset. */
-	dataset = H5Dopen2(f5->file, info->dataset, H5P_DEFAULT);
+	if ((dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", path);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
 	/* GEt the dataset's dataspace. */
 	dspace = H5Dget_space(dataset);
-	/* Get dimensions */
+	/* Get dimensions, the dims array is never overrun */
 	ndims = H5Sget_simple_extent_ndims(dspace);
+	if ((ndims < 1) || (ndims > 16)) {
+		H5Sclose(dspace);
+		H5Dclose(dataset);
+		return FAST5_ERR(FAST5_ERR_FORMAT);
+	}
 	H5Sget_simple_extent_dims(dspace, dims, NULL);
 	DBG(DBG_INFO, "ndims=%d dims[0]=%d", ndims, (int)dims[0]);
 
-	info->length = dims[0];
+	*length = dims[0];
 
 	/* Close the dataspace. */
 	H5Sclose(dspace);  
 	/* Close the dataset. */
 	H5Dclose(dataset);
 
-	H5Gclose(group);
-
 	return 0;
 }
 
-int fast5_raw_read(struct fast5 * f5, int16_t * raw, size_t len)
+/* Read len elements of a one dimension dataset, starting at offset. No
+   descriptor is allocated and the storage is not looked at, this is the 
+   path of the whole or partial reads of a signal or events table. */
+static int fast5_dset_path_read(struct fast5 * f5, const char * path, 
+								hid_t type, void * buf, size_t offset, 
+								size_t len)
 {
-	char name[FAST5_OBJ_PATH_MAX];
-	char path[FAST5_OBJ_PATH_MAX];
 	hid_t dataset;  
 	herr_t status;
 	hid_t dataspace_id;
 	hid_t memspace_id;
 	hsize_t dimsm[2];
 	hsize_t count[2];              /* size of subset in the file */
-	hsize_t offset[2];             /* subset offset in the file */
+	hsize_t start[2];              /* subset offset in the file */
 	hsize_t stride[2];
 	hsize_t block[2];
-	int ret;
-
-	assert(f5 != NULL);
-	assert(f5->file >= 0);
-	assert(raw != NULL);
-
-	if ((ret = fast5_raw_get_name(f5, name)) < 0)
-		return ret;
-
-	snprintf(path, FAST5_OBJ_PATH_MAX, "/Raw/Reads/%s/Signal", name);
-	DBG(DBG_INFO, "Raw signal: %s", path);
 
-	/* Open an existing dataset. */
-	dataset = H5Dopen2(f5->file, path, H5P_DEFAULT);
-
-	/* Specify size and shape of subset to write. */
+	/* Open dataset. */
+	if ((dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", path);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
 
-	offset[0] = 0;
+	/* Specify size and shape of subset to read. */
+	start[0] = offset;
 	count[0]  = len;
 	stride[0] = 1;
 	block[0] = 1;
 
 	/* Create memory space with size of subset. Get file dataspace
 	   and select subset from file dataspace. */
-
 	dimsm[0] = len;
 	memspace_id = H5Screate_simple(1, dimsm, NULL);
 
 	dataspace_id = H5Dget_space(dataset);
-	H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, 
-						offset, stride, count, block);
-
-	status = H5Dread(dataset, H5T_NATIVE_SHORT, 
-					 memspace_id, dataspace_id, 
-					 H5P_DEFAULT, raw);
+	/* an out of range selection fails here, nothing is read */
+	if (H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, 
+							start, stride, count, block) < 0 ||
+		H5Sselect_valid(dataspace_id) <= 0)
+		status = FAST5_ERR(FAST5_ERR_RANGE);
+	else if (H5Dread(dataset, type, memspace_id, dataspace_id, 
+					 H5P_DEFAULT, buf) < 0)
+		status = FAST5_ERR(FAST5_ERR_HDF5);
+	else
+		status = 0;
 
 	H5Sclose(memspace_id);
 	H5Sclose(dataspace_id);
 	/* Close the dataset. */
 	H5Dclose(dataset);
 
+	if (status >= 0)
+		PERF_ADD(bytes_read, len * H5Tget_size(type));
+
 	return status;
 }
 
 /* -------------------------------------------------------------------------
- * Events detection
+ * Dataset descriptors
  * ------------------------------------------------------------------------- */ 
 
-/* Get the link name for the events detection reads group */
-static int fast5_events_read_dirname(struct fast5 * f5, char * path)
+struct fast5_dset {
+	hid_t dataset;
+	/* file dataspace */
+	hid_t space;
+	/* memory type */
+	hid_t type;
+	/* the type and storage fields of info were read */
+	bool stat;
+	struct fast5_dset_info info;
+};
+
+/* Open a one dimension dataset and get its length */
+static struct fast5_dset * fast5_dset_open_path(struct fast5 * f5, 
+												const char * path, 
+												hid_t type)
 {
-	char dir[FAST5_OBJ_PATH_MAX];
-	char name[FAST5_OBJ_PATH_MAX];
-	H5G_info_t  ginfo;
-	hid_t group;
-	int i;
+	struct fast5_dset * ds;
+	hsize_t dims[1];
 
-	/* Check if group /Analyses/Reads exists in the file. */
-	if (H5Lexists(f5->file, "/Analyses", H5P_DEFAULT) <= 0) {
-		DBG(DBG_WARNING, "Group \"Analyses\" don't exist!");
-		return -1;
+	if ((ds = calloc(1, sizeof(struct fast5_dset))) == NULL) {
+		H5Tclose(type);
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
 	}
+	PERF_INC(alloc);
+	PERF_ADD(alloc_bytes, sizeof(struct fast5_dset));
 
-	sprintf(dir, "/Analyses/%s", "EventDetection_000");
+	ds->type = type;
+	ds->space = -1;
+	strncpy(ds->info.path, path, FAST5_OBJ_PATH_MAX);
 
-	/* Check if group /Analyses/EventDetection_000 exists in the file. */
-	if (H5Lexists(f5->file, dir, H5P_DEFAULT) <= 0) {
-		DBG(DBG_WARNING, "Group \"%s\" don't exist!", dir);
-		return -1;
+	if ((ds->dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", path);
+		fast5_dset_close(ds);
+		FAST5_ERR(FAST5_ERR_NOENT);
+		return NULL;
 	}
 
-	strcat(dir, "/Reads");
-
-	/* Check if group /Analysis/EventDetection_000/Reads exists in the file. */
-	if (H5Lexists(f5->file, dir, H5P_DEFAULT) <= 0) {
-		DBG(DBG_WARNING, "Group \"%s\" don't exist!", dir);
-		return -1;
+	ds->space = H5Dget_space(ds->dataset);
+	if (H5Sget_simple_extent_ndims(ds->space) != 1) {
+		DBG(DBG_WARNING, "\"%s\" is not one dimension!", path);
+		fast5_dset_close(ds);
+		FAST5_ERR(FAST5_ERR_FORMAT);
+		return NULL;
 	}
+	H5Sget_simple_extent_dims(ds->space, dims, NULL);
+	ds->info.length = dims[0];
 
-	if ((group = H5Gopen(f5->file, dir, H5P_DEFAULT)) < 0) {
-		DBG(DBG_WARNING, "Can't access group \"%s\"!", dir);
-		return group;
-	}
+	return ds;
+}
 
-	H5Gget_info(group, &ginfo);
+/* Collect the file type, layout and storage of a dataset, only done
+   when they are asked for */
+static void fast5_dset_stat(struct fast5_dset * ds)
+{
+	hsize_t chunk[1];
+	hid_t ftype;
+	hid_t dcpl;
+	haddr_t offs;
+	unsigned int flags;
+	size_t n;
+	int i;
 
-	if (ginfo.nlinks == 0) {
-		DBG(DBG_WARNING, "Empty group!");
-		return -1;
+	ftype = H5Dget_type(ds->dataset);
+	ds->info.size = H5Tget_size(ftype);
+	ds->info.native = (H5Tequal(ftype, ds->type) > 0);
+	H5Tclose(ftype);
+
+	dcpl = H5Dget_create_plist(ds->dataset);
+	switch (H5Pget_layout(dcpl)) {
+	case H5D_COMPACT:
+		ds->info.layout = FAST5_LAYOUT_COMPACT;
+		break;
+	case H5D_CHUNKED:
+		ds->info.layout = FAST5_LAYOUT_CHUNKED;
+		if (H5Pget_chunk(dcpl, 1, chunk) == 1)
+			ds->info.chunk = chunk[0];
+		break;
+	default:
+		ds->info.layout = FAST5_LAYOUT_CONTIGUOUS;
 	}
 
-	if (ginfo.nlinks > 1) {
-		DBG(DBG_WARNING, "Too many raw sub-groups!");
+	for (i = 0; i < H5Pget_nfilters(dcpl); ++i) {
+		n = 0;
+		switch (H5Pget_filter2(dcpl, i, &flags, &n, NULL, 0, NULL, NULL)) {
+		case H5Z_FILTER_DEFLATE:
+			ds->info.filters |= FAST5_FILTER_DEFLATE;
+			break;
+		case H5Z_FILTER_SHUFFLE:
+			ds->info.filters |= FAST5_FILTER_SHUFFLE;
+			break;
+		default:
+			ds->info.filters |= FAST5_FILTER_OTHER;
+		}
 	}
+	H5Pclose(dcpl);
 
-	i = 0;
+	ds->info.storage = H5Dget_storage_size(ds->dataset);
+	offs = H5Dget_offset(ds->dataset);
+	ds->info.offset = (offs == HADDR_UNDEF) ? -1 : (int64_t)offs;
+
+	ds->stat = true;
+}
 
-	H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, i, 
-					   name, FAST5_OBJ_PATH_MAX, H5P_DEFAULT);
+int fast5_dset_info(struct fast5_dset * ds, struct fast5_dset_info * info)
+{
+	assert(ds != NULL);
+	assert(info != NULL);
 
-	sprintf(path, "%s/%s", dir, name);
+	if (!ds->stat)
+		fast5_dset_stat(ds);
 
-	H5Gclose(group);
+	memcpy(info, &ds->info, sizeof(struct fast5_dset_info));
 
 	return 0;
 }
 
-int fast5_events_info(struct fast5 * f5, struct fast5_events_info * info)
+size_t fast5_dset_length(struct fast5_dset * ds)
 {
-	char path[FAST5_OBJ_PATH_MAX];
-	hid_t dataset;  
-	hid_t dspace;
-	hid_t group;
-	hid_t attr;
-	hsize_t dims[16];
-	int ndims;
-	int ret;
-
-	assert(f5 != NULL);
-	assert(f5->file >= 0);
-	assert(info != NULL);
+	assert(ds != NULL);
 
-	memset(info, 0, sizeof(struct fast5_events_info));
+	return ds->info.length;
+}
 
-	if ((ret = fast5_events_read_dirname(f5, path)) < 0)
-		return ret;
+int fast5_dset_read(struct fast5_dset * ds, void * buf, size_t start, 
+					size_t len)
+{
+	hsize_t offset[1];
+	hsize_t count[1];
+	herr_t status;
+	hid_t memspace;
 
-	snprintf(info->dataset, FAST5_OBJ_PATH_MAX, "%s/Events", path);
-	DBG(DBG_INFO, "Event detection events: %s", info->dataset);
+	assert(ds != NULL);
+	assert(buf != NULL);
 
-	if ((group = H5Gopen(f5->file, path, H5P_DEFAULT)) < 0) {
-		DBG(DBG_WARNING, "Cant open \"%s\" group!", path);
-		return -1;
+	if ((start > ds->info.length) || (len > ds->info.length - start)) {
+		DBG(DBG_WARNING, "Out of range: %zu + %zu!", start, len);
+		return FAST5_ERR(FAST5_ERR_RANGE);
 	}
 
-	if ((attr = H5Aopen(group, "duration", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_ULONG, &info->duration);
-		H5Aclose(attr);
-	}
+	offset[0] = start;
+	count[0] = len;
+	memspace = H5Screate_simple(1, count, NULL);
+	H5Sselect_hyperslab(ds->space, H5S_SELECT_SET, offset, NULL, count, 
+						NULL);
 
-	if ((attr = H5Aopen(group, "median_before", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->median_before);
-		H5Aclose(attr);
-	}
+	status = H5Dread(ds->dataset, ds->type, memspace, ds->space, 
+					 H5P_DEFAULT, buf);
 
-	if ((attr = H5Aopen(group, "read_id", H5P_DEFAULT)) >= 0) {
-		/* read a fixed length string */
-		hid_t type = H5Tcopy(H5T_C_S1);
-		H5Tset_size(type, FAST5_UUID_MAX);
-		H5Aread(attr, type, info->read_id);
-		H5Aclose(attr);
-		H5Tclose(type);
-	}
+	H5Sclose(memspace);
 
-	if ((attr = H5Aopen(group, "read_number", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_ULONG, &info->read_number);
-		H5Aclose(attr);
-	}
+	if (status < 0)
+		return FAST5_ERR(FAST5_ERR_HDF5);
 
-	if ((attr = H5Aopen(group, "scaling_used", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_LLONG, &info->scaling_used);
-		H5Aclose(attr);
-	}
+	PERF_ADD(bytes_read, len * H5Tget_size(ds->type));
 
-	if ((attr = H5Aopen(group, "start_mux", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_LONG, &info->start_mux);
-		H5Aclose(attr);
-	}
+	return 0;
+}
 
-	if ((attr = H5Aopen(group, "start_time", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->start_time);
-		H5Aclose(attr);
+int fast5_dset_close(struct fast5_dset * ds)
+{
+	assert(ds != NULL);
+
+	if (ds->space >= 0)
+		H5Sclose(ds->space);
+	if (ds->dataset >= 0)
+		H5Dclose(ds->dataset);
+	H5Tclose(ds->type);
+
+	free(ds);
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Raw signals
+ * ------------------------------------------------------------------------- */ 
+
+/* Get the link name of the selected read in a reads group */
+static int fast5_reads_get_name(struct fast5 * f5, const char * dir, 
+								char * name)
+{
+	H5G_info_t  ginfo;
+	hid_t group;
+	int ret;
+
+	if ((group = H5Gopen(f5->file, dir, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't access group \"%s\"!", dir);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	if ((ret = H5Gget_info(group, &ginfo)) < 0) {
+		DBG(DBG_WARNING, "Can't access group \"%s\"!", dir);
+		H5Gclose(group);
+		return FAST5_ERR(FAST5_ERR_HDF5);
+	}
+
+	if (ginfo.nlinks <= f5->read_idx) {
+		DBG(DBG_WARNING, "No read %d in \"%s\"!", f5->read_idx, dir);
+		H5Gclose(group);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	ret = H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, 
+							 f5->read_idx, name, FAST5_OBJ_PATH_MAX, 
+							 H5P_DEFAULT);
+	H5Gclose(group);
+
+	if (ret < 0)
+		return FAST5_ERR(FAST5_ERR_HDF5);
+
+	/* the returned length is the full name's, truncated names are not 
+	   used to build paths */
+	if (ret >= FAST5_OBJ_PATH_MAX)
+		return FAST5_ERR(FAST5_ERR_NAME);
+
+	return 0;
+}
+
+/* Get the link name for the raw reads group */
+static int fast5_raw_get_name(struct fast5 * f5, char * name)
+{
+	/* Check if group /Raw exists in the file. */
+	if (!fast5_has(f5, FAST5_GRP_RAW))
+		return FAST5_ERR(FAST5_ERR_NOENT);
+
+	/* Check if group /Raw/Reads exists in the file. */
+	if (H5Lexists(f5->file, "/Raw/Reads", H5P_DEFAULT) <= 0)
+		return FAST5_ERR(FAST5_ERR_NOENT);
+
+	return fast5_reads_get_name(f5, "/Raw/Reads", name);
+}
+
+struct fast5_dset * fast5_raw_open(struct fast5 * f5)
+{
+	char name[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	if ((fast5_raw_get_name(f5, name) < 0) ||
+		(fast5_path(path, "/Raw/Reads/%s/Signal", name) < 0))
+		return NULL;
+
+	return fast5_dset_open_path(f5, path, H5Tcopy(H5T_NATIVE_INT16));
+}
+
+int fast5_raw_read_info_mask(struct fast5 * f5, struct fast5_raw * info,
+							 unsigned int mask)
+{
+	char gpath[FAST5_OBJ_PATH_MAX];
+	char name[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+	int ret;
+	PERF_CALL(FAST5_PERF_RAW_INFO);
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(info != NULL);
+
+	memset(info, 0, sizeof(struct fast5_raw));
+
+	/* versions with no raw reads, don't look for them */
+	if (fast5_schema(f5)->raw.cnt == 0)
+		return FAST5_ERR(FAST5_ERR_NOENT);
+
+	if ((ret = fast5_raw_get_name(f5, name)) < 0)
+		return ret;
+
+	if ((ret = fast5_path(info->dataset, "/Raw/Reads/%s/Signal", name)) < 0)
+		return ret;
+	DBG(DBG_INFO, "Raw signal: %s", info->dataset);
+
+	/* Don't touch the read group if no attributes were requested */
+	if (mask & FAST5_F_RAW_ATTRS) {
+		fast5_path(gpath, "/Raw/Reads/%s", name);
+		if ((group = H5Gopen(f5->file, gpath, H5P_DEFAULT)) < 0) {
+			DBG(DBG_WARNING, "Cant open \"%s\" group!", gpath);
+			return FAST5_ERR(FAST5_ERR_NOENT);
+		}
+
+		fast5_attrs_read(group, &fast5_schema(f5)->raw, info, mask);
+
+		H5Gclose(group);
+	}
+
+	/* The signal dataset is only opened to get its length */
+	if (mask & FAST5_F_LENGTH) {
+		if ((ret = fast5_dset_path_length(f5, info->dataset, 
+										  &info->length)) < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int fast5_raw_read_info(struct fast5 * f5, struct fast5_raw * info)
+{
+	return fast5_raw_read_info_mask(f5, info, FAST5_F_ALL);
+}
+
+int fast5_raw_read_range(struct fast5 * f5, int16_t * raw, size_t start,
+						 size_t len)
+{
+	char name[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	int ret;
+	PERF_CALL(FAST5_PERF_RAW_READ);
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(raw != NULL);
+
+	if (((ret = fast5_raw_get_name(f5, name)) < 0) ||
+		((ret = fast5_path(path, "/Raw/Reads/%s/Signal", name)) < 0))
+		return ret;
+
+	/* out of range reads are rejected */
+	return fast5_dset_path_read(f5, path, H5T_NATIVE_INT16, raw, start, len);
+}
+
+int fast5_raw_read(struct fast5 * f5, int16_t * raw, size_t len)
+{
+	return fast5_raw_read_range(f5, raw, 0, len);
+}
+
+/* Map the raw signal of a contiguous, unfiltered, native int16 dataset */
+static const int16_t * fast5_raw_mmap(struct fast5 * f5, 
+									  const struct fast5_dset_info * info)
+{
+	char fname[PATH_MAX];
+	size_t pgsz;
+	size_t skip;
+	void * addr;
+	int fd;
+
+	/* The bytes in the file must be usable as they are, and there must 
+	   be a file */
+	if ((info->layout != FAST5_LAYOUT_CONTIGUOUS) || (info->filters != 0) ||
+		!info->native || (info->offset < 0) || (f5->flags & FAST5_MEMORY))
+		return NULL;
+
+	if (H5Fget_name(f5->file, fname, sizeof(fname)) < 0)
+		return NULL;
+
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return NULL;
+
+	pgsz = sysconf(_SC_PAGESIZE);
+	skip = info->offset % pgsz;
+	f5->map.size = skip + info->length * sizeof(int16_t);
+	addr = mmap(NULL, f5->map.size, PROT_READ, MAP_SHARED, fd, 
+				info->offset - skip);
+	close(fd);
+
+	if (addr == MAP_FAILED) {
+		DBG(DBG_WARNING, "mmap() failed!");
+		f5->map.size = 0;
+		return NULL;
+	}
+
+	madvise(addr, f5->map.size, MADV_SEQUENTIAL);
+	f5->map.addr = addr;
+
+	return (const int16_t *)((uint8_t *)addr + skip);
+}
+
+const int16_t * fast5_raw_map(struct fast5 * f5, size_t * len)
+{
+	struct fast5_dset_info info;
+	const int16_t * raw = NULL;
+	struct fast5_dset * ds;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(len != NULL);
+
+	fast5_raw_unmap(f5);
+
+	*len = 0;
+
+	if ((ds = fast5_raw_open(f5)) == NULL)
+		return NULL;
+
+	fast5_dset_info(ds, &info);
+	*len = info.length;
+
+	if (info.length == 0) {
+		fast5_dset_close(ds);
+		return NULL;
+	}
+
+	if ((raw = fast5_raw_mmap(f5, &info)) != NULL) {
+		DBG(DBG_INFO, "\"%s\" mapped", info.path);
+		fast5_dset_close(ds);
+		return raw;
+	}
+
+	/* Fall back to a copy, read through the same dataset handle */
+	if ((f5->map.buf = malloc(info.length * sizeof(int16_t))) != NULL) {
+		PERF_INC(alloc);
+		PERF_ADD(alloc_bytes, info.length * sizeof(int16_t));
+
+		if (fast5_dset_read(ds, f5->map.buf, 0, info.length) < 0) {
+			free(f5->map.buf);
+			f5->map.buf = NULL;
+		}
+		raw = f5->map.buf;
+	}
+
+	fast5_dset_close(ds);
+
+	return raw;
+}
+
+int fast5_raw_unmap(struct fast5 * f5)
+{
+	assert(f5 != NULL);
+
+	if (f5->map.addr != NULL) {
+		munmap(f5->map.addr, f5->map.size);
+		f5->map.addr = NULL;
+		f5->map.size = 0;
+	}
+
+	if (f5->map.buf != NULL) {
+		free(f5->map.buf);
+		f5->map.buf = NULL;
+	}
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Open pore trimming
+ * ------------------------------------------------------------------------- */ 
+
+static const struct fast5_trim_opt fast5_trim_default = {
+	.win = 40,
+	.hold = 5,
+	.ratio = 0.8,
+	.max = 40000
+};
+
+size_t fast5_trim_detect(const int16_t * raw, size_t len, double level,
+						 const struct fast5_trim_opt * opt)
+{
+	double thr;
+	size_t start = 0;
+	size_t pos;
+	unsigned int run = 0;
+	unsigned int i;
+	int64_t sum;
+
+	assert(raw != NULL);
+
+	if (opt == NULL)
+		opt = &fast5_trim_default;
+
+	if ((opt->win == 0) || (opt->hold == 0))
+		return 0;
+
+	/* window sums are compared, no division per window */
+	thr = opt->ratio * level * opt->win;
+
+	for (pos = 0; pos + opt->win <= len; pos += opt->win) {
+		sum = 0;
+		for (i = 0; i < opt->win; ++i)
+			sum += raw[pos + i];
+
+		if (sum < thr) {
+			if (run++ == 0)
+				start = pos;
+			if (run == opt->hold)
+				return start;
+		} else
+			run = 0;
+	}
+
+	/* no strand found */
+	return len;
+}
+
+int fast5_raw_trim(struct fast5 * f5, const struct fast5_trim_opt * opt,
+				   size_t * offset)
+{
+	struct fast5_channel_id cal;
+	struct fast5_raw info;
+	int16_t * raw;
+	double level;
+	size_t len;
+	int ret;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(offset != NULL);
+
+	*offset = 0;
+
+	if (opt == NULL)
+		opt = &fast5_trim_default;
+
+	if ((ret = fast5_raw_read_info_mask(f5, &info, FAST5_F_MEDIAN_BEFORE | 
+										FAST5_F_LENGTH)) < 0)
+		return ret;
+
+	if ((ret = fast5_channel_id(f5, &cal)) < 0)
+		return ret;
+
+	/* the open pore level, in pA, back to ADC units */
+	if ((info.median_before <= 0) || (cal.range <= 0)) {
+		DBG(DBG_INFO, "No open pore level!");
+		return 0;
+	}
+	level = info.median_before * cal.digitisation / cal.range - cal.offset;
+
+	len = (info.length < opt->max) ? info.length : opt->max;
+	if (len == 0)
+		return 0;
+
+	if ((raw = malloc(len * sizeof(int16_t))) == NULL)
+		return FAST5_ERR(FAST5_ERR_NOMEM);
+	PERF_INC(alloc);
+	PERF_ADD(alloc_bytes, len * sizeof(int16_t));
+
+	if ((ret = fast5_raw_read_range(f5, raw, 0, len)) >= 0)
+		*offset = fast5_trim_detect(raw, len, level, opt);
+
+	free(raw);
+
+	return ret;
+}
+
+/* -------------------------------------------------------------------------
+ * Analyses
+ * ------------------------------------------------------------------------- */ 
+
+static herr_t fast5_analysis_add(hid_t group, const char * name, 
+								 const H5L_info_t * linfo, void * arg)
+{
+	struct fast5 * f5 = (struct fast5 *)arg;
+	struct fast5_analysis * an;
+	const char * cp;
+	size_t n;
+
+	/* a truncated name would not be the path of the group, it is left
+	   out and the walk goes on */
+	if (strlen(name) > FAST5_ANALYSIS_NAME_MAX) {
+		DBG(DBG_WARNING, "Analysis name too long: \"%.32s...\"!", name);
+		FAST5_ERR(FAST5_ERR_NAME);
+		return 0;
+	}
+
+	if (f5->nan == f5->an_size) {
+		int size = f5->an_size ? 2 * f5->an_size : 8;
+
+		if ((an = realloc(f5->an, size * sizeof(struct fast5_analysis))) 
+			== NULL)
+			return -1;
+		PERF_INC(alloc);
+		PERF_ADD(alloc_bytes, size * sizeof(struct fast5_analysis));
+		f5->an = an;
+		f5->an_size = size;
+	}
+
+	an = &f5->an[f5->nan++];
+	memset(an, 0, sizeof(struct fast5_analysis));
+	strcpy(an->name, name);
+
+	/* <type>_<version>, e.g.: "Basecall_1D_002" */
+	n = strlen(an->name);
+	if (((cp = strrchr(an->name, '_')) != NULL) && (cp[1] != '\0') &&
+		(strspn(cp + 1, "0123456789") == strlen(cp + 1))) {
+		an->version = strtoul(cp + 1, NULL, 10);
+		n = cp - an->name;
+	}
+	memcpy(an->type, an->name, n);
+	an->type[n] = '\0';
+
+	return 0;
+}
+
+/* Select the highest version of each analysis type, or of one type only */
+static void fast5_analysis_latest(struct fast5 * f5, const char * type)
+{
+	struct fast5_analysis * an;
+	struct fast5_analysis * sel;
+	int i;
+	int j;
+
+	for (i = 0; i < f5->nan; ++i) {
+		an = &f5->an[i];
+		if ((type != NULL) && (strcmp(an->type, type) != 0))
+			continue;
+
+		sel = an;
+		for (j = 0; j < f5->nan; ++j) {
+			if ((strcmp(f5->an[j].type, an->type) == 0) &&
+				(f5->an[j].version > sel->version))
+				sel = &f5->an[j];
+		}
+		an->selected = (an == sel);
+	}
+}
+
+/* Walk the /Analyses group once per handle */
+static int fast5_analyses_load(struct fast5 * f5)
+{
+	hsize_t idx = 0;
+	hid_t group;
+
+	if (f5->nan >= 0)
+		return f5->nan;
+
+	f5->nan = 0;
+
+	if (!fast5_has(f5, FAST5_GRP_ANALYSES))
+		return 0;
+
+	if ((group = H5Gopen(f5->file, "/Analyses", H5P_DEFAULT)) < 0)
+		return 0;
+
+	if (H5Literate(group, H5_INDEX_NAME, H5_ITER_INC, &idx, 
+				   fast5_analysis_add, f5) < 0) {
+		DBG(DBG_WARNING, "Can't list \"/Analyses\"!");
+	}
+
+	H5Gclose(group);
+
+	fast5_analysis_latest(f5, NULL);
+
+	return f5->nan;
+}
+
+/* Get the selected analysis of a type, NULL if there is none */
+static const struct fast5_analysis * fast5_analysis_find(struct fast5 * f5, 
+														 const char * type)
+{
+	int i;
+
+	fast5_analyses_load(f5);
+
+	for (i = 0; i < f5->nan; ++i) {
+		if (f5->an[i].selected && (strcmp(f5->an[i].type, type) == 0))
+			return &f5->an[i];
+	}
+
+	return NULL;
+}
+
+int fast5_analysis_count(struct fast5 * f5)
+{
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	return fast5_analyses_load(f5);
+}
+
+int fast5_analysis_get(struct fast5 * f5, unsigned int idx, 
+					   struct fast5_analysis * an)
+{
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(an != NULL);
+
+	if (idx >= fast5_analyses_load(f5))
+		return FAST5_ERR(FAST5_ERR_RANGE);
+
+	memcpy(an, &f5->an[idx], sizeof(struct fast5_analysis));
+
+	return 0;
+}
+
+int fast5_analysis_select(struct fast5 * f5, const char * name)
+{
+	struct fast5_analysis * an = NULL;
+	int i;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(name != NULL);
+
+	fast5_analyses_load(f5);
+
+	for (i = 0; i < f5->nan; ++i) {
+		if (strcmp(f5->an[i].name, name) == 0)
+			an = &f5->an[i];
+	}
+
+	if (an == NULL) {
+		DBG(DBG_WARNING, "No analysis \"%s\"!", name);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	for (i = 0; i < f5->nan; ++i) {
+		if (strcmp(f5->an[i].type, an->type) == 0)
+			f5->an[i].selected = false;
+	}
+	an->selected = true;
+
+	/* the reads of another analysis may differ */
+	f5->nreads = -1;
+
+	return 0;
+}
+
+int fast5_analysis_select_latest(struct fast5 * f5, const char * type)
+{
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	fast5_analyses_load(f5);
+	fast5_analysis_latest(f5, type);
+	f5->nreads = -1;
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Events detection
+ * ------------------------------------------------------------------------- */ 
+
+/* Look for the group under dir with the read_id of the selected raw 
+   read, for files where the raw and events groups are named apart */
+static int fast5_events_find_read_id(struct fast5 * f5, const char * dir, 
+									 char * path)
+{
+	struct fast5_events_info ev;
+	struct fast5_raw raw;
+	char name[FAST5_OBJ_PATH_MAX];
+	H5G_info_t ginfo;
+	hsize_t i;
+	hid_t group;
+	hid_t read;
+	int ret;
+
+	if ((ret = fast5_raw_read_info_mask(f5, &raw, FAST5_F_READ_ID)) < 0)
+		return ret;
+
+	if (raw.read_id[0] == '\0')
+		return FAST5_ERR(FAST5_ERR_NOENT);
+
+	if ((group = H5Gopen(f5->file, dir, H5P_DEFAULT)) < 0)
+		return FAST5_ERR(FAST5_ERR_NOENT);
+
+	if (H5Gget_info(group, &ginfo) < 0) {
+		H5Gclose(group);
+		return FAST5_ERR(FAST5_ERR_HDF5);
+	}
+
+	for (i = 0; i < ginfo.nlinks; ++i) {
+		if ((ret = H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, 
+									  H5_ITER_INC, i, name, 
+									  FAST5_OBJ_PATH_MAX, 
+									  H5P_DEFAULT)) < 0)
+			break;
+
+		if ((ret >= FAST5_OBJ_PATH_MAX) || 
+			((read = H5Gopen(group, name, H5P_DEFAULT)) < 0))
+			continue;
+
+		memset(&ev, 0, sizeof(ev));
+		fast5_attrs_read(read, &fast5_schema(f5)->events, &ev, 
+						 FAST5_F_READ_ID);
+		H5Gclose(read);
+
+		if (strcmp(ev.read_id, raw.read_id) == 0) {
+			H5Gclose(group);
+			return fast5_path(path, "%s/%s", dir, name);
+		}
+	}
+
+	H5Gclose(group);
+
+	DBG(DBG_INFO, "No events for read \"%s\"!", raw.read_id);
+
+	return FAST5_ERR(FAST5_ERR_NOENT);
+}
+
+/* Get the link name for the events detection group of the selected read */
+static int fast5_events_read_dirname(struct fast5 * f5, char * path)
+{
+	const struct fast5_analysis * an;
+	char dir[FAST5_OBJ_PATH_MAX];
+	char name[FAST5_OBJ_PATH_MAX];
+
+	int ret;
+
+	/* Check if group /Analyses exists in the file. */
+	if (!fast5_has(f5, FAST5_GRP_ANALYSES)) {
+		DBG(DBG_WARNING, "Group \"Analyses\" don't exist!");
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	if ((an = fast5_analysis_find(f5, "EventDetection")) == NULL) {
+		DBG(DBG_WARNING, "No event detection analysis!");
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	if ((ret = fast5_path(dir, "/Analyses/%s/Reads", an->name)) < 0)
+		return ret;
+
+	/* Check if group /Analysis/EventDetection_NNN/Reads exists in the file. */
+	if (H5Lexists(f5->file, dir, H5P_DEFAULT) <= 0) {
+		DBG(DBG_WARNING, "Group \"%s\" don't exist!", dir);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	/* In an events only file the reads are selected by position */
+	if ((fast5_schema(f5)->raw.cnt == 0) || 
+		(fast5_raw_get_name(f5, name) < 0)) {
+		if ((ret = fast5_reads_get_name(f5, dir, name)) < 0)
+			return ret;
+
+		return fast5_path(path, "%s/%s", dir, name);
+	}
+
+	/* Otherwise the events group pairs with the selected raw read, some 
+	   of the reads may have no events. The groups share the name. */
+	if ((ret = fast5_path(path, "%s/%s", dir, name)) < 0)
+		return ret;
+
+	if (H5Lexists(f5->file, path, H5P_DEFAULT) > 0)
+		return 0;
+
+	return fast5_events_find_read_id(f5, dir, path);
+}
+
+int fast5_events_info_mask(struct fast5 * f5, 
+						   struct fast5_events_info * info, unsigned int mask)
+{
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+	int ret;
+	PERF_CALL(FAST5_PERF_EVENTS_INFO);
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(info != NULL);
+
+	memset(info, 0, sizeof(struct fast5_events_info));
+
+	if ((ret = fast5_events_read_dirname(f5, path)) < 0)
+		return ret;
+
+	if ((ret = fast5_path(info->dataset, "%s/Events", path)) < 0)
+		return ret;
+	DBG(DBG_INFO, "Event detection events: %s", info->dataset);
+
+	/* Don't touch the read group if no attributes were requested */
+	if (mask & FAST5_F_EVENTS_ATTRS) {
+		if ((group = H5Gopen(f5->file, path, H5P_DEFAULT)) < 0) {
+			DBG(DBG_WARNING, "Cant open \"%s\" group!", path);
+			return FAST5_ERR(FAST5_ERR_NOENT);
+		}
+
+		fast5_attrs_read(group, &fast5_schema(f5)->events, info, mask);
+
+		H5Gclose(group);
+	}
+
+	/* The events dataset is only opened to get its length */
+	if (mask & FAST5_F_LENGTH) {
+		if ((ret = fast5_dset_path_length(f5, info->dataset, 
+										  &info->length)) < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int fast5_events_info(struct fast5 * f5, struct fast5_events_info * info)
+{
+	return fast5_events_info_mask(f5, info, FAST5_F_ALL);
+}
+
+struct fast5_dset * fast5_events_open(struct fast5 * f5)
+{
+	char path[FAST5_OBJ_PATH_MAX];
+	char datasetname[FAST5_OBJ_PATH_MAX];
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	if ((fast5_events_read_dirname(f5, path) < 0) ||
+		(fast5_path(datasetname, "%s/Events", path) < 0))
+		return NULL;
+
+	return fast5_dset_open_path(f5, datasetname, fast5_event_type_create());
+}
+
+/* Create the memory data type for the event detection records */
+hid_t fast5_event_type_create(void)
+{
+	hid_t type;
+
+	type = H5Tcreate(H5T_COMPOUND, sizeof(struct fast5_event));
+	H5Tinsert(type, "start", HOFFSET(struct fast5_event, start), 
+			  H5T_NATIVE_LLONG);
+	H5Tinsert(type, "length", HOFFSET(struct fast5_event, length), 
+			  H5T_NATIVE_LLONG);
+	H5Tinsert(type, "mean", HOFFSET(struct fast5_event, mean), 
+			  H5T_NATIVE_DOUBLE);
+	H5Tinsert(type, "stdv", HOFFSET(struct fast5_event, stdv), 
+			  H5T_NATIVE_DOUBLE);
+	H5Tinsert(type, "variance", HOFFSET(struct fast5_event, variance), 
+			  H5T_NATIVE_DOUBLE);
+
+	return type;
+}
+
+static int __fast5_events_read(struct fast5 * f5, hid_t type,
+							   struct fast5_event * event, size_t offset,
+							   size_t len)
+{
+	char path[FAST5_OBJ_PATH_MAX];
+	char datasetname[FAST5_OBJ_PATH_MAX];
+	int ret;
+
+	if ((ret = fast5_events_read_dirname(f5, path)) < 0)
+		return ret;
+
+	if ((ret = fast5_path(datasetname, "%s/Events", path)) < 0)
+		return ret;
+
+	return fast5_dset_path_read(f5, datasetname, type, event, offset, len);
+}
+
+int fast5_events_read(struct fast5 * f5, struct fast5_event * event, 
+					  size_t len)
+{
+	hid_t type;
+	int ret;
+	PERF_CALL(FAST5_PERF_EVENTS_READ);
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(event != NULL);
+
+	/*
+	 * Create the memory data type.
+	 */
+	type = fast5_event_type_create();
+
+	ret = __fast5_events_read(f5, type, event, 0, len);
+
+	H5Tclose(type);
+
+	return ret;
+}
+
+int fast5_events_read_range(struct fast5 * f5, struct fast5_event * event, 
+							size_t offset, size_t len)
+{
+	hid_t type;
+	int ret;
+	PERF_CALL(FAST5_PERF_EVENTS_READ);
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(event != NULL);
+
+	type = fast5_event_type_create();
+
+	ret = __fast5_events_read(f5, type, event, offset, len);
+
+	H5Tclose(type);
+
+	return ret;
+}
+
+/* -------------------------------------------------------------------------
+ * Events index
+ * ------------------------------------------------------------------------- */ 
+
+#define FAST5_EVENT_INDEX_STEP 64
+
+/* "start" and "length" fields only */
+struct fast5_event_span {
+	int64_t start;
+	int64_t length;
+};
+
+struct fast5_event_index {
+	/* the events dataset, open for the life of the index */
+	hid_t dataset;
+	hid_t space;
+	/* number of events */
+	size_t len;
+	/* events per index entry */
+	unsigned int step;
+	/* start of every step-th event */
+	int64_t * start;
+	size_t cnt;
+	/* memory types of the start column, and of a block of events */
+	hid_t start_type;
+	hid_t type;
+	struct fast5_event_span * blk;
+};
+
+static hid_t fast5_event_span_type_create(void)
+{
+	hid_t type;
+
+	type = H5Tcreate(H5T_COMPOUND, sizeof(struct fast5_event_span));
+	H5Tinsert(type, "start", HOFFSET(struct fast5_event_span, start), 
+			  H5T_NATIVE_LLONG);
+	H5Tinsert(type, "length", HOFFSET(struct fast5_event_span, length), 
+			  H5T_NATIVE_LLONG);
+
+	return type;
+}
+
+/* Read cnt records of type, from event first, every stride events */
+static int fast5_event_index_read(struct fast5_event_index * idx, 
+								  hid_t type, void * buf, size_t first, 
+								  size_t stride, size_t cnt)
+{
+	hsize_t start[1];
+	hsize_t step[1];
+	hsize_t count[1];
+	herr_t status;
+	hid_t memspace;
+
+	start[0] = first;
+	step[0] = stride;
+	count[0] = cnt;
+	memspace = H5Screate_simple(1, count, NULL);
+	H5Sselect_hyperslab(idx->space, H5S_SELECT_SET, start, step, count, 
+						NULL);
+
+	status = H5Dread(idx->dataset, type, memspace, idx->space, 
+					 H5P_DEFAULT, buf);
+
+	H5Sclose(memspace);
+
+	if (status < 0)
+		return FAST5_ERR(FAST5_ERR_HDF5);
+
+	PERF_ADD(bytes_read, cnt * H5Tget_size(type));
+
+	return 0;
+}
+
+struct fast5_event_index * fast5_event_index_new(struct fast5 * f5, 
+												 unsigned int step)
+{
+	struct fast5_events_info info;
+	struct fast5_event_index * idx;
+	hsize_t dims[1];
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	if (step == 0)
+		step = FAST5_EVENT_INDEX_STEP;
+
+	if (fast5_events_info_mask(f5, &info, 0) < 0)
+		return NULL;
+
+	if ((idx = calloc(1, sizeof(struct fast5_event_index))) == NULL) {
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	idx->dataset = -1;
+	idx->space = -1;
+	idx->step = step;
+	idx->type = fast5_event_span_type_create();
+	/* the start field alone, read as an int64_t array */
+	idx->start_type = H5Tcreate(H5T_COMPOUND, sizeof(int64_t));
+	H5Tinsert(idx->start_type, "start", 0, H5T_NATIVE_LLONG);
+
+	if ((idx->dataset = H5Dopen2(f5->file, info.dataset, 
+								 H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", info.dataset);
+		fast5_event_index_free(idx);
+		FAST5_ERR(FAST5_ERR_NOENT);
+		return NULL;
+	}
+
+	idx->space = H5Dget_space(idx->dataset);
+	if (H5Sget_simple_extent_ndims(idx->space) != 1) {
+		DBG(DBG_WARNING, "\"%s\" is not one dimension!", info.dataset);
+		fast5_event_index_free(idx);
+		FAST5_ERR(FAST5_ERR_FORMAT);
+		return NULL;
+	}
+	H5Sget_simple_extent_dims(idx->space, dims, NULL);
+
+	idx->len = dims[0];
+	idx->cnt = (idx->len + step - 1) / step;
+	idx->start = malloc((idx->cnt + 1) * sizeof(int64_t));
+	idx->blk = malloc(step * sizeof(struct fast5_event_span));
+	PERF_ADD(alloc, 3);
+	PERF_ADD(alloc_bytes, sizeof(struct fast5_event_index) + 
+			 (idx->cnt + 1) * sizeof(int64_t) + 
+			 step * sizeof(struct fast5_event_span));
+
+	if ((idx->start == NULL) || (idx->blk == NULL)) {
+		fast5_event_index_free(idx);
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	if (idx->len == 0)
+		return idx;
+
+	/* The first start of each block, in one strided read of the start 
+	   column. The end of the last event terminates the table. */
+	if ((fast5_event_index_read(idx, idx->start_type, idx->start, 0, 
+								step, idx->cnt) < 0) ||
+		(fast5_event_index_read(idx, idx->type, idx->blk, idx->len - 1, 
+								1, 1) < 0)) {
+		fast5_event_index_free(idx);
+		return NULL;
+	}
+	idx->start[idx->cnt] = idx->blk[0].start + idx->blk[0].length;
+
+	return idx;
+}
+
+int fast5_event_index_free(struct fast5_event_index * idx)
+{
+	assert(idx != NULL);
+
+	if (idx->start != NULL)
+		free(idx->start);
+	if (idx->blk != NULL)
+		free(idx->blk);
+	if (idx->space >= 0)
+		H5Sclose(idx->space);
+	if (idx->dataset >= 0)
+		H5Dclose(idx->dataset);
+	H5Tclose(idx->start_type);
+	H5Tclose(idx->type);
+	free(idx);
+
+	return 0;
+}
+
+long fast5_event_index_lookup(struct fast5_event_index * idx, 
+							  int64_t sample)
+{
+	size_t lo;
+	size_t hi;
+	size_t mid;
+	size_t first;
+	size_t n;
+
+	assert(idx != NULL);
+
+	if ((idx->len == 0) || (sample < idx->start[0]) || 
+		(sample >= idx->start[idx->cnt]))
+		return -1;
+
+	/* last block whose first event starts at or before the sample */
+	lo = 0;
+	hi = idx->cnt;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (idx->start[mid] <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	first = lo * idx->step;
+	n = (idx->len - first < idx->step) ? idx->len - first : idx->step;
+
+	if (fast5_event_index_read(idx, idx->type, idx->blk, first, 1, n) < 0)
+		return -1;
+
+	/* last event of the block starting at or before the sample */
+	lo = 0;
+	hi = n;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (idx->blk[mid].start <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	/* a gap between events */
+	if (sample >= idx->blk[lo].start + idx->blk[lo].length)
+		return -1;
+
+	return first + lo;
+}
+
+int fast5_channel_id(struct fast5 * f5, struct fast5_channel_id * info)
+{
+	char name[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+	PERF_CALL(FAST5_PERF_CHANNEL_ID);
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(info != NULL);
+
+	memset(info, 0, sizeof(struct fast5_channel_id));
+
+	if (!fast5_has(f5, FAST5_GRP_UNIQUE_GLOBAL_KEY)) {
+		DBG(DBG_WARNING, "Group \"/UniqueGlobalKey\" not found!");
+		return FAST5_ERR(FAST5_ERR_FORMAT);
+	}
+
+	fast5_path(path, "/UniqueGlobalKey/channel_id");
+
+	/* Reads of a multi-read file may come from different channels, in 
+	   that case each read group carries its own channel_id group, the 
+	   raw one or, in an events only file, the event detection one. */
+	if (fast5_read_count(f5) > 1) {
+		char rpath[FAST5_OBJ_PATH_MAX];
+		int ret;
+
+		if (fast5_raw_get_name(f5, name) == 0)
+			ret = fast5_path(rpath, "/Raw/Reads/%s/channel_id", name);
+		else if (fast5_events_read_dirname(f5, name) == 0)
+			ret = fast5_path(rpath, "%s/channel_id", name);
+		else
+			ret = -1;
+
+		if ((ret == 0) && (H5Lexists(f5->file, rpath, H5P_DEFAULT) > 0))
+			memcpy(path, rpath, sizeof(path));
+	}
+
+	if ((group = H5Gopen(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't access group \"%s\"!", path);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	fast5_attrs_read(group, &fast5_schema(f5)->channel_id, info, 
+					 FAST5_F_ALL);
+
+	H5Gclose(group);
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Basecall results
+ * ------------------------------------------------------------------------- */ 
+
+static const char * const fast5_strand_nm[] = {
+	[FAST5_STRAND_TEMPLATE] = "template",
+	[FAST5_STRAND_COMPLEMENT] = "complement",
+	[FAST5_STRAND_2D] = "2D"
+};
+
+/* Get the BaseCalled_<strand> group of the selected basecall analyses. 
+   Basecall_2D analyses also hold the 1D template and complement strands,
+   they are used if there is no Basecall_1D one. */
+static int fast5_basecall_dirname(struct fast5 * f5, unsigned int strand, 
+								  char * path)
+{
+	static const char * const type[] = { "Basecall_1D", "Basecall_2D" };
+	const struct fast5_analysis * an;
+	int i;
+
+	if (strand > FAST5_STRAND_2D)
+		return FAST5_ERR(FAST5_ERR_INVAL);
+
+	for (i = (strand == FAST5_STRAND_2D) ? 1 : 0; i < 2; ++i) {
+		if ((an = fast5_analysis_find(f5, type[i])) == NULL)
+			continue;
+
+		if ((fast5_path(path, "/Analyses/%s/BaseCalled_%s", an->name, 
+						fast5_strand_nm[strand]) == 0) &&
+			(H5Lexists(f5->file, path, H5P_DEFAULT) > 0))
+			return 0;
 	}
 
-	H5Gclose(group);
+	DBG(DBG_INFO, "No %s basecall!", fast5_strand_nm[strand]);
 
-	/* Open dataset. */
-	dataset = H5Dopen2(f5->file, info->dataset, H5P_DEFAULT);
-	/* GEt the dataset's dataspace. */
+	return FAST5_ERR(FAST5_ERR_NOENT);
+}
+
+/* Read a variable length string from a one element dataset. A NULL 
+   string is returned as NULL, the string is released with 
+   H5free_memory(). */
+static int fast5_vstr_read(hid_t dataset, char ** s)
+{
+	hid_t dspace;
+	hid_t type;
+	int ret = 0;
+
+	type = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type, H5T_VARIABLE);
 	dspace = H5Dget_space(dataset);
-	/* Get dimensions */
-	ndims = H5Sget_simple_extent_ndims(dspace);
-	H5Sget_simple_extent_dims(dspace, dims, NULL);
-	DBG(DBG_INFO, "ndims=%d dims[0]=%d", ndims, (int)dims[0]);
+	*s = NULL;
+	if ((H5Sget_simple_extent_npoints(dspace) != 1) ||
+		(H5Dread(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, s) < 0))
+		ret = -1;
+	H5Sclose(dspace);
+	H5Tclose(type);
+
+	return ret;
+}
 
-	info->length = dims[0];
+/* Length of a FASTQ record, either a fixed or a variable length string.
+   H5Dvlen_get_buf_size() overruns its buffers on a scalar dataspace, a 
+   variable length string is read to know its size. */
+static int fast5_fastq_len(hid_t dataset, size_t * len)
+{
+	hid_t ftype;
+	char * s;
+	int ret = 0;
 
-	/* Close the dataspace. */
-	H5Sclose(dspace);  
-	/* Close the dataset. */
-	H5Dclose(dataset);
+	ftype = H5Dget_type(dataset);
 
-	return 0;
+	if (H5Tis_variable_str(ftype) > 0) {
+		ret = fast5_vstr_read(dataset, &s);
+		*len = (s != NULL) ? strlen(s) : 0;
+		if (s != NULL)
+			H5free_memory(s);
+	} else
+		*len = H5Tget_size(ftype);
+
+	H5Tclose(ftype);
+
+	return ret;
 }
 
-int fast5_events_read(struct fast5 * f5, struct fast5_event * event, 
-					  size_t len)
+/* Read the FASTQ string, at most size - 1 characters. Returns the length
+   of the record read. */
+static int fast5_fastq_dset_read(hid_t dataset, char * buf, size_t size)
 {
-	char path[FAST5_OBJ_PATH_MAX];
-	char datasetname[FAST5_OBJ_PATH_MAX];
-	hid_t dataset;  
 	herr_t status;
-	hid_t dataspace_id;
-	hid_t memspace_id;
-	hsize_t dimsm[2];
-	hsize_t count[2];              /* size of subset in the file */
-	hsize_t offset[2];             /* subset offset in the file */
-	hsize_t stride[2];
-	hsize_t block[2];
+	hid_t ftype;
 	hid_t type;
+	char * s;
+
+	ftype = H5Dget_type(dataset);
+	type = H5Tcopy(H5T_C_S1);
+
+	if (H5Tis_variable_str(ftype) > 0) {
+		/* a NULL string is an empty record */
+		if ((status = fast5_vstr_read(dataset, &s)) >= 0) {
+			if (s != NULL) {
+				strncpy(buf, s, size - 1);
+				H5free_memory(s);
+			} else
+				buf[0] = '\0';
+		}
+	} else {
+		/* null terminated, the conversion truncates longer records */
+		H5Tset_size(type, size);
+		status = H5Dread(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+	}
+	buf[size - 1] = '\0';
+
+	H5Tclose(type);
+	H5Tclose(ftype);
+
+	if (status < 0) {
+		DBG(DBG_WARNING, "Can't read FASTQ!");
+		return FAST5_ERR(FAST5_ERR_HDF5);
+	}
+
+	PERF_ADD(bytes_read, strlen(buf));
+
+	return strlen(buf);
+}
+
+int fast5_basecall_info(struct fast5 * f5, unsigned int strand, 
+						struct fast5_basecall * info)
+{
+	char path[FAST5_OBJ_PATH_MAX];
+	char * cp;
+	hid_t dataset;
+	hid_t group;
 	int ret;
 
 	assert(f5 != NULL);
 	assert(f5->file >= 0);
-	assert(event != NULL);
+	assert(info != NULL);
 
-	if ((ret = fast5_events_read_dirname(f5, path)) < 0)
+	memset(info, 0, sizeof(struct fast5_basecall));
+
+	if ((ret = fast5_basecall_dirname(f5, strand, info->group)) < 0)
 		return ret;
 
-	snprintf(datasetname, FAST5_OBJ_PATH_MAX, "%s/Events", path);
+	/* the group path fits, the dataset paths below may not */
+	if ((fast5_path(path, "%s/Fastq", info->group) == 0) &&
+		(dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) >= 0) {
+		fast5_fastq_len(dataset, &info->fastq_len);
+		H5Dclose(dataset);
+	}
 
-	/* Open dataset. */
-	dataset = H5Dopen2(f5->file, datasetname, H5P_DEFAULT);
+	/* Newer basecallers store a signal block move table, older ones a 
+	   "move" field in the basecall events. */
+	if ((fast5_path(path, "%s/Move", info->group) == 0) &&
+		(H5Lexists(f5->file, path, H5P_DEFAULT) > 0)) {
+		fast5_dset_path_length(f5, path, &info->moves_len);
+
+		/* /Analyses/Basecall_X/Summary/basecall_1d_<strand> */
+		cp = strrchr(info->group, '/');
+		if ((fast5_path(path, "%.*s/Summary/basecall_1d_%s", 
+						(int)(cp - info->group), info->group, 
+						fast5_strand_nm[strand]) == 0) &&
+			(H5Lexists(f5->file, path, H5P_DEFAULT) > 0) &&
+			((group = H5Gopen(f5->file, path, H5P_DEFAULT)) >= 0)) {
+			fast5_attr_read(group, "block_stride", H5T_NATIVE_UINT32, 
+							&info->stride);
+			H5Gclose(group);
+		}
+	} else if ((fast5_path(path, "%s/Events", info->group) == 0) &&
+			   (H5Lexists(f5->file, path, H5P_DEFAULT) > 0)) {
+		fast5_dset_path_length(f5, path, &info->moves_len);
+	}
 
-	/* Specify size and shape of subset to read. */
-	offset[0] = 0;
-	count[0]  = len;
-	stride[0] = 1;
-	block[0] = 1;
+	return 0;
+}
 
-	/*
-	 * Create the memory data type.
-	 */
-	type = H5Tcreate(H5T_COMPOUND, sizeof(struct fast5_event));
-	H5Tinsert(type, "start", HOFFSET(struct fast5_event, start), 
-			  H5T_NATIVE_LLONG);
-	H5Tinsert(type, "length", HOFFSET(struct fast5_event, length), 
-			  H5T_NATIVE_LLONG);
-	H5Tinsert(type, "mean", HOFFSET(struct fast5_event, mean), 
-			  H5T_NATIVE_DOUBLE);
-	H5Tinsert(type, "stdv", HOFFSET(struct fast5_event, stdv), 
-			  H5T_NATIVE_DOUBLE);
-	H5Tinsert(type, "variance", HOFFSET(struct fast5_event, variance), 
-			  H5T_NATIVE_DOUBLE);
+int fast5_fastq_read(struct fast5 * f5, unsigned int strand, 
+					 char * buf, size_t size)
+{
+	char dir[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t dataset;
+	int ret;
+	PERF_CALL(FAST5_PERF_FASTQ_READ);
 
-	/* Create memory space with size of subset. Get file dataspace
-	   and select subset from file dataspace. */
-	dimsm[0] = len;
-	memspace_id = H5Screate_simple(1, dimsm, NULL);
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(buf != NULL);
+	assert(size > 0);
 
-	dataspace_id = H5Dget_space(dataset);
-	H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, 
-						offset, stride, count, block);
+	if (((ret = fast5_basecall_dirname(f5, strand, dir)) < 0) ||
+		((ret = fast5_path(path, "%s/Fastq", dir)) < 0))
+		return ret;
 
-	status = H5Dread(dataset, type, 
-					 memspace_id, dataspace_id, 
-					 H5P_DEFAULT, event);
+	if ((dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", path);
+		return FAST5_ERR(FAST5_ERR_NOENT);
+	}
+
+	ret = fast5_fastq_dset_read(dataset, buf, size);
 
-	H5Sclose(memspace_id);
-	H5Sclose(dataspace_id);
-	/* Close the dataset. */
 	H5Dclose(dataset);
 
-	return status;
+	return ret;
 }
 
-int fast5_channel_id(struct fast5 * f5, struct fast5_channel_id * info)
+int fast5_moves_read(struct fast5 * f5, unsigned int strand, 
+					 uint8_t * move, size_t len)
 {
-	hid_t group;
-	hid_t attr;
-	char * s;
+	char dir[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t dataset;  
+	hid_t memspace;
+	hid_t dspace;
+	hid_t type;
+	hsize_t offset[1];
+	hsize_t count[1];
+	herr_t status;
+	int ret;
 
 	assert(f5 != NULL);
 	assert(f5->file >= 0);
-	assert(info != NULL);
+	assert(move != NULL);
 
-	memset(info, 0, sizeof(struct fast5_channel_id));
+	if ((ret = fast5_basecall_dirname(f5, strand, dir)) < 0)
+		return ret;
 
-	if ((group = H5Gopen(f5->file, "/UniqueGlobalKey/channel_id", 
-						 H5P_DEFAULT)) < 0) {
-		DBG(DBG_WARNING, "Can't access group \"/UniqueGlobalKey/channel_id\"!");
-		return group;
-	}
+	if ((ret = fast5_path(path, "%s/Move", dir)) < 0)
+		return ret;
 
-	if ((attr = H5Aopen(group, "channel_number", H5P_DEFAULT)) >= 0) {
-		/* read a variable length string */
-		hid_t type = H5Tcopy(H5T_C_S1);
-		H5Tset_size(type, H5T_VARIABLE);
-		H5Aread(attr, type, &s);
-		strncpy(info->channel_number, s, FAST5_CHAN_NUM_MAX);
-		info->channel_number[FAST5_CHAN_NUM_MAX] = '\0';
-		free(s);
-		H5Aclose(attr);
-		H5Tclose(type);
+	if (H5Lexists(f5->file, path, H5P_DEFAULT) > 0) {
+		type = H5Tcopy(H5T_NATIVE_UINT8);
 	} else {
-		DBG(DBG_WARNING, "Can't read attribute: \"read_id\"!");
+		/* only the "move" field of the events records */
+		if ((ret = fast5_path(path, "%s/Events", dir)) < 0)
+			return ret;
+		type = H5Tcreate(H5T_COMPOUND, sizeof(uint8_t));
+		H5Tinsert(type, "move", 0, H5T_NATIVE_UINT8);
 	}
 
-	if ((attr = H5Aopen(group, "digitisation", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->digitisation);
-		H5Aclose(attr);
+	if ((dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", path);
+		H5Tclose(type);
+		return FAST5_ERR(FAST5_ERR_NOENT);
 	}
 
-	if ((attr = H5Aopen(group, "offset", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->offset);
-		H5Aclose(attr);
-	}
+	offset[0] = 0;
+	count[0] = len;
+	memspace = H5Screate_simple(1, count, NULL);
+	dspace = H5Dget_space(dataset);
+	if ((H5Sselect_hyperslab(dspace, H5S_SELECT_SET, offset, NULL, count, 
+							 NULL) < 0) || (H5Sselect_valid(dspace) <= 0))
+		status = FAST5_ERR(FAST5_ERR_RANGE);
+	else if (H5Dread(dataset, type, memspace, dspace, H5P_DEFAULT, 
+					 move) < 0)
+		status = FAST5_ERR(FAST5_ERR_HDF5);
+	else
+		status = 0;
+
+	H5Sclose(memspace);
+	H5Sclose(dspace);
+	H5Dclose(dataset);
+	H5Tclose(type);
 
-	if ((attr = H5Aopen(group, "range", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->range);
-		H5Aclose(attr);
+	if (status >= 0)
+		PERF_ADD(bytes_read, len);
+
+	return status;
+}
+
+/* -------------------------------------------------------------------------
+ * Multi-read files
+ * ------------------------------------------------------------------------- */ 
+
+int fast5_read_count(struct fast5 * f5)
+{
+	H5G_info_t  ginfo;
+	const struct fast5_analysis * an;
+	char dir[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	if (f5->nreads >= 0)
+		return f5->nreads;
+
+	f5->nreads = 0;
+
+	if (fast5_has(f5, FAST5_GRP_RAW))
+		fast5_path(dir, "/Raw/Reads");
+	else if ((an = fast5_analysis_find(f5, "EventDetection")) != NULL) {
+		if (fast5_path(dir, "/Analyses/%s/Reads", an->name) < 0)
+			return 0;
+	} else
+		return 0;
+
+	if (H5Lexists(f5->file, dir, H5P_DEFAULT) <= 0)
+		return 0;
+
+	if ((group = H5Gopen(f5->file, dir, H5P_DEFAULT)) < 0)
+		return 0;
+
+	if (H5Gget_info(group, &ginfo) >= 0)
+		f5->nreads = ginfo.nlinks;
+
+	H5Gclose(group);
+
+	return f5->nreads;
+}
+
+int fast5_read_select(struct fast5 * f5, unsigned int idx)
+{
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	if (idx >= fast5_read_count(f5))
+		return FAST5_ERR(FAST5_ERR_RANGE);
+
+	f5->read_idx = idx;
+
+	return 0;
+}
+
+int fast5_stats(struct fast5 * f5)
+{
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	return 0;
+}
+
+
+/* -------------------------------------------------------------------------
+ * Read context
+ * ------------------------------------------------------------------------- */ 
+
+#define FAST5_BUF_MIN 4096
+
+struct fast5_buf {
+	void * ptr;
+	size_t size;
+};
+
+struct fast5_reader {
+	const struct fast5_allocator * alloc;
+	struct fast5_buf raw;
+	struct fast5_buf evt;
+	struct fast5_buf seq;
+	/* cached memory type for event records */
+	hid_t event_type;
+};
+
+/* Make sure the buffer can hold at least size bytes. The buffer never
+   shrinks, so once it reaches the size of the largest read no more 
+   allocations are made. */
+static void * fast5_buf_reserve(struct fast5_reader * rd, 
+								struct fast5_buf * buf, size_t size)
+{
+	const struct fast5_allocator * a = rd->alloc;
+	size_t n;
+	void * ptr;
+
+	if (size <= buf->size)
+		return buf->ptr;
+
+	n = (buf->size > 0) ? buf->size : FAST5_BUF_MIN;
+	while (n < size)
+		n *= 2;
+
+	/* contents are not preserved, an arena can reuse the old buffer */
+	if (buf->ptr != NULL) {
+		a->free(a->arg, buf->ptr, buf->size);
+		buf->ptr = NULL;
+		buf->size = 0;
 	}
 
-	if ((attr = H5Aopen(group, "sampling_rate", H5P_DEFAULT)) >= 0) {
-		H5Aread(attr, H5T_NATIVE_DOUBLE, &info->sampling_rate);
-		H5Aclose(attr);
+	if ((ptr = a->alloc(a->arg, n)) == NULL) {
+		DBG(DBG_WARNING, "buffer allocation (%zu) failed!", n);
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
 	}
+	PERF_INC(alloc);
+	PERF_ADD(alloc_bytes, n);
 
-	H5Gclose(group);
+	buf->ptr = ptr;
+	buf->size = n;
+
+	return ptr;
+}
+
+struct fast5_reader * fast5_reader_new(void)
+{
+	return fast5_reader_new_alloc(NULL);
+}
+
+struct fast5_reader * fast5_reader_new_alloc(const struct fast5_allocator * 
+											 alloc)
+{
+	struct fast5_reader * rd;
+
+	if ((rd = (struct fast5_reader *)malloc(sizeof(struct fast5_reader))) 
+		== NULL)
+		return NULL;
+	PERF_INC(alloc);
+	PERF_ADD(alloc_bytes, sizeof(struct fast5_reader));
+
+	rd->alloc = (alloc != NULL) ? alloc : &fast5_heap_allocator;
+	rd->raw.ptr = NULL;
+	rd->raw.size = 0;
+	rd->evt.ptr = NULL;
+	rd->evt.size = 0;
+	rd->seq.ptr = NULL;
+	rd->seq.size = 0;
+	rd->event_type = fast5_event_type_create();
+
+	return rd;
+}
+
+int fast5_reader_free(struct fast5_reader * rd)
+{
+	assert(rd != NULL);
+
+	if (rd->raw.ptr != NULL)
+		rd->alloc->free(rd->alloc->arg, rd->raw.ptr, rd->raw.size);
+	if (rd->evt.ptr != NULL)
+		rd->alloc->free(rd->alloc->arg, rd->evt.ptr, rd->evt.size);
+	if (rd->seq.ptr != NULL)
+		rd->alloc->free(rd->alloc->arg, rd->seq.ptr, rd->seq.size);
+	H5Tclose(rd->event_type);
+
+	free(rd);
 
 	return 0;
 }
 
+int16_t * fast5_reader_raw(struct fast5_reader * rd, struct fast5 * f5,
+						   size_t len)
+{
+	int16_t * raw;
+
+	assert(rd != NULL);
 
-int fast5_stats(struct fast5 * f5)
+	if ((raw = fast5_buf_reserve(rd, &rd->raw, 
+								 len * sizeof(int16_t))) == NULL)
+		return NULL;
+
+	if (fast5_raw_read(f5, raw, len) < 0)
+		return NULL;
+
+	return raw;
+}
+
+struct fast5_event * fast5_reader_events(struct fast5_reader * rd, 
+										 struct fast5 * f5, size_t len)
+{
+	struct fast5_event * event;
+
+	assert(rd != NULL);
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+
+	if ((event = fast5_buf_reserve(rd, &rd->evt, 
+								   len * sizeof(struct fast5_event))) == NULL)
+		return NULL;
+
+	/* fields missing in the file's compound type (e.g. "variance") are 
+	   not touched by H5Dread(), clear them instead of leaking the 
+	   previous read's values. */
+	memset(event, 0, len * sizeof(struct fast5_event));
+
+	PERF_CALL(FAST5_PERF_EVENTS_READ);
+
+	if (__fast5_events_read(f5, rd->event_type, event, 0, len) < 0)
+		return NULL;
+
+	return event;
+}
+
+char * fast5_reader_fastq(struct fast5_reader * rd, struct fast5 * f5,
+						  unsigned int strand, size_t * len)
 {
+	char dir[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t dataset;
+	hid_t ftype;
+	size_t size;
+	char * buf;
+	char * s;
+	int ret;
+	PERF_CALL(FAST5_PERF_FASTQ_READ);
+
+	assert(rd != NULL);
 	assert(f5 != NULL);
 	assert(f5->file >= 0);
 
+	if ((fast5_basecall_dirname(f5, strand, dir) < 0) ||
+		(fast5_path(path, "%s/Fastq", dir) < 0))
+		return NULL;
+
+	if ((dataset = H5Dopen2(f5->file, path, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't open dataset \"%s\"!", path);
+		FAST5_ERR(FAST5_ERR_NOENT);
+		return NULL;
+	}
+
+	ftype = H5Dget_type(dataset);
+
+	if (H5Tis_variable_str(ftype) > 0) {
+		/* the string is read once, into the buffer sized after it */
+		if (fast5_vstr_read(dataset, &s) < 0) {
+			DBG(DBG_WARNING, "Can't read FASTQ!");
+			ret = FAST5_ERR(FAST5_ERR_HDF5);
+		} else {
+			ret = (s != NULL) ? strlen(s) : 0;
+			if ((buf = fast5_buf_reserve(rd, &rd->seq, ret + 1)) == NULL)
+				ret = -1;
+			else {
+				memcpy(buf, (s != NULL) ? s : "", ret + 1);
+				PERF_ADD(bytes_read, ret);
+			}
+			if (s != NULL)
+				H5free_memory(s);
+		}
+	} else {
+		size = H5Tget_size(ftype) + 1;
+		if ((buf = fast5_buf_reserve(rd, &rd->seq, size)) == NULL)
+			ret = -1;
+		else
+			ret = fast5_fastq_dset_read(dataset, buf, size);
+	}
+
+	H5Tclose(ftype);
+	H5Dclose(dataset);
+
+	if (ret < 0)
+		return NULL;
+
+	if (len != NULL)
+		*len = ret;
+
+	return buf;
+}
+
+/* -------------------------------------------------------------------------
+ * Performance counters
+ * ------------------------------------------------------------------------- */ 
+
+#ifdef FAST5_PERF
+struct fast5_perf __fast5_perf;
+#endif
+
+static const char * const fast5_perf_call_nm[FAST5_PERF_CALL_MAX] = {
+	[FAST5_PERF_OPEN] = "fast5_open",
+	[FAST5_PERF_CLOSE] = "fast5_close",
+	[FAST5_PERF_RAW_INFO] = "fast5_raw_read_info",
+	[FAST5_PERF_RAW_READ] = "fast5_raw_read",
+	[FAST5_PERF_EVENTS_INFO] = "fast5_events_info",
+	[FAST5_PERF_EVENTS_READ] = "fast5_events_read",
+	[FAST5_PERF_CHANNEL_ID] = "fast5_channel_id",
+	[FAST5_PERF_FASTQ_READ] = "fast5_fastq_read"
+};
+
+const char * fast5_perf_call_name(unsigned int call)
+{
+	if (call >= FAST5_PERF_CALL_MAX)
+		return NULL;
+
+	return fast5_perf_call_nm[call];
+}
+
+int fast5_perf_counters(struct fast5_perf * perf)
+{
+	assert(perf != NULL);
+
+#ifdef FAST5_PERF
+	{
+		uint64_t * dst = (uint64_t *)perf;
+		uint64_t * src = (uint64_t *)&__fast5_perf;
+		unsigned int i;
+
+		for (i = 0; i < sizeof(struct fast5_perf) / sizeof(uint64_t); ++i)
+			dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	}
+
 	return 0;
+#else
+	memset(perf, 0, sizeof(struct fast5_perf));
+
+	return -1;
+#endif
 }
 
+void fast5_perf_reset(void)
+{
+#ifdef FAST5_PERF
+	uint64_t * cnt = (uint64_t *)&__fast5_perf;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(struct fast5_perf) / sizeof(uint64_t); ++i)
+		__atomic_store_n(&cnt[i], 0, __ATOMIC_RELAXED);
+#endif
+}
@@ -0,0 +1,241 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_alloc.c
+ * \brief     Buffer allocators
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#define _GNU_SOURCE
+#define __FAST5_I__
+
+#include "fast5-i.h"
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ALLOC_ALIGN 64
+#define ARENA_CHUNK_DEFAULT (64 << 20)
+#define ARENA_HUGEPAGE_SIZE (2 << 20)
+
+/* -------------------------------------------------------------------------
+ * Heap
+ * ------------------------------------------------------------------------- */
+
+static void * heap_alloc(void * arg, size_t size)
+{
+	void * ptr;
+
+	if (posix_memalign(&ptr, ALLOC_ALIGN, size) != 0)
+		return NULL;
+
+	return ptr;
+}
+
+static void heap_free(void * arg, void * ptr, size_t size)
+{
+	free(ptr);
+}
+
+const struct fast5_allocator fast5_heap_allocator = {
+	.alloc = heap_alloc,
+	.free = heap_free,
+	.arg = NULL
+};
+
+/* -------------------------------------------------------------------------
+ * Arena
+ * ------------------------------------------------------------------------- */
+
+/* Header at the start of each mapping */
+struct arena_map {
+	struct arena_map * next;
+	size_t size;
+};
+
+#define ARENA_MAP_HDR ((sizeof(struct arena_map) + ALLOC_ALIGN - 1) & \
+					   ~(size_t)(ALLOC_ALIGN - 1))
+
+struct fast5_arena {
+	struct fast5_allocator alloc;
+	unsigned int flags;
+	size_t chunk;
+	size_t page;
+	/* current mapping first, then the full ones */
+	struct arena_map * map;
+	/* offsets of the free space and of the last buffer in the current
+	   mapping */
+	size_t used;
+	size_t last;
+	size_t mapped;
+};
+
+static inline size_t arena_round(size_t n, size_t align)
+{
+	return (n + align - 1) & ~(align - 1);
+}
+
+static struct arena_map * arena_map_new(struct fast5_arena * ar, size_t size)
+{
+	struct arena_map * map;
+	size_t len = size;
+	uint8_t * base;
+	uint8_t * p;
+	size_t head;
+
+	/* over-allocate to trim the mapping to a huge page boundary */
+	if (ar->flags & FAST5_ARENA_HUGEPAGE)
+		len += ARENA_HUGEPAGE_SIZE;
+
+	base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		DBG(DBG_WARNING, "mmap(%zu): %s", len, strerror(errno));
+		return NULL;
+	}
+
+	p = base;
+	if (ar->flags & FAST5_ARENA_HUGEPAGE) {
+		head = arena_round((uintptr_t)base, ARENA_HUGEPAGE_SIZE) -
+			(uintptr_t)base;
+		if (head > 0)
+			munmap(base, head);
+		if (len - head > size)
+			munmap(base + head + size, len - head - size);
+		p = base + head;
+#ifdef MADV_HUGEPAGE
+		/* advisory, the mapping is usable either way */
+		if (madvise(p, size, MADV_HUGEPAGE) < 0)
+			DBG(DBG_INFO, "madvise(MADV_HUGEPAGE): %s", strerror(errno));
+#endif
+	}
+
+	/* fault the pages in from this thread */
+	if (ar->flags & FAST5_ARENA_FIRST_TOUCH) {
+		size_t step = sysconf(_SC_PAGESIZE);
+		size_t off;
+
+		/* every small page, huge pages may not be granted */
+		for (off = 0; off < size; off += step)
+			((volatile uint8_t *)p)[off] = 0;
+	}
+
+	map = (struct arena_map *)p;
+	map->size = size;
+	map->next = ar->map;
+	ar->map = map;
+	ar->used = ARENA_MAP_HDR;
+	ar->last = ARENA_MAP_HDR;
+	ar->mapped += size;
+
+	return map;
+}
+
+static void * arena_alloc(void * arg, size_t size)
+{
+	struct fast5_arena * ar = (struct fast5_arena *)arg;
+	size_t len;
+	void * ptr;
+
+	size = arena_round(size, ALLOC_ALIGN);
+
+	if ((ar->map == NULL) || (ar->used + size > ar->map->size)) {
+		len = arena_round(ARENA_MAP_HDR + size, ar->page);
+		if (len < ar->chunk)
+			len = ar->chunk;
+		if (arena_map_new(ar, len) == NULL)
+			return NULL;
+	}
+
+	ptr = (uint8_t *)ar->map + ar->used;
+	ar->last = ar->used;
+	ar->used += size;
+
+	return ptr;
+}
+
+static void arena_free(void * arg, void * ptr, size_t size)
+{
+	struct fast5_arena * ar = (struct fast5_arena *)arg;
+
+	/* only the last buffer can be reused */
+	if ((ar->map != NULL) && (ptr == (uint8_t *)ar->map + ar->last))
+		ar->used = ar->last;
+}
+
+struct fast5_arena * fast5_arena_new(size_t chunk, unsigned int flags)
+{
+	struct fast5_arena * ar;
+	size_t page;
+
+	if ((ar = calloc(1, sizeof(struct fast5_arena))) == NULL) {
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	page = sysconf(_SC_PAGESIZE);
+	if (chunk == 0)
+		chunk = ARENA_CHUNK_DEFAULT;
+
+	ar->alloc.alloc = arena_alloc;
+	ar->alloc.free = arena_free;
+	ar->alloc.arg = ar;
+	ar->flags = flags;
+	/* mappings are a whole number of pages, or huge pages */
+	ar->page = (flags & FAST5_ARENA_HUGEPAGE) ? ARENA_HUGEPAGE_SIZE : page;
+	ar->chunk = arena_round(chunk, ar->page);
+
+	return ar;
+}
+
+const struct fast5_allocator * fast5_arena_allocator(struct fast5_arena * ar)
+{
+	assert(ar != NULL);
+
+	return &ar->alloc;
+}
+
+size_t fast5_arena_size(struct fast5_arena * ar)
+{
+	assert(ar != NULL);
+
+	return ar->mapped;
+}
+
+int fast5_arena_free(struct fast5_arena * ar)
+{
+	struct arena_map * map;
+
+	assert(ar != NULL);
+
+	while ((map = ar->map) != NULL) {
+		ar->map = map->next;
+		munmap(map, map->size);
+	}
+
+	free(ar);
+
+	return 0;
+}
@@ -0,0 +1,481 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_dir.c
+ * \brief     FAST5 recursive directory walker
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#define _GNU_SOURCE
+#define __FAST5_I__
+
+#include "fast5-i.h"
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/* getdents64() buffer, a few hundred entries per system call */
+#define DIR_BUF_SIZE (64 * 1024)
+#define DIR_QUEUE_DEFAULT 16
+#define DIR_EXT_MAX 31
+/* directories open at the same time */
+#define DIR_DEPTH_MAX 64
+
+struct linux_dirent64 {
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct dir_name {
+	char * name;
+	unsigned char type;
+};
+
+struct dir_ent {
+	/* NULL if the file is to be opened by the consumer */
+	struct fast5 * f5;
+	char * path;
+};
+
+struct fast5_dir_iter {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	/* serializes the opens of the consumers, see dir_walk() */
+	pthread_mutex_t open_mutex;
+	pthread_cond_t not_full;
+	pthread_cond_t not_empty;
+	/* circular queue of opened files */
+	struct dir_ent * queue;
+	unsigned int size;
+	unsigned int head;
+	unsigned int cnt;
+	/* the walk is over */
+	bool done;
+	/* the consumers are gone */
+	bool stop;
+	unsigned long skipped;
+	unsigned int flags;
+	/* matching files seen, for the partition */
+	unsigned long nfiles;
+	unsigned int part;
+	unsigned int nparts;
+	int root;
+	char ext[DIR_EXT_MAX + 1];
+	size_t ext_len;
+	char path[PATH_MAX];
+	char buf[DIR_BUF_SIZE];
+};
+
+static int dir_name_cmp(const void * a, const void * b)
+{
+	return strcmp(((const struct dir_name *)a)->name,
+				  ((const struct dir_name *)b)->name);
+}
+
+/* Read all the entries of a directory, sorted by name */
+static struct dir_name * dir_list(struct fast5_dir_iter * it, int dfd,
+								  int * count)
+{
+	struct linux_dirent64 * d;
+	struct dir_name * lst = NULL;
+	struct dir_name * tmp;
+	int size = 0;
+	int cnt = 0;
+	long n;
+	long pos;
+
+	while ((n = syscall(SYS_getdents64, dfd, it->buf, DIR_BUF_SIZE)) > 0) {
+		for (pos = 0; pos < n; pos += d->d_reclen) {
+			d = (struct linux_dirent64 *)(it->buf + pos);
+
+			if ((strcmp(d->d_name, ".") == 0) ||
+				(strcmp(d->d_name, "..") == 0))
+				continue;
+
+			if (cnt == size) {
+				size = size ? 2 * size : 256;
+				if ((tmp = realloc(lst, size *
+								   sizeof(struct dir_name))) == NULL)
+					goto error;
+				lst = tmp;
+			}
+
+			if ((lst[cnt].name = strdup(d->d_name)) == NULL)
+				goto error;
+			lst[cnt].type = d->d_type;
+			cnt++;
+		}
+	}
+
+	if (n < 0) {
+		DBG(DBG_WARNING, "getdents64(): %s", strerror(errno));
+		goto error;
+	}
+
+	if (cnt > 1)
+		qsort(lst, cnt, sizeof(struct dir_name), dir_name_cmp);
+
+	*count = cnt;
+	return lst;
+
+error:
+	while (cnt > 0)
+		free(lst[--cnt].name);
+	free(lst);
+	*count = 0;
+	return NULL;
+}
+
+/* Queue a file, blocks while the queue is full. The file is released if
+   the consumers are gone. */
+static int dir_push(struct fast5_dir_iter * it, struct fast5 * f5,
+					const char * path)
+{
+	struct dir_ent * ent;
+	char * cp;
+
+	if ((cp = strdup(path)) == NULL) {
+		if (f5 != NULL)
+			fast5_close(f5);
+		return FAST5_ERR(FAST5_ERR_NOMEM);
+	}
+
+	pthread_mutex_lock(&it->mutex);
+
+	while ((it->cnt == it->size) && !it->stop)
+		pthread_cond_wait(&it->not_full, &it->mutex);
+
+	if (it->stop) {
+		pthread_mutex_unlock(&it->mutex);
+		if (f5 != NULL)
+			fast5_close(f5);
+		free(cp);
+		return -1;
+	}
+
+	ent = &it->queue[(it->head + it->cnt) % it->size];
+	ent->f5 = f5;
+	ent->path = cp;
+	it->cnt++;
+
+	pthread_cond_signal(&it->not_empty);
+	pthread_mutex_unlock(&it->mutex);
+
+	return 0;
+}
+
+static void dir_skip(struct fast5_dir_iter * it)
+{
+	pthread_mutex_lock(&it->mutex);
+	it->skipped++;
+	pthread_mutex_unlock(&it->mutex);
+}
+
+/* Walk a directory, it->path holds its path, len bytes long */
+static int dir_walk(struct fast5_dir_iter * it, int dfd, size_t len,
+					int depth)
+{
+	struct dir_name * lst;
+	struct fast5 * f5;
+	struct stat st;
+	size_t n;
+	int ret = 0;
+	int cnt;
+	int fd;
+	int i;
+
+	/* empty or unreadable */
+	if ((lst = dir_list(it, dfd, &cnt)) == NULL)
+		return 0;
+
+	for (i = 0; (i < cnt) && (ret == 0); ++i) {
+		unsigned char type = lst[i].type;
+
+		n = strlen(lst[i].name);
+		if (len + 1 + n >= PATH_MAX) {
+			DBG(DBG_WARNING, "%s/%s: path too long!", it->path, lst[i].name);
+			continue;
+		}
+		it->path[len] = '/';
+		memcpy(&it->path[len + 1], lst[i].name, n + 1);
+
+		/* symbolic links to files are followed, to directories are not */
+		if ((type == DT_UNKNOWN) || (type == DT_LNK)) {
+			if (fstatat(dfd, lst[i].name, &st, (type == DT_LNK) ? 0 :
+						AT_SYMLINK_NOFOLLOW) < 0)
+				continue;
+			if (S_ISREG(st.st_mode))
+				type = DT_REG;
+			else if (S_ISDIR(st.st_mode) && (type == DT_UNKNOWN))
+				type = DT_DIR;
+		}
+
+		if (type == DT_DIR) {
+			if (depth == DIR_DEPTH_MAX) {
+				DBG(DBG_WARNING, "%s: too deep!", it->path);
+				continue;
+			}
+			if ((fd = openat(dfd, lst[i].name,
+							 O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+				continue;
+			ret = dir_walk(it, fd, len + 1 + n, depth + 1);
+			close(fd);
+			continue;
+		}
+
+		if (type != DT_REG)
+			continue;
+
+		if ((n < it->ext_len) ||
+			(strcmp(&lst[i].name[n - it->ext_len], it->ext) != 0))
+			continue;
+
+		/* the walk order is the same for every part */
+		if ((it->nparts > 1) && ((it->nfiles++ % it->nparts) != it->part))
+			continue;
+
+#ifdef H5_HAVE_THREADSAFE
+		/* Open the file here, this and the consumer threads can call a 
+		   thread safe HDF5 (see "Threads" in fast5.h). Junk files are 
+		   rejected by the signature check of fast5_open_flags(). */
+		if ((f5 = fast5_open_flags(it->path, it->flags)) == NULL) {
+			dir_skip(it);
+			continue;
+		}
+#else
+		/* Only one thread at a time can call the HDF5 library, the 
+		   consumers open, one at a time */
+		if (fast5_sniff(it->path) < 0) {
+			dir_skip(it);
+			continue;
+		}
+		f5 = NULL;
+#endif
+
+		ret = dir_push(it, f5, it->path);
+	}
+
+	for (i = 0; i < cnt; ++i)
+		free(lst[i].name);
+	free(lst);
+
+	return ret;
+}
+
+static void * dir_thread(void * arg)
+{
+	struct fast5_dir_iter * it = (struct fast5_dir_iter *)arg;
+
+	dir_walk(it, it->root, strlen(it->path), 0);
+	close(it->root);
+
+	pthread_mutex_lock(&it->mutex);
+	it->done = true;
+	pthread_cond_broadcast(&it->not_empty);
+	pthread_mutex_unlock(&it->mutex);
+
+	return NULL;
+}
+
+struct fast5_dir_iter * fast5_dir_iter_new(const char * path,
+										   const struct fast5_dir_opt * opt)
+{
+	struct fast5_dir_iter * it;
+	const char * ext = ".fast5";
+	unsigned int size = DIR_QUEUE_DEFAULT;
+	size_t len;
+
+	assert(path != NULL);
+
+	if (opt != NULL) {
+		if (opt->ext != NULL)
+			ext = opt->ext;
+		if (opt->queue > 0)
+			size = opt->queue;
+	}
+
+	len = strlen(path);
+	/* the walk appends to the path, without a trailing slash */
+	while ((len > 1) && (path[len - 1] == '/'))
+		len--;
+
+	if ((strlen(ext) > DIR_EXT_MAX) || (len >= PATH_MAX)) {
+		FAST5_ERR(FAST5_ERR_NAME);
+		return NULL;
+	}
+
+	if ((it = calloc(1, sizeof(struct fast5_dir_iter))) == NULL) {
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	if ((it->queue = calloc(size, sizeof(struct dir_ent))) == NULL) {
+		free(it);
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	if ((it->root = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		DBG(DBG_WARNING, "%s: %s", path, strerror(errno));
+		free(it->queue);
+		free(it);
+		FAST5_ERR(FAST5_ERR_IO);
+		return NULL;
+	}
+
+	it->size = size;
+	if (opt != NULL) {
+		it->flags = opt->flags;
+		it->part = opt->part;
+		it->nparts = opt->nparts;
+	}
+	it->ext_len = strlen(ext);
+	memcpy(it->ext, ext, it->ext_len + 1);
+	memcpy(it->path, path, len);
+	it->path[len] = '\0';
+	/* a root "/" must not become "//name" */
+	if ((len == 1) && (path[0] == '/'))
+		it->path[0] = '\0';
+
+	pthread_mutex_init(&it->mutex, NULL);
+	pthread_mutex_init(&it->open_mutex, NULL);
+	pthread_cond_init(&it->not_full, NULL);
+	pthread_cond_init(&it->not_empty, NULL);
+
+	if (pthread_create(&it->thread, NULL, dir_thread, it) != 0) {
+		pthread_mutex_destroy(&it->mutex);
+		pthread_mutex_destroy(&it->open_mutex);
+		pthread_cond_destroy(&it->not_full);
+		pthread_cond_destroy(&it->not_empty);
+		close(it->root);
+		free(it->queue);
+		free(it);
+		FAST5_ERR(FAST5_ERR_NOMEM);
+		return NULL;
+	}
+
+	return it;
+}
+
+struct fast5 * fast5_dir_iter_next(struct fast5_dir_iter * it,
+								   char * path, size_t size)
+{
+	struct dir_ent ent;
+
+	assert(it != NULL);
+
+	for (;;) {
+		pthread_mutex_lock(&it->mutex);
+
+		while ((it->cnt == 0) && !it->done)
+			pthread_cond_wait(&it->not_empty, &it->mutex);
+
+		if (it->cnt == 0) {
+			pthread_mutex_unlock(&it->mutex);
+			return NULL;
+		}
+
+		ent = it->queue[it->head];
+		it->head = (it->head + 1) % it->size;
+		it->cnt--;
+
+		pthread_cond_signal(&it->not_full);
+		pthread_mutex_unlock(&it->mutex);
+
+		if (ent.f5 == NULL) {
+			pthread_mutex_lock(&it->open_mutex);
+			ent.f5 = fast5_open_flags(ent.path, it->flags);
+			pthread_mutex_unlock(&it->open_mutex);
+			if (ent.f5 == NULL) {
+				dir_skip(it);
+				free(ent.path);
+				continue;
+			}
+		}
+
+		if ((path != NULL) && (size > 0)) {
+			strncpy(path, ent.path, size - 1);
+			path[size - 1] = '\0';
+		}
+		free(ent.path);
+
+		return ent.f5;
+	}
+}
+
+unsigned long fast5_dir_iter_skipped(struct fast5_dir_iter * it)
+{
+	unsigned long cnt;
+
+	assert(it != NULL);
+
+	pthread_mutex_lock(&it->mutex);
+	cnt = it->skipped;
+	pthread_mutex_unlock(&it->mutex);
+
+	return cnt;
+}
+
+int fast5_dir_iter_free(struct fast5_dir_iter * it)
+{
+	struct dir_ent * ent;
+
+	assert(it != NULL);
+
+	/* stop the walk, if still running */
+	pthread_mutex_lock(&it->mutex);
+	it->stop = true;
+	pthread_cond_broadcast(&it->not_full);
+	pthread_mutex_unlock(&it->mutex);
+
+	pthread_join(it->thread, NULL);
+
+	while (it->cnt > 0) {
+		ent = &it->queue[it->head];
+		if (ent->f5 != NULL)
+			fast5_close(ent->f5);
+		free(ent->path);
+		it->head = (it->head + 1) % it->size;
+		it->cnt--;
+	}
+
+	pthread_mutex_destroy(&it->mutex);
+	pthread_mutex_destroy(&it->open_mutex);
+	pthread_cond_destroy(&it->not_full);
+	pthread_cond_destroy(&it->not_empty);
+	free(it->queue);
+	free(it);
+
+	return 0;
+}
+
@@ -0,0 +1,1022 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_filter.c
+ * \brief     Raw signal streaming filters
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "debug.h"
+#include "fast5_filter.h"
+
+#define FILTER_STAGE_MAX 16
+#define FILTER_SPEC_MAX 255
+
+#define MEDIAN_WIN_MAX 255
+#define FIR_TAPS_MAX 255
+#define MAD_WIN_MAX (1 << 20)
+
+/* Resampler limits: interpolation factor, taps per phase and banks 
+   kept per stage */
+#define RESAMPLE_L_MAX 512
+#define RESAMPLE_M_MAX 32768
+#define RESAMPLE_TAPS_MAX 64
+#define RESAMPLE_BANK_MAX 4
+/* accumulators of the dot product, the taps per phase are a multiple */
+#define RESAMPLE_LANES 8
+
+/* Polyphase filter bank for a L/M rate ratio */
+struct resample_bank {
+	unsigned int l;
+	unsigned int m;
+	unsigned int taps;
+	/* l phases of taps coefficients, reversed */
+	float * tap;
+};
+
+struct filter_stage;
+
+/* run() returns the number of samples written back to x, the stages
+   that change the sampling rate also have rate() and len(). */
+struct filter_op {
+	const char * name;
+	int (* init)(struct filter_stage * st, int argc, double * argv);
+	void (* reset)(struct filter_stage * st);
+	int (* run)(struct filter_stage * st, float * x, size_t len);
+	void (* release)(struct filter_stage * st);
+	/* set the input rate, returns the output rate */
+	double (* rate)(struct filter_stage * st, double rate);
+	/* maximum output samples for len input samples */
+	size_t (* len)(struct filter_stage * st, size_t len);
+};
+
+struct filter_stage {
+	const struct filter_op * op;
+	bool primed;
+	union {
+		struct {
+			unsigned int w;
+			unsigned int pos;
+			/* last w samples, in arrival order and sorted */
+			float hist[MEDIAN_WIN_MAX];
+			float sort[MEDIAN_WIN_MAX];
+		} median;
+		struct {
+			float a;
+			float y;
+		} iir;
+		struct {
+			unsigned int n;
+			/* reversed taps */
+			float * tap;
+			/* n - 1 samples of history followed by the chunk */
+			float * buf;
+			size_t size;
+		} fir;
+		struct {
+			float k;
+			unsigned int w;
+			/* samples in the window */
+			unsigned int cnt;
+			/* window size for the next estimate */
+			unsigned int next;
+			float lo;
+			float hi;
+			float * win;
+			float * tmp;
+		} mad;
+		struct {
+			/* output rate */
+			double rate;
+			/* taps per phase, at least */
+			unsigned int taps;
+			/* bank in use, NULL to pass the samples through */
+			struct resample_bank * bank;
+			struct resample_bank cache[RESAMPLE_BANK_MAX];
+			unsigned int next;
+			/* input sample and phase of the next output sample */
+			size_t pos;
+			unsigned int phase;
+			/* taps - 1 samples of history followed by the chunk */
+			float * buf;
+			size_t size;
+		} resample;
+	};
+};
+
+struct fast5_filter {
+	unsigned int cnt;
+	struct filter_stage stage[FILTER_STAGE_MAX];
+	/* working copy of the chunk */
+	float * x;
+	size_t size;
+};
+
+/* Integer parameter in [min, max]. The double is checked before the 
+   conversion, which is undefined out of the range of the type. */
+static int filter_arg_uint(double v, unsigned int min, unsigned int max, 
+						   unsigned int * val)
+{
+	/* negated, NaN fails the compares */
+	if (!((v >= min) && (v <= max)) || (v != floor(v))) {
+		DBG(DBG_WARNING, "invalid parameter: %g", v);
+		return -1;
+	}
+
+	*val = v;
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Running median
+ * ------------------------------------------------------------------------- */
+
+static int median_init(struct filter_stage * st, int argc, double * argv)
+{
+	if (filter_arg_uint((argc > 0) ? argv[0] : 5, 1, MEDIAN_WIN_MAX, 
+						&st->median.w) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void median_reset(struct filter_stage * st)
+{
+	st->median.pos = 0;
+}
+
+/* position of v in the sorted window, the first element not less than v */
+static inline unsigned int median_find(const float * a, unsigned int n,
+									   float v)
+{
+	unsigned int lo = 0;
+	unsigned int hi = n;
+	unsigned int mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (a[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int median_run(struct filter_stage * st, float * x, size_t len)
+{
+	float * hist = st->median.hist;
+	float * sort = st->median.sort;
+	unsigned int w = st->median.w;
+	unsigned int pos = st->median.pos;
+	unsigned int i;
+	unsigned int j;
+	size_t n;
+
+	if (!st->primed && (len > 0)) {
+		/* start with a window full of the first sample */
+		for (i = 0; i < w; ++i) {
+			hist[i] = x[0];
+			sort[i] = x[0];
+		}
+		st->primed = true;
+	}
+
+	for (n = 0; n < len; ++n) {
+		/* drop the oldest sample and insert the new one, shifting the
+		   elements in between */
+		i = median_find(sort, w, hist[pos]);
+		j = median_find(sort, w, x[n]);
+		if (j > i) {
+			memmove(&sort[i], &sort[i + 1], (j - i - 1) * sizeof(float));
+			sort[j - 1] = x[n];
+		} else {
+			memmove(&sort[j + 1], &sort[j], (i - j) * sizeof(float));
+			sort[j] = x[n];
+		}
+
+		hist[pos] = x[n];
+		if (++pos == w)
+			pos = 0;
+
+		x[n] = sort[w / 2];
+	}
+
+	st->median.pos = pos;
+
+	return len;
+}
+
+/* -------------------------------------------------------------------------
+ * One pole IIR low-pass
+ * ------------------------------------------------------------------------- */
+
+static int iir_init(struct filter_stage * st, int argc, double * argv)
+{
+	double a = (argc > 0) ? argv[0] : 0.25;
+
+	if (!((a > 0) && (a <= 1)))
+		return -1;
+
+	st->iir.a = a;
+
+	return 0;
+}
+
+static void iir_reset(struct filter_stage * st)
+{
+	st->iir.y = 0;
+}
+
+static int iir_run(struct filter_stage * st, float * x, size_t len)
+{
+	float a = st->iir.a;
+	float y = st->iir.y;
+	size_t n;
+
+	if (!st->primed && (len > 0)) {
+		y = x[0];
+		st->primed = true;
+	}
+
+	/* recursive, this one does not vectorize */
+	for (n = 0; n < len; ++n) {
+		y += a * (x[n] - y);
+		x[n] = y;
+	}
+
+	st->iir.y = y;
+
+	return len;
+}
+
+/* -------------------------------------------------------------------------
+ * Windowed sinc FIR low-pass
+ * ------------------------------------------------------------------------- */
+
+static int fir_init(struct filter_stage * st, int argc, double * argv)
+{
+	double fc = (argc > 1) ? argv[1] : 0.1;
+	double sum = 0;
+	double m;
+	double h;
+	unsigned int n;
+	unsigned int i;
+
+	if ((filter_arg_uint((argc > 0) ? argv[0] : 31, 1, FIR_TAPS_MAX, 
+						 &n) < 0) || !((fc > 0) && (fc < 0.5)))
+		return -1;
+
+	if ((st->fir.tap = malloc(n * sizeof(float))) == NULL)
+		return -1;
+
+	st->fir.n = n;
+	st->fir.buf = NULL;
+	st->fir.size = 0;
+
+	/* Hamming windowed sinc, normalized for unity gain at DC */
+	m = (n - 1) / 2.0;
+	for (i = 0; i < n; ++i) {
+		double t = i - m;
+
+		h = (t == 0) ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t);
+		if (n > 1)
+			h *= 0.54 - 0.46 * cos(2 * M_PI * i / (n - 1));
+		st->fir.tap[n - 1 - i] = h;
+		sum += h;
+	}
+
+	for (i = 0; i < n; ++i)
+		st->fir.tap[i] /= sum;
+
+	return 0;
+}
+
+static void fir_release(struct filter_stage * st)
+{
+	free(st->fir.tap);
+	if (st->fir.buf != NULL)
+		free(st->fir.buf);
+}
+
+static void fir_reset(struct filter_stage * st)
+{
+}
+
+static int fir_run(struct filter_stage * st, float * x, size_t len)
+{
+	unsigned int h = st->fir.n - 1;
+	const float * tap = st->fir.tap;
+	float * buf;
+	unsigned int k;
+	size_t n;
+
+	if (len == 0)
+		return 0;
+
+	if (h + len > st->fir.size) {
+		size_t size = h + len;
+
+		if ((buf = realloc(st->fir.buf, size * sizeof(float))) == NULL)
+			return -1;
+		st->fir.buf = buf;
+		st->fir.size = size;
+	}
+
+	buf = st->fir.buf;
+
+	if (!st->primed) {
+		for (k = 0; k < h; ++k)
+			buf[k] = x[0];
+		st->primed = true;
+	}
+
+	memcpy(&buf[h], x, len * sizeof(float));
+
+	/* One tap at a time over the whole chunk. Unlike a dot product per
+	   output sample, the inner loop has no reduction and is vectorized
+	   without relaxing the floating point rules. The -O2 cost model 
+	   doesn't version the loop for the x/buf aliasing, the pragma 
+	   (-fopenmp-simd) says there is none. */
+	for (n = 0; n < len; ++n)
+		x[n] = 0;
+
+	for (k = 0; k <= h; ++k) {
+		const float c = tap[k];
+		const float * src = &buf[k];
+
+#pragma omp simd
+		for (n = 0; n < len; ++n)
+			x[n] += c * src[n];
+	}
+
+	/* keep the last n - 1 input samples for the next chunk */
+	memmove(buf, &buf[len], h * sizeof(float));
+
+	return len;
+}
+
+/* -------------------------------------------------------------------------
+ * MAD clipping
+ * ------------------------------------------------------------------------- */
+
+static int mad_init(struct filter_stage * st, int argc, double * argv)
+{
+	double k = (argc > 0) ? argv[0] : 4;
+
+	if (!((k > 0) && (k <= FLT_MAX)) || 
+		(filter_arg_uint((argc > 1) ? argv[1] : 4096, 1, MAD_WIN_MAX, 
+						 &st->mad.w) < 0))
+		return -1;
+
+	st->mad.k = k;
+
+	st->mad.win = malloc(st->mad.w * sizeof(float));
+	st->mad.tmp = malloc(st->mad.w * sizeof(float));
+	if ((st->mad.win == NULL) || (st->mad.tmp == NULL)) {
+		free(st->mad.win);
+		free(st->mad.tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void mad_release(struct filter_stage * st)
+{
+	free(st->mad.win);
+	free(st->mad.tmp);
+}
+
+#define MAD_WIN_FIRST 64
+
+static void mad_reset(struct filter_stage * st)
+{
+	st->mad.cnt = 0;
+	st->mad.next = (st->mad.w < MAD_WIN_FIRST) ? st->mad.w : MAD_WIN_FIRST;
+	/* nothing is clipped until the first estimate */
+	st->mad.lo = -FLT_MAX;
+	st->mad.hi = FLT_MAX;
+}
+
+/* k-th smallest element, the array is reordered */
+static float select_kth(float * a, int n, int k)
+{
+	int lo = 0;
+	int hi = n - 1;
+
+	while (lo < hi) {
+		float pivot = a[(lo + hi) / 2];
+		int i = lo;
+		int j = hi;
+
+		/* Hoare partition */
+		while (i <= j) {
+			while (a[i] < pivot)
+				i++;
+			while (a[j] > pivot)
+				j--;
+			if (i <= j) {
+				float t = a[i];
+				a[i++] = a[j];
+				a[j--] = t;
+			}
+		}
+
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
+
+	return a[k];
+}
+
+/* Estimate the median and the MAD of n samples */
+static void mad_update(struct filter_stage * st, const float * x,
+					   unsigned int n)
+{
+	float * tmp = st->mad.tmp;
+	float med;
+	float mad;
+	float lim;
+	unsigned int i;
+
+	memcpy(tmp, x, n * sizeof(float));
+	med = select_kth(tmp, n, n / 2);
+
+	for (i = 0; i < n; ++i)
+		tmp[i] = fabsf(x[i] - med);
+	mad = select_kth(tmp, n, n / 2);
+
+	/* 1.4826 * MAD estimates the standard deviation of normal noise. A
+	   flat signal has no outliers. */
+	lim = (mad > 0) ? st->mad.k * 1.4826f * mad : FLT_MAX;
+	st->mad.lo = med - lim;
+	st->mad.hi = med + lim;
+}
+
+static int mad_run(struct filter_stage * st, float * x, size_t len)
+{
+	unsigned int w = st->mad.w;
+	size_t cnt = len;
+	float lo;
+	float hi;
+	size_t n;
+	size_t i;
+
+	while (len > 0) {
+		/* samples until the next estimate */
+		n = st->mad.next - st->mad.cnt;
+		if (n > len)
+			n = len;
+
+		/* the estimate is made on the unclipped samples */
+		memcpy(&st->mad.win[st->mad.cnt], x, n * sizeof(float));
+
+		/* compares rather than fminf()/fmaxf(), whose NaN rules have
+		   no vector instruction; the samples come from integers */
+		lo = st->mad.lo;
+		hi = st->mad.hi;
+#pragma omp simd
+		for (i = 0; i < n; ++i) {
+			float v = (x[i] < lo) ? lo : x[i];
+			x[i] = (v > hi) ? hi : v;
+		}
+
+		st->mad.cnt += n;
+		if (st->mad.cnt == st->mad.next) {
+			mad_update(st, st->mad.win, st->mad.cnt);
+			/* The first window grows (64, 128, ... w samples), so the 
+			   beginning of the read is clipped early. The estimates are 
+			   made at the same samples whatever the chunk sizes. */
+			if (st->mad.next < w)
+				st->mad.next = (2 * st->mad.next < w) ? 2 * st->mad.next : w;
+			else
+				st->mad.cnt = 0;
+		}
+
+		x += n;
+		len -= n;
+	}
+
+	return cnt;
+}
+
+/* -------------------------------------------------------------------------
+ * Polyphase resampler
+ * ------------------------------------------------------------------------- */
+
+static int resample_init(struct filter_stage * st, int argc, double * argv)
+{
+	unsigned int taps;
+
+	if ((argc < 1) || !((argv[0] > 0) && (argv[0] <= DBL_MAX)) || 
+		(filter_arg_uint((argc > 1) ? argv[1] : 16, 1, RESAMPLE_TAPS_MAX, 
+						 &taps) < 0))
+		return -1;
+
+	memset(&st->resample, 0, sizeof(st->resample));
+	st->resample.rate = argv[0];
+	st->resample.taps = taps;
+
+	return 0;
+}
+
+static void resample_release(struct filter_stage * st)
+{
+	unsigned int i;
+
+	for (i = 0; i < RESAMPLE_BANK_MAX; ++i)
+		free(st->resample.cache[i].tap);
+	free(st->resample.buf);
+}
+
+static void resample_reset(struct filter_stage * st)
+{
+	st->resample.pos = 0;
+	st->resample.phase = 0;
+}
+
+/* Closest l/m to ratio with l <= RESAMPLE_L_MAX, from the continued 
+   fraction of the ratio */
+static void resample_ratio(double ratio, unsigned int * l, unsigned int * m)
+{
+	unsigned long p0 = 0;
+	unsigned long q0 = 1;
+	unsigned long p1 = 1;
+	unsigned long q1 = 0;
+	unsigned long p2;
+	unsigned long q2;
+	double x = ratio;
+	double a;
+	unsigned int i;
+
+	*l = 1;
+	*m = 1;
+
+	for (i = 0; i < 32; ++i) {
+		a = floor(x);
+		p2 = a * p1 + p0;
+		q2 = a * q1 + q0;
+		if ((p2 > RESAMPLE_L_MAX) || (q2 > RESAMPLE_M_MAX))
+			break;
+		if (p2 > 0) {
+			*l = p2;
+			*m = q2;
+		}
+		if ((x == a) || (fabs((double)p2 / q2 - ratio) < 1e-9 * ratio))
+			break;
+		p0 = p1;
+		q0 = q1;
+		p1 = p2;
+		q1 = q2;
+		x = 1 / (x - a);
+	}
+}
+
+/* Hamming windowed sinc prototype, cutoff at the lower of the two 
+   Nyquist frequencies, split in l phases. Each phase is normalized for 
+   unity gain at DC. When decimating the cutoff is lower, the taps per 
+   phase are scaled by m / l to keep the transition band. */
+static int resample_bank_init(struct resample_bank * bank, unsigned int l,
+							  unsigned int m, unsigned int taps)
+{
+	double fc = 0.5 / ((l > m) ? l : m);
+	unsigned int n;
+	double c;
+	unsigned int p;
+	unsigned int k;
+
+	if (m > l)
+		taps = taps * ((m + l - 1) / l);
+	if (taps > RESAMPLE_TAPS_MAX)
+		taps = RESAMPLE_TAPS_MAX;
+	taps = (taps + RESAMPLE_LANES - 1) & ~(RESAMPLE_LANES - 1);
+
+	n = l * taps;
+	c = (n - 1) / 2.0;
+
+	if ((bank->tap = malloc(n * sizeof(float))) == NULL)
+		return -1;
+
+	bank->l = l;
+	bank->m = m;
+	bank->taps = taps;
+
+	for (p = 0; p < l; ++p) {
+		float * tap = &bank->tap[p * taps];
+		double sum = 0;
+
+		/* tap k of phase p is the prototype's p + (taps - 1 - k) * l */
+		for (k = 0; k < taps; ++k) {
+			unsigned int i = p + (taps - 1 - k) * l;
+			double t = i - c;
+			double h;
+
+			h = (t == 0) ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t);
+			if (n > 1)
+				h *= 0.54 - 0.46 * cos(2 * M_PI * i / (n - 1));
+			tap[k] = h;
+			sum += h;
+		}
+
+		for (k = 0; k < taps; ++k)
+			tap[k] /= sum;
+	}
+
+	return 0;
+}
+
+static double resample_rate(struct filter_stage * st, double rate)
+{
+	struct resample_bank * bank;
+	unsigned int l;
+	unsigned int m;
+	unsigned int i;
+
+	st->resample.bank = NULL;
+
+	if ((rate <= 0) || (rate == st->resample.rate))
+		return rate;
+
+	resample_ratio(st->resample.rate / rate, &l, &m);
+	if (l == m)
+		return rate;
+
+	DBG(DBG_INFO, "%.1f -> %.1f Hz: %u/%u", rate, st->resample.rate, l, m);
+
+	/* reads of a run come at a few rates, their banks are kept */
+	for (i = 0; i < RESAMPLE_BANK_MAX; ++i) {
+		bank = &st->resample.cache[i];
+		if ((bank->tap != NULL) && (bank->l == l) && (bank->m == m)) {
+			st->resample.bank = bank;
+			return rate * l / m;
+		}
+	}
+
+	bank = &st->resample.cache[st->resample.next];
+	st->resample.next = (st->resample.next + 1) % RESAMPLE_BANK_MAX;
+	free(bank->tap);
+	bank->tap = NULL;
+	if (resample_bank_init(bank, l, m, st->resample.taps) < 0)
+		return rate;
+
+	st->resample.bank = bank;
+
+	return rate * l / m;
+}
+
+static size_t resample_len(struct filter_stage * st, size_t len)
+{
+	struct resample_bank * bank = st->resample.bank;
+
+	if (bank == NULL)
+		return len;
+
+	return ((uint64_t)len * bank->l + bank->m - 1) / bank->m + 1;
+}
+
+/* Dot product of n taps, n a multiple of RESAMPLE_LANES. The lanes are
+   independent sums, added in a fixed order at the end, the inner loop 
+   is vectorized without relaxing the floating point rules. */
+static inline float resample_dot(const float * restrict c, 
+								 const float * restrict x, unsigned int n)
+{
+	float acc[RESAMPLE_LANES];
+	unsigned int j;
+	unsigned int k;
+
+	for (j = 0; j < RESAMPLE_LANES; ++j)
+		acc[j] = 0;
+
+	for (k = 0; k < n; k += RESAMPLE_LANES) {
+		for (j = 0; j < RESAMPLE_LANES; ++j)
+			acc[j] += c[k + j] * x[k + j];
+	}
+
+	for (j = RESAMPLE_LANES / 2; j > 0; j /= 2) {
+		for (k = 0; k < j; ++k)
+			acc[k] += acc[k + j];
+	}
+
+	return acc[0];
+}
+
+static int resample_run(struct filter_stage * st, float * x, size_t len)
+{
+	struct resample_bank * bank = st->resample.bank;
+	unsigned int taps;
+	unsigned int h;
+	unsigned int phase;
+	unsigned int l;
+	unsigned int m;
+	size_t pos;
+	size_t cnt;
+	float * buf;
+	unsigned int k;
+
+	if ((bank == NULL) || (len == 0))
+		return len;
+
+	taps = bank->taps;
+	h = taps - 1;
+
+	if (h + len > st->resample.size) {
+		size_t size = h + len;
+
+		if ((buf = realloc(st->resample.buf, size * sizeof(float))) == NULL)
+			return -1;
+		st->resample.buf = buf;
+		st->resample.size = size;
+	}
+
+	buf = st->resample.buf;
+
+	if (!st->primed) {
+		for (k = 0; k < h; ++k)
+			buf[k] = x[0];
+		st->primed = true;
+	}
+
+	memcpy(&buf[h], x, len * sizeof(float));
+
+	/* Output sample j is at j * m / l input samples. Its phase selects 
+	   the taps, applied to the input samples up to pos (buf[pos + h]). 
+	   The input is in buf now, the chain sized x for the output. */
+	l = bank->l;
+	m = bank->m;
+	pos = st->resample.pos;
+	phase = st->resample.phase;
+	for (cnt = 0; pos < len; ++cnt) {
+		x[cnt] = resample_dot(&bank->tap[phase * taps], &buf[pos], taps);
+		phase += m;
+		pos += phase / l;
+		phase %= l;
+	}
+
+	st->resample.pos = pos - len;
+	st->resample.phase = phase;
+
+	memmove(buf, &buf[len], h * sizeof(float));
+
+	return cnt;
+}
+
+/* -------------------------------------------------------------------------
+ * Filter chain
+ * ------------------------------------------------------------------------- */
+
+static const struct filter_op filter_op_tab[] = {
+	{ "median", median_init, median_reset, median_run, NULL, NULL, NULL },
+	{ "iir", iir_init, iir_reset, iir_run, NULL, NULL, NULL },
+	{ "fir", fir_init, fir_reset, fir_run, fir_release, NULL, NULL },
+	{ "mad", mad_init, mad_reset, mad_run, mad_release, NULL, NULL },
+	{ "resample", resample_init, resample_reset, resample_run, 
+		resample_release, resample_rate, resample_len },
+};
+
+#define FILTER_OP_CNT (sizeof(filter_op_tab) / sizeof(struct filter_op))
+
+#define FILTER_ARG_MAX 4
+
+static int filter_stage_parse(struct filter_stage * st, char * spec)
+{
+	double argv[FILTER_ARG_MAX];
+	char * save;
+	char * name;
+	char * cp;
+	char * end;
+	int argc = 0;
+	unsigned int i;
+
+	if ((name = strtok_r(spec, ":", &save)) == NULL)
+		return -1;
+
+	while ((cp = strtok_r(NULL, ":", &save)) != NULL) {
+		if (argc == FILTER_ARG_MAX)
+			return -1;
+		argv[argc++] = strtod(cp, &end);
+		if ((end == cp) || (*end != '\0')) {
+			DBG(DBG_WARNING, "invalid parameter: \"%s\"", cp);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < FILTER_OP_CNT; ++i) {
+		if (strcmp(filter_op_tab[i].name, name) == 0) {
+			st->op = &filter_op_tab[i];
+			if (st->op->init(st, argc, argv) < 0) {
+				DBG(DBG_WARNING, "invalid \"%s\" parameters", name);
+				return -1;
+			}
+			return 0;
+		}
+	}
+
+	DBG(DBG_WARNING, "unknown filter: \"%s\"", name);
+
+	return -1;
+}
+
+struct fast5_filter * fast5_filter_new(const char * spec)
+{
+	char buf[FILTER_SPEC_MAX + 1];
+	struct fast5_filter * flt;
+	char * save;
+	char * cp;
+
+	assert(spec != NULL);
+
+	if (strlen(spec) > FILTER_SPEC_MAX)
+		return NULL;
+
+	strcpy(buf, spec);
+
+	if ((flt = calloc(1, sizeof(struct fast5_filter))) == NULL)
+		return NULL;
+
+	for (cp = strtok_r(buf, ",", &save); cp != NULL;
+		 cp = strtok_r(NULL, ",", &save)) {
+		if ((flt->cnt == FILTER_STAGE_MAX) ||
+			(filter_stage_parse(&flt->stage[flt->cnt], cp) < 0)) {
+			fast5_filter_free(flt);
+			return NULL;
+		}
+		flt->cnt++;
+	}
+
+	fast5_filter_reset(flt);
+
+	return flt;
+}
+
+int fast5_filter_free(struct fast5_filter * flt)
+{
+	struct filter_stage * st;
+	unsigned int i;
+
+	assert(flt != NULL);
+
+	for (i = 0; i < flt->cnt; ++i) {
+		st = &flt->stage[i];
+		if (st->op->release != NULL)
+			st->op->release(st);
+	}
+
+	if (flt->x != NULL)
+		free(flt->x);
+
+	free(flt);
+
+	return 0;
+}
+
+void fast5_filter_reset(struct fast5_filter * flt)
+{
+	struct filter_stage * st;
+	unsigned int i;
+
+	assert(flt != NULL);
+
+	for (i = 0; i < flt->cnt; ++i) {
+		st = &flt->stage[i];
+		st->primed = false;
+		st->op->reset(st);
+	}
+}
+
+double fast5_filter_rate(struct fast5_filter * flt, double rate)
+{
+	struct filter_stage * st;
+	unsigned int i;
+
+	assert(flt != NULL);
+
+	for (i = 0; i < flt->cnt; ++i) {
+		st = &flt->stage[i];
+		if (st->op->rate != NULL)
+			rate = st->op->rate(st, rate);
+	}
+
+	fast5_filter_reset(flt);
+
+	return rate;
+}
+
+size_t fast5_filter_len(struct fast5_filter * flt, size_t len)
+{
+	struct filter_stage * st;
+	unsigned int i;
+
+	assert(flt != NULL);
+
+	for (i = 0; i < flt->cnt; ++i) {
+		st = &flt->stage[i];
+		if (st->op->len != NULL)
+			len = st->op->len(st, len);
+	}
+
+	return len;
+}
+
+int fast5_filter_process(struct fast5_filter * flt, const int16_t * in, 
+						 size_t len, int16_t * out)
+{
+	struct filter_stage * st;
+	unsigned int i;
+	size_t size;
+	float * x;
+	size_t n;
+	int ret;
+
+	assert(flt != NULL);
+	assert(in != NULL);
+	assert(out != NULL);
+
+	/* room for the largest intermediate chunk, each stage gets the 
+	   output of the previous one */
+	size = len;
+	n = len;
+	for (i = 0; i < flt->cnt; ++i) {
+		st = &flt->stage[i];
+		if (st->op->len != NULL)
+			n = st->op->len(st, n);
+		if (n > size)
+			size = n;
+	}
+
+	if (size > flt->size) {
+		if ((x = realloc(flt->x, size * sizeof(float))) == NULL)
+			return -1;
+		flt->x = x;
+		flt->size = size;
+	}
+
+	x = flt->x;
+
+	/* The samples are converted once, all the stages run on the chunk
+	   while it is in the cache. */
+	for (n = 0; n < len; ++n)
+		x[n] = in[n];
+
+	for (i = 0; i < flt->cnt; ++i) {
+		st = &flt->stage[i];
+		if ((ret = st->op->run(st, x, len)) < 0)
+			return -1;
+		len = ret;
+	}
+
+	for (n = 0; n < len; ++n) {
+		float v = fminf(fmaxf(x[n], INT16_MIN), INT16_MAX);
+
+		out[n] = lrintf(v);
+	}
+
+	return len;
+}
+
+int fast5_filter_run(struct fast5_filter * flt, int16_t * buf, size_t len)
+{
+	assert(flt != NULL);
+	assert(buf != NULL);
+
+	/* in place, the chain must not add samples */
+	if (fast5_filter_len(flt, len) > len)
+		return -1;
+
+	return fast5_filter_process(flt, buf, len, buf);
+}
@@ -0,0 +1,520 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_index.c
+ * \brief     Read index of a run, by channel and time
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "fast5_index.h"
+
+#define INDEX_HDR_LEN 16
+#define INDEX_READ_LEN 32
+#define INDEX_PATH_MAX UINT16_MAX
+
+struct index_read {
+	uint32_t file;
+	uint32_t read;
+	uint32_t channel;
+	uint64_t start;
+	uint64_t duration;
+	/* latest end of the reads of the channel up to this one */
+	uint64_t end_max;
+};
+
+struct fast5_index {
+	/* file paths */
+	char ** path;
+	uint32_t nfiles;
+	uint32_t files_size;
+	struct index_read * read;
+	uint32_t nreads;
+	uint32_t reads_size;
+	/* reads sorted, end_max valid */
+	bool sorted;
+};
+
+static inline uint8_t * index_put_u16(uint8_t * p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	return p + 2;
+}
+
+static inline uint8_t * index_put_u32(uint8_t * p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+	return p + 4;
+}
+
+static inline uint8_t * index_put_u64(uint8_t * p, uint64_t v)
+{
+	p = index_put_u32(p, v);
+	return index_put_u32(p, v >> 32);
+}
+
+static inline uint16_t index_get_u16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t index_get_u32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t index_get_u64(const uint8_t * p)
+{
+	return index_get_u32(p) | ((uint64_t)index_get_u32(p + 4) << 32);
+}
+
+struct fast5_index * fast5_index_new(void)
+{
+	return (struct fast5_index *)calloc(1, sizeof(struct fast5_index));
+}
+
+int fast5_index_free(struct fast5_index * idx)
+{
+	uint32_t i;
+
+	assert(idx != NULL);
+
+	for (i = 0; i < idx->nfiles; ++i)
+		free(idx->path[i]);
+	free(idx->path);
+	free(idx->read);
+	free(idx);
+
+	return 0;
+}
+
+/* Index of a new file path */
+static int index_file_new(struct fast5_index * idx, const char * path)
+{
+	char ** tmp;
+	char * cp;
+
+	if (strlen(path) > INDEX_PATH_MAX) {
+		DBG(DBG_WARNING, "%s: path too long!", path);
+		return -1;
+	}
+
+	if (idx->nfiles == idx->files_size) {
+		uint32_t size = idx->files_size ? 2 * idx->files_size : 256;
+
+		if ((tmp = realloc(idx->path, size * sizeof(char *))) == NULL)
+			return -1;
+		idx->path = tmp;
+		idx->files_size = size;
+	}
+
+	if ((cp = strdup(path)) == NULL)
+		return -1;
+
+	idx->path[idx->nfiles] = cp;
+
+	return idx->nfiles++;
+}
+
+static struct index_read * index_read_new(struct fast5_index * idx)
+{
+	struct index_read * tmp;
+
+	if (idx->nreads == idx->reads_size) {
+		uint32_t size = idx->reads_size ? 2 * idx->reads_size : 1024;
+
+		if ((tmp = realloc(idx->read, size *
+						   sizeof(struct index_read))) == NULL)
+			return NULL;
+		idx->read = tmp;
+		idx->reads_size = size;
+	}
+
+	idx->sorted = false;
+
+	return &idx->read[idx->nreads++];
+}
+
+static int index_add(struct fast5_index * idx, int file, unsigned int read,
+					 const struct fast5_raw * raw,
+					 const struct fast5_channel_id * ch)
+{
+	struct index_read * r;
+
+	if ((r = index_read_new(idx)) == NULL)
+		return -1;
+
+	r->file = file;
+	r->read = read;
+	r->channel = strtoul(ch->channel_number, NULL, 10);
+	r->start = raw->start_time;
+	r->duration = raw->duration;
+
+	return 0;
+}
+
+int fast5_index_add(struct fast5_index * idx, const char * path,
+					unsigned int read, const struct fast5_raw * raw,
+					const struct fast5_channel_id * ch)
+{
+	int file;
+
+	assert(idx != NULL);
+	assert(path != NULL);
+	assert(raw != NULL);
+	assert(ch != NULL);
+
+	/* the reads of a file usually come in a row */
+	if ((idx->nfiles > 0) && (strcmp(idx->path[idx->nfiles - 1], path) == 0))
+		file = idx->nfiles - 1;
+	else if ((file = index_file_new(idx, path)) < 0)
+		return -1;
+
+	return index_add(idx, file, read, raw, ch);
+}
+
+int fast5_index_add_file(struct fast5_index * idx, struct fast5 * f5,
+						 const char * path)
+{
+	struct fast5_channel_id ch;
+	struct fast5_raw raw;
+	int file = -1;
+	int cnt;
+	int i;
+
+	assert(idx != NULL);
+	assert(f5 != NULL);
+	assert(path != NULL);
+
+	cnt = fast5_read_count(f5);
+	for (i = 0; i < cnt; ++i) {
+		/* only the attributes, the signal dataset is not opened */
+		if ((fast5_read_select(f5, i) < 0) ||
+			(fast5_raw_read_info_mask(f5, &raw, FAST5_F_DURATION |
+									  FAST5_F_START_TIME) < 0) ||
+			(fast5_channel_id(f5, &ch) < 0))
+			continue;
+
+		if ((file < 0) && ((file = index_file_new(idx, path)) < 0))
+			return -1;
+
+		if (index_add(idx, file, i, &raw, &ch) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int fast5_index_merge(struct fast5_index * dst,
+					  const struct fast5_index * src)
+{
+	struct index_read * r;
+	uint32_t base;
+	uint32_t i;
+
+	assert(dst != NULL);
+	assert(src != NULL);
+
+	base = dst->nfiles;
+	for (i = 0; i < src->nfiles; ++i) {
+		if (index_file_new(dst, src->path[i]) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < src->nreads; ++i) {
+		if ((r = index_read_new(dst)) == NULL)
+			return -1;
+		*r = src->read[i];
+		r->file += base;
+	}
+
+	return fast5_index_sort(dst);
+}
+
+size_t fast5_index_count(const struct fast5_index * idx)
+{
+	assert(idx != NULL);
+
+	return idx->nreads;
+}
+
+static int index_read_cmp(const void * a, const void * b)
+{
+	const struct index_read * ra = (const struct index_read *)a;
+	const struct index_read * rb = (const struct index_read *)b;
+
+	if (ra->channel != rb->channel)
+		return (ra->channel < rb->channel) ? -1 : 1;
+	if (ra->start != rb->start)
+		return (ra->start < rb->start) ? -1 : 1;
+	if (ra->file != rb->file)
+		return (ra->file < rb->file) ? -1 : 1;
+	if (ra->read != rb->read)
+		return (ra->read < rb->read) ? -1 : 1;
+	return 0;
+}
+
+int fast5_index_sort(struct fast5_index * idx)
+{
+	struct index_read * r;
+	uint64_t end_max = 0;
+	uint32_t i;
+
+	assert(idx != NULL);
+
+	if (idx->sorted)
+		return 0;
+
+	if (idx->nreads > 1)
+		qsort(idx->read, idx->nreads, sizeof(struct index_read),
+			  index_read_cmp);
+
+	for (i = 0; i < idx->nreads; ++i) {
+		r = &idx->read[i];
+		if ((i == 0) || (r->channel != idx->read[i - 1].channel))
+			end_max = 0;
+		if (r->start + r->duration > end_max)
+			end_max = r->start + r->duration;
+		r->end_max = end_max;
+	}
+
+	idx->sorted = true;
+
+	return 0;
+}
+
+int fast5_index_query(struct fast5_index * idx, unsigned int channel,
+					  uint64_t t0, uint64_t t1,
+					  struct fast5_index_hit * hit, unsigned int max)
+{
+	const struct index_read * r;
+	uint64_t end;
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t mid;
+	int cnt = 0;
+
+	assert(idx != NULL);
+	assert((hit != NULL) || (max == 0));
+
+	fast5_index_sort(idx);
+
+	/* first read of the channel */
+	lo = 0;
+	hi = idx->nreads;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (idx->read[mid].channel < channel)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* first read of the channel ending after t0, end_max grows along
+	   the channel */
+	hi = lo;
+	while ((hi < idx->nreads) && (idx->read[hi].channel == channel))
+		hi++;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (idx->read[mid].end_max <= t0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (r = &idx->read[lo]; r < &idx->read[idx->nreads]; ++r) {
+		if ((r->channel != channel) || (r->start >= t1))
+			break;
+
+		end = r->start + r->duration;
+		if (end <= t0)
+			continue;
+
+		if ((unsigned int)cnt < max) {
+			hit->path = idx->path[r->file];
+			hit->read = r->read;
+			hit->channel = r->channel;
+			hit->start = r->start;
+			hit->duration = r->duration;
+			hit->offset = (t0 > r->start) ? t0 - r->start : 0;
+			hit->count = ((t1 < end) ? t1 : end) - r->start - hit->offset;
+			hit++;
+		}
+		cnt++;
+	}
+
+	return cnt;
+}
+
+int fast5_index_hit_read(struct fast5 * f5,
+						 const struct fast5_index_hit * hit, int16_t * raw)
+{
+	struct fast5_dset * ds;
+	size_t len;
+	size_t cnt;
+	int ret;
+
+	assert(f5 != NULL);
+	assert(hit != NULL);
+	assert(raw != NULL);
+
+	if ((ret = fast5_read_select(f5, hit->read)) < 0)
+		return ret;
+
+	if ((ds = fast5_raw_open(f5)) == NULL)
+		return fast5_error();
+
+	/* the duration attribute may not match the signal length */
+	len = fast5_dset_length(ds);
+	cnt = 0;
+	if (hit->offset < len)
+		cnt = (hit->offset + hit->count > len) ? len - hit->offset :
+			hit->count;
+
+	ret = (cnt > 0) ? fast5_dset_read(ds, raw, hit->offset, cnt) : 0;
+	fast5_dset_close(ds);
+
+	return (ret < 0) ? ret : (int)cnt;
+}
+
+int fast5_index_save(struct fast5_index * idx, FILE * f)
+{
+	uint8_t buf[INDEX_READ_LEN];
+	const struct index_read * r;
+	uint8_t * p;
+	uint32_t i;
+	size_t n;
+
+	assert(idx != NULL);
+	assert(f != NULL);
+
+	fast5_index_sort(idx);
+
+	memcpy(buf, "F5IX", 4);
+	p = index_put_u16(buf + 4, FAST5_INDEX_VERSION);
+	p = index_put_u16(p, 0);
+	p = index_put_u32(p, idx->nfiles);
+	p = index_put_u32(p, idx->nreads);
+	if (fwrite(buf, 1, INDEX_HDR_LEN, f) != INDEX_HDR_LEN)
+		goto error;
+
+	for (i = 0; i < idx->nfiles; ++i) {
+		n = strlen(idx->path[i]);
+		index_put_u16(buf, n);
+		if ((fwrite(buf, 1, 2, f) != 2) ||
+			(fwrite(idx->path[i], 1, n, f) != n))
+			goto error;
+	}
+
+	for (i = 0; i < idx->nreads; ++i) {
+		r = &idx->read[i];
+		p = index_put_u32(buf, r->file);
+		p = index_put_u32(p, r->read);
+		p = index_put_u32(p, r->channel);
+		p = index_put_u32(p, 0);
+		p = index_put_u64(p, r->start);
+		p = index_put_u64(p, r->duration);
+		if (fwrite(buf, 1, INDEX_READ_LEN, f) != INDEX_READ_LEN)
+			goto error;
+	}
+
+	return 0;
+
+error:
+	DBG(DBG_WARNING, "write error!");
+	return -1;
+}
+
+struct fast5_index * fast5_index_load(FILE * f)
+{
+	uint8_t buf[INDEX_READ_LEN];
+	struct fast5_index * idx;
+	struct index_read * r;
+	char path[INDEX_PATH_MAX + 1];
+	uint32_t nfiles;
+	uint32_t nreads;
+	uint32_t i;
+	size_t n;
+
+	assert(f != NULL);
+
+	if ((fread(buf, 1, INDEX_HDR_LEN, f) != INDEX_HDR_LEN) ||
+		(memcmp(buf, "F5IX", 4) != 0) ||
+		(index_get_u16(buf + 4) != FAST5_INDEX_VERSION)) {
+		DBG(DBG_WARNING, "not a read index!");
+		return NULL;
+	}
+
+	nfiles = index_get_u32(buf + 8);
+	nreads = index_get_u32(buf + 12);
+
+	if ((idx = fast5_index_new()) == NULL)
+		return NULL;
+
+	for (i = 0; i < nfiles; ++i) {
+		if (fread(buf, 1, 2, f) != 2)
+			goto error;
+		n = index_get_u16(buf);
+		if (fread(path, 1, n, f) != n)
+			goto error;
+		path[n] = '\0';
+		if (index_file_new(idx, path) < 0)
+			goto error;
+	}
+
+	for (i = 0; i < nreads; ++i) {
+		if ((fread(buf, 1, INDEX_READ_LEN, f) != INDEX_READ_LEN) ||
+			((r = index_read_new(idx)) == NULL))
+			goto error;
+		r->file = index_get_u32(buf);
+		r->read = index_get_u32(buf + 4);
+		r->channel = index_get_u32(buf + 8);
+		r->start = index_get_u64(buf + 16);
+		r->duration = index_get_u64(buf + 24);
+		if (r->file >= nfiles)
+			goto error;
+	}
+
+	/* saved sorted, but end_max is not in the file */
+	fast5_index_sort(idx);
+
+	return idx;
+
+error:
+	DBG(DBG_WARNING, "truncated or corrupt read index!");
+	fast5_index_free(idx);
+	return NULL;
+}
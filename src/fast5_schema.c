@@ -0,0 +1,213 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_schema.c
+ * \brief     Attribute layout of the known file versions
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   The attributes of the read and channel groups are fixed for a given
+   "file_version". Each version has a schema: a list of descriptors per
+   group, with the attribute name, the selection mask bit, the memory
+   type and the destination in the info structure. fast5_attrs_read()
+   reads any of these lists into its structure, the memory types are
+   created once per process.
+
+   The schema of a file is the one of the highest version not newer
+   than the file's. Files with no "file_version" use the latest one.
+
+     0.5   event detection reads only, there is no /Raw group. The 
+           integer attributes are 64 bits, signed, the events start_time
+           is an integer.
+     0.6   raw reads added, the raw start_time is an unsigned 64 bits 
+           integer. Up to 1.0 (including the multi-read files written by
+           f5repack, with a channel_id group per read) the names do not 
+           change: duration and read_number became 32 bits unsigned and 
+           the events start_time a double, still counting samples from 
+           the start of the run, e.g. 572472.0 at 4000 Hz.
+
+   What a schema fixes is the names, memory types and destinations. The
+   file types are not part of it: each attribute is still opened by name
+   and H5Aread() converts from whatever type the file has, which is how
+   the two 0.6 and 1.0 layouts share a list. A missing attribute is 
+   skipped, the field keeps its zero. Fixed and variable length strings 
+   are read differently, the read_id is a fixed length string in all 
+   the versions, the channel_number a variable length one.
+*/
+
+#define __FAST5_I__
+
+#include "fast5-i.h"
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#define ATTR(S, NAME, FIELD, TYPE) { #NAME, (FIELD), (TYPE), \
+	offsetof(struct S, NAME), sizeof(((struct S *)0)->NAME) }
+
+#define ATTR_LIST(A) { (A), sizeof(A) / sizeof((A)[0]) }
+
+static const struct fast5_attr_desc fast5_raw_attrs[] = {
+	ATTR(fast5_raw, duration, FAST5_F_DURATION, FAST5_T_U32),
+	ATTR(fast5_raw, median_before, FAST5_F_MEDIAN_BEFORE, FAST5_T_F64),
+	ATTR(fast5_raw, read_id, FAST5_F_READ_ID, FAST5_T_STR),
+	ATTR(fast5_raw, read_number, FAST5_F_READ_NUMBER, FAST5_T_U32),
+	ATTR(fast5_raw, start_mux, FAST5_F_START_MUX, FAST5_T_I32),
+	ATTR(fast5_raw, start_time, FAST5_F_START_TIME, FAST5_T_U64),
+};
+
+static const struct fast5_attr_desc fast5_events_attrs[] = {
+	ATTR(fast5_events_info, duration, FAST5_F_DURATION, FAST5_T_U32),
+	ATTR(fast5_events_info, median_before, FAST5_F_MEDIAN_BEFORE,
+		 FAST5_T_F64),
+	ATTR(fast5_events_info, read_id, FAST5_F_READ_ID, FAST5_T_STR),
+	ATTR(fast5_events_info, read_number, FAST5_F_READ_NUMBER, FAST5_T_U32),
+	ATTR(fast5_events_info, scaling_used, FAST5_F_SCALING_USED,
+		 FAST5_T_I64),
+	ATTR(fast5_events_info, start_mux, FAST5_F_START_MUX, FAST5_T_I32),
+	ATTR(fast5_events_info, start_time, FAST5_F_START_TIME, FAST5_T_F64),
+};
+
+/* The channel_id attributes are always read */
+static const struct fast5_attr_desc fast5_channel_attrs[] = {
+	ATTR(fast5_channel_id, channel_number, FAST5_F_ALL, FAST5_T_VSTR),
+	ATTR(fast5_channel_id, digitisation, FAST5_F_ALL, FAST5_T_F64),
+	ATTR(fast5_channel_id, offset, FAST5_F_ALL, FAST5_T_F64),
+	ATTR(fast5_channel_id, range, FAST5_F_ALL, FAST5_T_F64),
+	ATTR(fast5_channel_id, sampling_rate, FAST5_F_ALL, FAST5_T_F64),
+};
+
+/* Known versions, in increasing order */
+static const struct fast5_schema fast5_schema_tab[] = {
+	{
+		.major = 0, .minor = 50,
+		.raw = { NULL, 0 },
+		.events = ATTR_LIST(fast5_events_attrs),
+		.channel_id = ATTR_LIST(fast5_channel_attrs)
+	},
+	{
+		/* also 1.0, the attribute names are the same */
+		.major = 0, .minor = 60,
+		.raw = ATTR_LIST(fast5_raw_attrs),
+		.events = ATTR_LIST(fast5_events_attrs),
+		.channel_id = ATTR_LIST(fast5_channel_attrs)
+	},
+};
+
+#define FAST5_SCHEMA_CNT (sizeof(fast5_schema_tab) / sizeof(fast5_schema_tab[0]))
+
+const struct fast5_schema * fast5_schema_lookup(unsigned int major,
+												unsigned int minor)
+{
+	unsigned int ver = major * 100 + minor;
+	unsigned int i;
+
+	/* the oldest schema also serves older versions */
+	for (i = FAST5_SCHEMA_CNT - 1; i > 0; --i) {
+		const struct fast5_schema * sc = &fast5_schema_tab[i];
+
+		if (sc->major * 100 + sc->minor <= ver)
+			break;
+	}
+
+	return &fast5_schema_tab[i];
+}
+
+const struct fast5_schema * fast5_schema_latest(void)
+{
+	return &fast5_schema_tab[FAST5_SCHEMA_CNT - 1];
+}
+
+/* Memory types by FAST5_T_xxx, created once. They are never released,
+   the calls are not accounted by the performance counters. */
+static hid_t fast5_mem_type[FAST5_T_CNT];
+static pthread_once_t fast5_mem_type_once = PTHREAD_ONCE_INIT;
+
+static void fast5_mem_type_init(void)
+{
+	hid_t type;
+
+	fast5_mem_type[FAST5_T_U32] = H5T_NATIVE_UINT32;
+	fast5_mem_type[FAST5_T_I32] = H5T_NATIVE_INT32;
+	fast5_mem_type[FAST5_T_U64] = H5T_NATIVE_UINT64;
+	fast5_mem_type[FAST5_T_I64] = H5T_NATIVE_INT64;
+	fast5_mem_type[FAST5_T_F64] = H5T_NATIVE_DOUBLE;
+
+	/* the only fixed length strings are the read ids */
+	type = (H5Tcopy)(H5T_C_S1);
+	H5Tset_size(type, FAST5_UUID_MAX);
+	fast5_mem_type[FAST5_T_STR] = type;
+
+	type = (H5Tcopy)(H5T_C_S1);
+	H5Tset_size(type, H5T_VARIABLE);
+	fast5_mem_type[FAST5_T_VSTR] = type;
+}
+
+int fast5_attrs_read(hid_t obj, const struct fast5_attr_list * lst,
+					 void * dst, unsigned int mask)
+{
+	const struct fast5_attr_desc * d;
+	uint8_t * p;
+	herr_t status;
+	hid_t attr;
+	unsigned int i;
+	char * s;
+
+	assert(lst != NULL);
+	assert(dst != NULL);
+
+	pthread_once(&fast5_mem_type_once, fast5_mem_type_init);
+
+	for (i = 0; i < lst->cnt; ++i) {
+		d = &lst->attr[i];
+		if ((mask & d->field) == 0)
+			continue;
+
+		if ((attr = H5Aopen(obj, d->name, H5P_DEFAULT)) < 0) {
+			DBG(DBG_INFO, "Can't read attribute: \"%s\"!", d->name);
+			continue;
+		}
+
+		p = (uint8_t *)dst + d->offset;
+		if (d->type == FAST5_T_VSTR) {
+			if ((status = H5Aread(attr, fast5_mem_type[d->type], &s)) >= 0) {
+				strncpy((char *)p, s, d->size - 1);
+				p[d->size - 1] = '\0';
+				H5free_memory(s);
+			}
+		} else {
+			status = H5Aread(attr, fast5_mem_type[d->type], p);
+			if (d->type == FAST5_T_STR)
+				p[d->size - 1] = '\0';
+		}
+		H5Aclose(attr);
+
+		if (status < 0)
+			DBG(DBG_WARNING, "Can't read attribute: \"%s\"!", d->name);
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,408 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_sniff.c
+ * \brief     FAST5 signature check, without the HDF5 library
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+/*
+   The check follows the HDF5 file format specification far enough to
+   find the root group object header and list its attribute messages:
+
+   - the superblock is at offset 0, 512, 1024, 2048... (after a user
+     block), versions 0 and 1 hold the root group symbol table entry,
+     versions 2 and 3 the root object header address;
+   - version 1 object headers are a prefix and a list of 8 bytes aligned
+     messages, version 2 ones start with "OHDR";
+   - continuation messages point to more message blocks ("OCHK" for
+     version 2).
+
+   Attributes kept in a dense storage (an attribute info message), as
+   well as anything that does not parse, give the benefit of the doubt
+   to the file, the HDF5 library then decides.
+*/
+
+#define __FAST5_I__
+
+#include "fast5-i.h"
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* bytes read at a time: the superblock, an object header block */
+#define SNIFF_BLK_SIZE 4096
+/* user block sizes tried */
+#define SNIFF_UBLK_MAX 65536
+/* object header continuation blocks followed */
+#define SNIFF_CONT_MAX 8
+
+#define MSG_ATTR 0x000c
+#define MSG_CONT 0x0010
+#define MSG_ATTR_INFO 0x0015
+
+#define SNIFF_FAST5 1
+#define SNIFF_MAYBE 0
+#define SNIFF_NOT -1
+
+static const uint8_t hdf5_sig[8] = { 0x89, 'H', 'D', 'F', '\r', '\n',
+	0x1a, '\n' };
+
+struct sniff {
+	/* either a file or a memory image */
+	int fd;
+	const uint8_t * mem;
+	uint64_t mem_len;
+	/* size of offsets and lengths */
+	unsigned int so;
+	unsigned int sl;
+	uint64_t base;
+	/* message blocks still to parse */
+	struct {
+		uint64_t addr;
+		uint64_t len;
+	} cont[SNIFF_CONT_MAX];
+	int ncont;
+	uint8_t buf[SNIFF_BLK_SIZE];
+};
+
+/* Read up to len bytes at offs, returns the byte count */
+static size_t sniff_read(struct sniff * sn, uint64_t offs, size_t len)
+{
+	ssize_t n;
+
+	if (len > SNIFF_BLK_SIZE)
+		len = SNIFF_BLK_SIZE;
+
+	if (sn->mem != NULL) {
+		if (offs >= sn->mem_len)
+			return 0;
+		if (len > sn->mem_len - offs)
+			len = sn->mem_len - offs;
+		memcpy(sn->buf, sn->mem + offs, len);
+		return len;
+	}
+
+	if ((n = pread(sn->fd, sn->buf, len, offs)) < 0)
+		return 0;
+
+	return n;
+}
+
+/* Little endian unsigned integer of n bytes */
+static uint64_t sniff_uint(const uint8_t * p, unsigned int n)
+{
+	uint64_t v = 0;
+
+	while (n-- > 0)
+		v = (v << 8) | p[n];
+
+	return v;
+}
+
+/* Check an attribute message for the "file_version" name */
+static bool sniff_attr(const uint8_t * p, size_t len)
+{
+	static const char name[] = "file_version";
+	size_t hdr;
+	size_t n;
+
+	if (len < 1)
+		return false;
+
+	/* version, flags, name size (including the NUL), datatype and 
+	   dataspace sizes, version 3 adds the name encoding */
+	hdr = (p[0] >= 3) ? 9 : 8;
+	if (len < hdr)
+		return false;
+
+	n = sniff_uint(p + 2, 2);
+	p += hdr;
+	len -= hdr;
+
+	return (n == sizeof(name)) && (len >= n) &&
+		(memcmp(p, name, sizeof(name)) == 0);
+}
+
+/* An attribute info message with a fractal heap address, the attributes
+   are not in the object header */
+static bool sniff_dense(struct sniff * sn, const uint8_t * p, size_t len)
+{
+	unsigned int i;
+	size_t hdr;
+
+	if (len < 2)
+		return true;
+
+	hdr = (p[1] & 1) ? 4 : 2;
+	if (len < hdr + sn->so)
+		return true;
+
+	for (i = 0; i < sn->so; ++i) {
+		if (p[hdr + i] != 0xff)
+			return true;
+	}
+
+	return false;
+}
+
+/* Queue a continuation block */
+static void sniff_cont(struct sniff * sn, const uint8_t * p, size_t len)
+{
+	if ((len < sn->so + sn->sl) || (sn->ncont == SNIFF_CONT_MAX))
+		return;
+
+	sn->cont[sn->ncont].addr = sniff_uint(p, sn->so);
+	sn->cont[sn->ncont].len = sniff_uint(p + sn->so, sn->sl);
+	sn->ncont++;
+}
+
+/* Scan a block of version 1 object header messages */
+static int sniff_msgs_v1(struct sniff * sn, const uint8_t * p, size_t len)
+{
+	unsigned int type;
+	size_t size;
+
+	while (len >= 8) {
+		type = sniff_uint(p, 2);
+		size = sniff_uint(p + 2, 2);
+		p += 8;
+		len -= 8;
+		if (size > len)
+			return SNIFF_MAYBE;
+
+		if ((type == MSG_ATTR) && sniff_attr(p, size))
+			return SNIFF_FAST5;
+		if ((type == MSG_ATTR_INFO) && sniff_dense(sn, p, size))
+			return SNIFF_MAYBE;
+		if (type == MSG_CONT)
+			sniff_cont(sn, p, size);
+
+		p += size;
+		len -= size;
+	}
+
+	return SNIFF_NOT;
+}
+
+/* Scan a block of version 2 object header messages */
+static int sniff_msgs_v2(struct sniff * sn, const uint8_t * p, size_t len,
+						 unsigned int flags)
+{
+	unsigned int hdr = (flags & (1 << 2)) ? 6 : 4;
+	unsigned int type;
+	size_t size;
+
+	while (len >= hdr) {
+		type = p[0];
+		size = sniff_uint(p + 1, 2);
+		p += hdr;
+		len -= hdr;
+		if (size > len)
+			return SNIFF_MAYBE;
+
+		if ((type == MSG_ATTR) && sniff_attr(p, size))
+			return SNIFF_FAST5;
+		if ((type == MSG_ATTR_INFO) && sniff_dense(sn, p, size))
+			return SNIFF_MAYBE;
+		if (type == MSG_CONT)
+			sniff_cont(sn, p, size);
+
+		p += size;
+		len -= size;
+	}
+
+	return SNIFF_NOT;
+}
+
+/* Look for the file_version attribute in the root object header */
+static int sniff_root(struct sniff * sn, uint64_t addr)
+{
+	unsigned int flags;
+	uint64_t size;
+	size_t n;
+	size_t hdr;
+	int ver;
+	int ret;
+	int i;
+
+	if ((n = sniff_read(sn, sn->base + addr, SNIFF_BLK_SIZE)) < 16)
+		return SNIFF_MAYBE;
+
+	if (memcmp(sn->buf, "OHDR", 4) == 0) {
+		ver = 2;
+		flags = sn->buf[5];
+		hdr = 6 + ((flags & (1 << 5)) ? 16 : 0) +
+			((flags & (1 << 4)) ? 4 : 0);
+		if (hdr + (1 << (flags & 3)) > n)
+			return SNIFF_MAYBE;
+		size = sniff_uint(&sn->buf[hdr], 1 << (flags & 3));
+		hdr += 1 << (flags & 3);
+		/* the messages, a checksum follows. The size comes from the 
+		   file, it can be anything. */
+		if (size > n - hdr)
+			return SNIFF_MAYBE;
+		ret = sniff_msgs_v2(sn, &sn->buf[hdr], size, flags);
+	} else if (sn->buf[0] == 1) {
+		ver = 1;
+		flags = 0;
+		size = sniff_uint(&sn->buf[8], 4);
+		if (size > n - 16)
+			return SNIFF_MAYBE;
+		ret = sniff_msgs_v1(sn, &sn->buf[16], size);
+	} else
+		return SNIFF_MAYBE;
+
+	/* continuation blocks, in the order they were found */
+	for (i = 0; (ret == SNIFF_NOT) && (i < sn->ncont); ++i) {
+		size = sn->cont[i].len;
+		if (size > SNIFF_BLK_SIZE)
+			return SNIFF_MAYBE;
+		if ((n = sniff_read(sn, sn->base + sn->cont[i].addr, size)) < size)
+			return SNIFF_MAYBE;
+
+		if (ver == 1) {
+			ret = sniff_msgs_v1(sn, sn->buf, size);
+		} else {
+			if ((size < 8) || (memcmp(sn->buf, "OCHK", 4) != 0))
+				return SNIFF_MAYBE;
+			ret = sniff_msgs_v2(sn, &sn->buf[4], size - 8, flags);
+		}
+	}
+
+	return ret;
+}
+
+static int sniff(struct sniff * sn)
+{
+	uint64_t offs;
+	uint64_t addr;
+	uint8_t * p;
+	size_t n;
+
+	sn->ncont = 0;
+
+	/* superblock signature, the user block size is a power of 2 */
+	for (offs = 0; offs <= SNIFF_UBLK_MAX; offs = offs ? 2 * offs : 512) {
+		if ((n = sniff_read(sn, offs, 64 + 4 * 8)) < 8)
+			return SNIFF_NOT;
+		if (memcmp(sn->buf, hdf5_sig, sizeof(hdf5_sig)) == 0)
+			break;
+	}
+
+	if (offs > SNIFF_UBLK_MAX)
+		return SNIFF_NOT;
+
+	p = sn->buf;
+	switch (p[8]) {
+	case 0:
+	case 1:
+		sn->so = p[13];
+		sn->sl = p[14];
+		/* base address, four addresses and the root symbol table
+		   entry's link name offset */
+		p += (p[8] == 0) ? 24 : 28;
+		if ((sn->so != 8) && (sn->so != 4))
+			return SNIFF_MAYBE;
+		if ((p - sn->buf) + 6 * sn->so > n)
+			return SNIFF_NOT;
+		sn->base = sniff_uint(p, sn->so);
+		addr = sniff_uint(p + 5 * sn->so, sn->so);
+		break;
+
+	case 2:
+	case 3:
+		sn->so = p[9];
+		sn->sl = p[10];
+		if ((sn->so != 8) && (sn->so != 4))
+			return SNIFF_MAYBE;
+		if (12 + 4 * sn->so > n)
+			return SNIFF_NOT;
+		sn->base = sniff_uint(p + 12, sn->so);
+		addr = sniff_uint(p + 12 + 3 * sn->so, sn->so);
+		break;
+
+	default:
+		/* a format newer than this code */
+		return SNIFF_MAYBE;
+	}
+
+	/* The addresses are relative to the base address, which is the
+	   superblock address unless the file was written otherwise. */
+	if ((sn->base == 0) && (offs != 0))
+		sn->base = offs;
+
+	return sniff_root(sn, addr);
+}
+
+int fast5_sniff(const char * path)
+{
+	struct sniff * sn;
+	int ret;
+
+	assert(path != NULL);
+
+	if ((sn = malloc(sizeof(struct sniff))) == NULL)
+		return FAST5_ERR(FAST5_ERR_NOMEM);
+
+	sn->mem = NULL;
+	if ((sn->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		free(sn);
+		return FAST5_ERR(FAST5_ERR_IO);
+	}
+
+	ret = sniff(sn);
+
+	close(sn->fd);
+	free(sn);
+
+	if (ret == SNIFF_NOT) {
+		DBG(DBG_INFO, "%s: not a FAST5 file", path);
+		return FAST5_ERR(FAST5_ERR_FORMAT);
+	}
+
+	return 0;
+}
+
+int fast5_sniff_mem(const void * buf, size_t len)
+{
+	struct sniff * sn;
+	int ret;
+
+	assert(buf != NULL);
+
+	if ((sn = malloc(sizeof(struct sniff))) == NULL)
+		return FAST5_ERR(FAST5_ERR_NOMEM);
+
+	sn->fd = -1;
+	sn->mem = (const uint8_t *)buf;
+	sn->mem_len = len;
+
+	ret = sniff(sn);
+
+	free(sn);
+
+	return (ret == SNIFF_NOT) ? FAST5_ERR(FAST5_ERR_FORMAT) : 0;
+}
+
@@ -0,0 +1,429 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_stats.c
+ * \brief     Run level statistics
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#include "debug.h"
+#include "fast5_stats.h"
+
+/* channels are numbered from 1 */
+#define STATS_CHAN_MAX 3072
+#define STATS_MUX_MAX 8
+/* yield over time, 10 minutes bins, 96 hours */
+#define STATS_TIME_BIN 600
+#define STATS_TIME_MAX 576
+/* lengths below 16 have their own bucket, then 8 buckets per octave */
+#define STATS_LEN_SUB_BITS 3
+#define STATS_LEN_BKT_MAX (16 + (64 - 4) * (1 << STATS_LEN_SUB_BITS))
+/* open pore current, 2 pA bins, 0 to 512 pA */
+#define STATS_PA_BIN 2
+#define STATS_PA_MAX 256
+
+struct fast5_stats {
+	unsigned int flags;
+	uint64_t files;
+	uint64_t reads;
+	uint64_t skipped;
+	uint64_t samples;
+	uint64_t min_length;
+	uint64_t max_length;
+	double sampling_rate;
+	double duration;
+	/* reads per channel and start mux */
+	uint32_t mux[STATS_CHAN_MAX][STATS_MUX_MAX];
+	/* reads and samples per time bin, by read start */
+	uint64_t time_reads[STATS_TIME_MAX];
+	uint64_t time_samples[STATS_TIME_MAX];
+	/* reads and samples per length bucket */
+	uint64_t len_reads[STATS_LEN_BKT_MAX];
+	uint64_t len_samples[STATS_LEN_BKT_MAX];
+	/* open pore current per channel */
+	uint32_t pa[STATS_CHAN_MAX][STATS_PA_MAX];
+};
+
+static unsigned int stats_len_bucket(uint64_t len)
+{
+	unsigned int e;
+
+	if (len < 16)
+		return len;
+
+	e = 63 - __builtin_clzll(len);
+
+	return 16 + ((e - 4) << STATS_LEN_SUB_BITS) +
+		((len >> (e - STATS_LEN_SUB_BITS)) & ((1 << STATS_LEN_SUB_BITS) - 1));
+}
+
+/* First length of a bucket */
+static uint64_t stats_len_low(unsigned int bkt)
+{
+	unsigned int e;
+	unsigned int sub;
+
+	if (bkt < 16)
+		return bkt;
+
+	e = ((bkt - 16) >> STATS_LEN_SUB_BITS) + 4;
+	sub = (bkt - 16) & ((1 << STATS_LEN_SUB_BITS) - 1);
+
+	return (uint64_t)((1 << STATS_LEN_SUB_BITS) + sub) <<
+		(e - STATS_LEN_SUB_BITS);
+}
+
+/* Middle of a bucket, the value reported for the lengths it holds */
+static uint64_t stats_len_mid(unsigned int bkt)
+{
+	uint64_t low = stats_len_low(bkt);
+
+	if (bkt < 16)
+		return low;
+
+	return low + (stats_len_low(bkt + 1) - low) / 2;
+}
+
+struct fast5_stats * fast5_stats_new(unsigned int flags)
+{
+	struct fast5_stats * st;
+
+	if (flags & FAST5_STATS_SHARED) {
+		/* anonymous mappings are zero filled */
+		st = mmap(NULL, sizeof(struct fast5_stats), PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (st == MAP_FAILED) {
+			DBG(DBG_WARNING, "mmap() failed!");
+			return NULL;
+		}
+	} else if ((st = calloc(1, sizeof(struct fast5_stats))) == NULL) {
+		return NULL;
+	}
+
+	st->flags = flags;
+	st->min_length = UINT64_MAX;
+
+	return st;
+}
+
+int fast5_stats_free(struct fast5_stats * st)
+{
+	assert(st != NULL);
+
+	if (st->flags & FAST5_STATS_SHARED)
+		munmap(st, sizeof(struct fast5_stats));
+	else
+		free(st);
+
+	return 0;
+}
+
+int fast5_stats_add(struct fast5_stats * st, const struct fast5_raw * raw,
+					const struct fast5_channel_id * ch)
+{
+	unsigned int chan;
+	unsigned int bkt;
+	double t;
+	long pa;
+
+	assert(st != NULL);
+	assert(raw != NULL);
+	assert(ch != NULL);
+
+	st->reads++;
+	st->samples += raw->length;
+	if (raw->length < st->min_length)
+		st->min_length = raw->length;
+	if (raw->length > st->max_length)
+		st->max_length = raw->length;
+
+	bkt = stats_len_bucket(raw->length);
+	st->len_reads[bkt]++;
+	st->len_samples[bkt] += raw->length;
+
+	if (ch->sampling_rate > 0) {
+		if (st->sampling_rate == 0)
+			st->sampling_rate = ch->sampling_rate;
+		t = raw->start_time / ch->sampling_rate;
+		if (t > st->duration)
+			st->duration = t;
+		bkt = t / STATS_TIME_BIN;
+		if (bkt >= STATS_TIME_MAX)
+			bkt = STATS_TIME_MAX - 1;
+		st->time_reads[bkt]++;
+		st->time_samples[bkt] += raw->length;
+	}
+
+	/* per channel tables */
+	chan = strtoul(ch->channel_number, NULL, 10);
+	if ((chan < 1) || (chan > STATS_CHAN_MAX))
+		return 0;
+
+	if ((raw->start_mux >= 0) && (raw->start_mux < STATS_MUX_MAX))
+		st->mux[chan - 1][raw->start_mux]++;
+
+	pa = raw->median_before / STATS_PA_BIN;
+	if (pa < 0)
+		pa = 0;
+	if (pa >= STATS_PA_MAX)
+		pa = STATS_PA_MAX - 1;
+	st->pa[chan - 1][pa]++;
+
+	return 0;
+}
+
+int fast5_stats_add_file(struct fast5_stats * st, struct fast5 * f5)
+{
+	struct fast5_channel_id ch;
+	struct fast5_raw raw;
+	int cnt;
+	int i;
+
+	assert(st != NULL);
+	assert(f5 != NULL);
+
+	st->files++;
+
+	cnt = fast5_read_count(f5);
+	for (i = 0; i < cnt; ++i) {
+		if ((fast5_read_select(f5, i) < 0) ||
+			(fast5_raw_read_info_mask(f5, &raw, FAST5_F_MEDIAN_BEFORE |
+									  FAST5_F_START_MUX |
+									  FAST5_F_START_TIME |
+									  FAST5_F_LENGTH) < 0) ||
+			(fast5_channel_id(f5, &ch) < 0)) {
+			st->skipped++;
+			continue;
+		}
+
+		fast5_stats_add(st, &raw, &ch);
+	}
+
+	return 0;
+}
+
+int fast5_stats_merge(struct fast5_stats * dst,
+					  const struct fast5_stats * src)
+{
+	unsigned int i;
+	unsigned int j;
+
+	assert(dst != NULL);
+	assert(src != NULL);
+
+	dst->files += src->files;
+	dst->reads += src->reads;
+	dst->skipped += src->skipped;
+	dst->samples += src->samples;
+	if (src->min_length < dst->min_length)
+		dst->min_length = src->min_length;
+	if (src->max_length > dst->max_length)
+		dst->max_length = src->max_length;
+	if (dst->sampling_rate == 0)
+		dst->sampling_rate = src->sampling_rate;
+	if (src->duration > dst->duration)
+		dst->duration = src->duration;
+
+	for (i = 0; i < STATS_TIME_MAX; ++i) {
+		dst->time_reads[i] += src->time_reads[i];
+		dst->time_samples[i] += src->time_samples[i];
+	}
+
+	for (i = 0; i < STATS_LEN_BKT_MAX; ++i) {
+		dst->len_reads[i] += src->len_reads[i];
+		dst->len_samples[i] += src->len_samples[i];
+	}
+
+	for (i = 0; i < STATS_CHAN_MAX; ++i) {
+		for (j = 0; j < STATS_MUX_MAX; ++j)
+			dst->mux[i][j] += src->mux[i][j];
+		for (j = 0; j < STATS_PA_MAX; ++j)
+			dst->pa[i][j] += src->pa[i][j];
+	}
+
+	return 0;
+}
+
+static uint64_t stats_chan_reads(const struct fast5_stats * st,
+								 unsigned int chan)
+{
+	uint64_t cnt = 0;
+	unsigned int j;
+
+	/* every read of the channel has a current bin, not all a mux */
+	for (j = 0; j < STATS_PA_MAX; ++j)
+		cnt += st->pa[chan][j];
+
+	return cnt;
+}
+
+int fast5_stats_summary(const struct fast5_stats * st,
+						struct fast5_stats_summary * sum)
+{
+	uint64_t acc;
+	unsigned int i;
+
+	assert(st != NULL);
+	assert(sum != NULL);
+
+	memset(sum, 0, sizeof(struct fast5_stats_summary));
+	sum->files = st->files;
+	sum->reads = st->reads;
+	sum->skipped = st->skipped;
+	sum->samples = st->samples;
+	sum->min_length = (st->reads > 0) ? st->min_length : 0;
+	sum->max_length = st->max_length;
+	sum->sampling_rate = st->sampling_rate;
+	sum->duration = st->duration;
+
+	if (st->reads > 0) {
+		/* median: half of the reads are in the buckets below */
+		for (i = 0, acc = 0; i < STATS_LEN_BKT_MAX; ++i) {
+			acc += st->len_reads[i];
+			if (2 * acc >= st->reads) {
+				sum->median_length = stats_len_mid(i);
+				break;
+			}
+		}
+		/* N50: half of the samples are in reads at least this long */
+		for (i = STATS_LEN_BKT_MAX, acc = 0; i > 0; --i) {
+			acc += st->len_samples[i - 1];
+			if (2 * acc >= st->samples) {
+				sum->n50_length = stats_len_mid(i - 1);
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < STATS_CHAN_MAX; ++i) {
+		if (stats_chan_reads(st, i) > 0)
+			sum->channels++;
+	}
+
+	return 0;
+}
+
+/* Median open pore current of a channel, in pA */
+static double stats_chan_pa(const struct fast5_stats * st, unsigned int chan,
+							uint64_t cnt)
+{
+	uint64_t acc = 0;
+	unsigned int i;
+
+	for (i = 0; i < STATS_PA_MAX; ++i) {
+		acc += st->pa[chan][i];
+		if (2 * acc >= cnt)
+			break;
+	}
+
+	return (i + 0.5) * STATS_PA_BIN;
+}
+
+int fast5_stats_report(const struct fast5_stats * st, FILE * f)
+{
+	struct fast5_stats_summary sum;
+	unsigned int nmux = 0;
+	unsigned int last;
+	uint64_t acc;
+	uint64_t cnt;
+	unsigned int i;
+	unsigned int j;
+
+	assert(st != NULL);
+	assert(f != NULL);
+
+	fast5_stats_summary(st, &sum);
+
+	fprintf(f, "          files: %" PRIu64 "\n", sum.files);
+	fprintf(f, "          reads: %" PRIu64 "\n", sum.reads);
+	fprintf(f, "        skipped: %" PRIu64 "\n", sum.skipped);
+	fprintf(f, "       channels: %u\n", sum.channels);
+	fprintf(f, "        samples: %" PRIu64 "\n", sum.samples);
+	fprintf(f, "  sampling_rate: %f\n", sum.sampling_rate);
+	fprintf(f, "       duration: %.1f s\n", sum.duration);
+	fprintf(f, "     min_length: %" PRIu64 "\n", sum.min_length);
+	fprintf(f, "     max_length: %" PRIu64 "\n", sum.max_length);
+	fprintf(f, "  median_length: %" PRIu64 "\n", sum.median_length);
+	fprintf(f, "     N50_length: %" PRIu64 "\n", sum.n50_length);
+
+	if (st->reads == 0)
+		return 0;
+
+	/* yield over time, up to the last non empty bin */
+	for (last = STATS_TIME_MAX; last > 0; --last) {
+		if (st->time_reads[last - 1] > 0)
+			break;
+	}
+	fprintf(f, "\n# %8s %10s %14s %14s\n", "time(h)", "reads", "samples",
+			"cumulative");
+	for (i = 0, acc = 0; i < last; ++i) {
+		acc += st->time_samples[i];
+		fprintf(f, "  %8.2f %10" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n",
+				(double)i * STATS_TIME_BIN / 3600, st->time_reads[i],
+				st->time_samples[i], acc);
+	}
+
+	/* length distribution, non empty buckets */
+	fprintf(f, "\n# %12s %12s %10s %14s\n", "length", "to", "reads",
+			"samples");
+	for (i = 0; i < STATS_LEN_BKT_MAX; ++i) {
+		if (st->len_reads[i] == 0)
+			continue;
+		fprintf(f, "  %12" PRIu64 " %12" PRIu64 " %10" PRIu64 " %14" PRIu64
+				"\n", stats_len_low(i), stats_len_low(i + 1) - 1,
+				st->len_reads[i], st->len_samples[i]);
+	}
+
+	/* channels, mux columns up to the last one used */
+	for (i = 0; i < STATS_CHAN_MAX; ++i) {
+		for (j = nmux; j < STATS_MUX_MAX; ++j) {
+			if (st->mux[i][j] > 0)
+				nmux = j + 1;
+		}
+	}
+	fprintf(f, "\n# %7s %8s %8s", "channel", "reads", "pA");
+	for (j = 0; j < nmux; ++j)
+		fprintf(f, "     mux%u", j);
+	fprintf(f, "\n");
+	for (i = 0; i < STATS_CHAN_MAX; ++i) {
+		if ((cnt = stats_chan_reads(st, i)) == 0)
+			continue;
+		fprintf(f, "  %7u %8" PRIu64 " %8.1f", i + 1, cnt,
+				stats_chan_pa(st, i, cnt));
+		for (j = 0; j < nmux; ++j)
+			fprintf(f, " %8u", st->mux[i][j]);
+		fprintf(f, "\n");
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,431 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      fast5_write.c
+ * \brief     FAST5 writer
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#define __FAST5_I__
+
+#define DEBUG_LEVEL DBG_TRACE
+#include "fast5-i.h"
+#include <assert.h>
+#include <string.h>
+#include <fast5.h>
+
+/* file_version written to the root group */
+#define FAST5_WR_VERSION 1.0
+
+/* Event detection reads group */
+#define FAST5_WR_EVENTS_DIR "/Analyses/EventDetection_000/Reads"
+
+/* -------------------------------------------------------------------------
+ * Attributes and groups helpers
+ * ------------------------------------------------------------------------- */
+
+/* Create and write a scalar attribute */
+static int fast5_attr_write(hid_t obj, const char * name, hid_t ftype,
+							hid_t mtype, const void * buf)
+{
+	herr_t status;
+	hid_t space;
+	hid_t attr;
+
+	space = H5Screate(H5S_SCALAR);
+	if ((attr = H5Acreate2(obj, name, ftype, space,
+						   H5P_DEFAULT, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't create attribute \"%s\"!", name);
+		H5Sclose(space);
+		return -1;
+	}
+
+	status = H5Awrite(attr, mtype, buf);
+	H5Aclose(attr);
+	H5Sclose(space);
+
+	return status;
+}
+
+/* Create and write a fixed length string attribute */
+static int fast5_attr_write_str(hid_t obj, const char * name,
+								const char * str)
+{
+	hid_t type;
+	int ret;
+
+	type = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type, strlen(str) + 1);
+	H5Tset_strpad(type, H5T_STR_NULLTERM);
+	ret = fast5_attr_write(obj, name, type, type, str);
+	H5Tclose(type);
+
+	return ret;
+}
+
+/* Create and write a variable length string attribute */
+static int fast5_attr_write_vstr(hid_t obj, const char * name,
+								 const char * str)
+{
+	hid_t type;
+	int ret;
+
+	type = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type, H5T_VARIABLE);
+	ret = fast5_attr_write(obj, name, type, type, &str);
+	H5Tclose(type);
+
+	return ret;
+}
+
+/* Create a group, along with any missing parent groups */
+static hid_t fast5_group_create(struct fast5 * f5, const char * path)
+{
+	hid_t lcpl;
+	hid_t group;
+
+	lcpl = H5Pcreate(H5P_LINK_CREATE);
+	H5Pset_create_intermediate_group(lcpl, 1);
+	if ((group = H5Gcreate2(f5->file, path, lcpl, H5P_DEFAULT,
+							H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't create group \"%s\"!", path);
+	}
+	H5Pclose(lcpl);
+
+	return group;
+}
+
+/* Remove the group of a read that failed to be written, so that the 
+   file holds no partial reads. Evaluates to the error. */
+static int fast5_read_drop(struct fast5 * f5, const char * path)
+{
+	DBG(DBG_WARNING, "Can't write \"%s\"!", path);
+	H5Ldelete(f5->file, path, H5P_DEFAULT);
+
+	return FAST5_ERR(FAST5_ERR_HDF5);
+}
+
+/* Dataset creation properties for len elements, according to the
+   writer options */
+static hid_t fast5_dcpl_create(struct fast5 * f5, size_t len)
+{
+	struct fast5_wr_opt * opt = &f5->wr_opt;
+	hsize_t chunk[1];
+	hid_t dcpl;
+
+	dcpl = H5Pcreate(H5P_DATASET_CREATE);
+
+	/* Empty datasets can't be chunked */
+	if ((opt->chunk == 0) || (len == 0))
+		return dcpl;
+
+	chunk[0] = (opt->chunk < len) ? opt->chunk : len;
+	H5Pset_chunk(dcpl, 1, chunk);
+
+	switch (opt->codec) {
+	case FAST5_CODEC_SHUFFLE_DEFLATE:
+		H5Pset_shuffle(dcpl);
+		/* fall through */
+	case FAST5_CODEC_DEFLATE:
+		H5Pset_deflate(dcpl, opt->level);
+		break;
+	}
+
+	return dcpl;
+}
+
+/* Create a one dimension dataset and write all of its elements */
+static int fast5_dset_write(struct fast5 * f5, hid_t loc, const char * name,
+							hid_t ftype, hid_t mtype, const void * buf,
+							size_t len)
+{
+	hsize_t dims[1];
+	herr_t status;
+	hid_t dataset;
+	hid_t space;
+	hid_t dcpl;
+
+	dims[0] = len;
+	space = H5Screate_simple(1, dims, NULL);
+	dcpl = fast5_dcpl_create(f5, len);
+
+	if ((dataset = H5Dcreate2(loc, name, ftype, space, H5P_DEFAULT,
+							  dcpl, H5P_DEFAULT)) < 0) {
+		DBG(DBG_WARNING, "Can't create dataset \"%s\"!", name);
+		H5Pclose(dcpl);
+		H5Sclose(space);
+		return -1;
+	}
+
+	status = (len > 0) ? H5Dwrite(dataset, mtype, H5S_ALL, H5S_ALL,
+								  H5P_DEFAULT, buf) : 0;
+
+	H5Dclose(dataset);
+	H5Pclose(dcpl);
+	H5Sclose(space);
+
+	return status;
+}
+
+/* -------------------------------------------------------------------------
+ * File
+ * ------------------------------------------------------------------------- */
+
+struct fast5 * fast5_create(const char * path,
+							const struct fast5_wr_opt * opt)
+{
+	struct fast5 * f5;
+	double ver = FAST5_WR_VERSION;
+	hid_t group;
+	hid_t fapl;
+	hid_t file;
+
+	assert(path != NULL);
+	assert(opt != NULL);
+
+	if ((opt->chunk == 0) && (opt->codec != FAST5_CODEC_NONE)) {
+		DBG(DBG_WARNING, "Compression requires chunked datasets!");
+		FAST5_ERR(FAST5_ERR_INVAL);
+		return NULL;
+	}
+
+	fapl = H5Pcreate(H5P_FILE_ACCESS);
+	/* Build the file image in memory and write it out on close */
+	if (opt->bufsize > 0)
+		H5Pset_fapl_core(fapl, opt->bufsize, 1);
+	/* Aggregate the small metadata blocks */
+	if (opt->meta_block > 0)
+		H5Pset_meta_block_size(fapl, opt->meta_block);
+
+	file = H5Fcreate(path, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+	H5Pclose(fapl);
+	if (file < 0) {
+		DBG(DBG_WARNING, "Can't create \"%s\"!", path);
+		FAST5_ERR(FAST5_ERR_HDF5);
+		return NULL;
+	}
+
+	if ((f5 = fast5_handle_alloc(file, path, 0)) == NULL)
+		return NULL;
+
+	f5->nreads = 0;
+	f5->wr_opt = *opt;
+	f5->info.version.major = ver;
+	f5->info.version.minor = (ver - f5->info.version.major) * 100;
+
+	if ((fast5_attr_write(file, "file_version", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &ver) < 0) ||
+		((group = fast5_group_create(f5, "/UniqueGlobalKey")) < 0)) {
+		H5Fclose(file);
+		free(f5);
+		FAST5_ERR(FAST5_ERR_HDF5);
+		return NULL;
+	}
+	H5Gclose(group);
+
+	/* The probe cache reflects what was written so far */
+	f5->probed = FAST5_GRP_VERSION | FAST5_GRP_UNIQUE_GLOBAL_KEY |
+		FAST5_GRP_ANALYSES | FAST5_GRP_SEQUENCES | FAST5_GRP_RAW;
+	f5->present = FAST5_GRP_VERSION | FAST5_GRP_UNIQUE_GLOBAL_KEY;
+
+	return f5;
+}
+
+/* -------------------------------------------------------------------------
+ * Raw signals
+ * ------------------------------------------------------------------------- */
+
+int fast5_raw_write(struct fast5 * f5, const struct fast5_raw * info,
+					const int16_t * raw, size_t len)
+{
+	char name[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+	int ret;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(info != NULL);
+	assert((raw != NULL) || (len == 0));
+
+	/* Read numbers are only unique within a channel, the group is named 
+	   after the position of the read in this file */
+	if (((ret = fast5_path(name, "Read_%u", f5->nreads)) < 0) ||
+		((ret = fast5_path(path, "/Raw/Reads/%s", name)) < 0))
+		return ret;
+
+	if ((group = fast5_group_create(f5, path)) < 0)
+		return FAST5_ERR(FAST5_ERR_HDF5);
+
+	if ((fast5_attr_write(group, "duration", H5T_STD_U32LE,
+						  H5T_NATIVE_UINT32, &info->duration) < 0) ||
+		(fast5_attr_write(group, "median_before", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->median_before) < 0) ||
+		(fast5_attr_write_str(group, "read_id", info->read_id) < 0) ||
+		(fast5_attr_write(group, "read_number", H5T_STD_U32LE,
+						  H5T_NATIVE_UINT32, &info->read_number) < 0) ||
+		(fast5_attr_write(group, "start_mux", H5T_STD_I32LE,
+						  H5T_NATIVE_INT32, &info->start_mux) < 0) ||
+		(fast5_attr_write(group, "start_time", H5T_STD_U64LE,
+						  H5T_NATIVE_UINT64, &info->start_time) < 0))
+		ret = -1;
+	else
+		ret = fast5_dset_write(f5, group, "Signal", H5T_STD_I16LE,
+							   H5T_NATIVE_INT16, raw, len);
+
+	H5Gclose(group);
+
+	if (ret < 0)
+		return fast5_read_drop(f5, path);
+
+	memcpy(f5->wr_read, name, FAST5_OBJ_PATH_MAX);
+	f5->present |= FAST5_GRP_RAW;
+	f5->nreads++;
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Events detection
+ * ------------------------------------------------------------------------- */
+
+int fast5_events_write(struct fast5 * f5,
+					   const struct fast5_events_info * info,
+					   const struct fast5_event * event, size_t len)
+{
+	char name[FAST5_OBJ_PATH_MAX];
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+	hid_t type;
+	int ret;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(info != NULL);
+	assert((event != NULL) || (len == 0));
+
+	/* The events of the last raw read go to a group of the same name, 
+	   in an events only file each call starts a new read */
+	if (f5->present & FAST5_GRP_RAW)
+		memcpy(name, f5->wr_read, FAST5_OBJ_PATH_MAX);
+	else if ((ret = fast5_path(name, "Read_%u", f5->nreads)) < 0)
+		return ret;
+
+	if ((ret = fast5_path(path, "%s/%s", FAST5_WR_EVENTS_DIR, name)) < 0)
+		return ret;
+
+	if (H5Lexists(f5->file, path, H5P_DEFAULT) > 0) {
+		DBG(DBG_WARNING, "Events of \"%s\" already written!", name);
+		return FAST5_ERR(FAST5_ERR_INVAL);
+	}
+
+	if ((group = fast5_group_create(f5, path)) < 0)
+		return FAST5_ERR(FAST5_ERR_HDF5);
+
+	if ((fast5_attr_write(group, "duration", H5T_STD_U32LE,
+						  H5T_NATIVE_UINT32, &info->duration) < 0) ||
+		(fast5_attr_write(group, "median_before", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->median_before) < 0) ||
+		(fast5_attr_write_str(group, "read_id", info->read_id) < 0) ||
+		(fast5_attr_write(group, "read_number", H5T_STD_U32LE,
+						  H5T_NATIVE_UINT32, &info->read_number) < 0) ||
+		(fast5_attr_write(group, "scaling_used", H5T_STD_I64LE,
+						  H5T_NATIVE_INT64, &info->scaling_used) < 0) ||
+		(fast5_attr_write(group, "start_mux", H5T_STD_I32LE,
+						  H5T_NATIVE_INT32, &info->start_mux) < 0) ||
+		(fast5_attr_write(group, "start_time", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->start_time) < 0))
+		ret = -1;
+	else {
+		type = fast5_event_type_create();
+		ret = fast5_dset_write(f5, group, "Events", type, type, event, len);
+		H5Tclose(type);
+	}
+
+	H5Gclose(group);
+
+	if (ret < 0)
+		return fast5_read_drop(f5, path);
+
+	f5->present |= FAST5_GRP_ANALYSES;
+	/* events only file */
+	if ((f5->present & FAST5_GRP_RAW) == 0) {
+		memcpy(f5->wr_read, name, FAST5_OBJ_PATH_MAX);
+		f5->nreads++;
+	}
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Channel
+ * ------------------------------------------------------------------------- */
+
+int fast5_channel_id_write(struct fast5 * f5,
+						   const struct fast5_channel_id * info)
+{
+	char path[FAST5_OBJ_PATH_MAX];
+	hid_t group;
+
+	assert(f5 != NULL);
+	assert(f5->file >= 0);
+	assert(info != NULL);
+
+	/* The first channel_id goes to /UniqueGlobalKey, as in a single read
+	   file. The following reads of a multi-read file get their own. */
+	if (H5Lexists(f5->file, "/UniqueGlobalKey/channel_id", H5P_DEFAULT) <= 0)
+		fast5_path(path, "/UniqueGlobalKey/channel_id");
+	else if (f5->wr_read[0] == '\0') {
+		DBG(DBG_WARNING, "channel_id already written!");
+		return FAST5_ERR(FAST5_ERR_INVAL);
+	} else if (f5->present & FAST5_GRP_RAW) {
+		if (fast5_path(path, "/Raw/Reads/%s/channel_id", f5->wr_read) < 0)
+			return FAST5_ERR(FAST5_ERR_NAME);
+	} else {
+		if (fast5_path(path, "%s/%s/channel_id", FAST5_WR_EVENTS_DIR, 
+					   f5->wr_read) < 0)
+			return FAST5_ERR(FAST5_ERR_NAME);
+	}
+
+	if ((group = fast5_group_create(f5, path)) < 0)
+		return FAST5_ERR(FAST5_ERR_HDF5);
+
+	if ((fast5_attr_write_vstr(group, "channel_number", 
+							   info->channel_number) < 0) ||
+		(fast5_attr_write(group, "digitisation", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->digitisation) < 0) ||
+		(fast5_attr_write(group, "offset", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->offset) < 0) ||
+		(fast5_attr_write(group, "range", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->range) < 0) ||
+		(fast5_attr_write(group, "sampling_rate", H5T_IEEE_F64LE,
+						  H5T_NATIVE_DOUBLE, &info->sampling_rate) < 0)) {
+		H5Gclose(group);
+		return fast5_read_drop(f5, path);
+	}
+
+	H5Gclose(group);
+
+	return 0;
+}
+
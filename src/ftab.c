@@ -0,0 +1,686 @@
+/*
+ * ftab - columnar table writer
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      ftab.c
+ * \brief     Columnar table writer
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "debug.h"
+#include "ftab.h"
+
+#define FTAB_HDR_LEN 16
+#define FTAB_COL_MAX 64
+#define FTAB_NAME_MAX 255
+
+struct ftab_col {
+	uint8_t type;
+	uint16_t size;
+	size_t offset;
+	char name[FTAB_NAME_MAX + 1];
+	/* values of the pending batch */
+	uint8_t * buf;
+};
+
+struct ftab_blk {
+	uint64_t offset;
+	uint64_t rows;
+};
+
+struct ftab
+{
+	FILE * f;
+	unsigned int fmt;
+	/* header written, no more columns */
+	bool started;
+	/* current write offset */
+	uint64_t offs;
+	uint64_t rows;
+	/* rows in the pending batch */
+	unsigned int cnt;
+	/* batch index */
+	struct ftab_blk * idx;
+	uint32_t idx_cnt;
+	uint32_t idx_size;
+	unsigned int ncols;
+	struct ftab_col col[FTAB_COL_MAX];
+};
+
+static const uint8_t ftab_pad[8];
+
+/* Value size of the numeric types, 0 for strings */
+static const uint8_t ftab_type_size[] = {
+	[FTAB_U8] = 1,
+	[FTAB_I32] = 4,
+	[FTAB_U32] = 4,
+	[FTAB_I64] = 8,
+	[FTAB_U64] = 8,
+	[FTAB_F64] = 8,
+	[FTAB_STR] = 0
+};
+
+static inline uint8_t * ftab_put_u16(uint8_t * p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	return p + 2;
+}
+
+static inline uint8_t * ftab_put_u32(uint8_t * p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+	return p + 4;
+}
+
+static inline uint8_t * ftab_put_u64(uint8_t * p, uint64_t v)
+{
+	p = ftab_put_u32(p, v);
+	return ftab_put_u32(p, v >> 32);
+}
+
+static inline uint16_t ftab_get_u16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t ftab_get_u32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t ftab_get_u64(const uint8_t * p)
+{
+	return ftab_get_u32(p) | ((uint64_t)ftab_get_u32(p + 4) << 32);
+}
+
+static int ftab_write(struct ftab * tab, const void * buf, size_t len)
+{
+	if (fwrite(buf, 1, len, tab->f) != len) {
+		DBG(DBG_WARNING, "write error!");
+		return -1;
+	}
+
+	tab->offs += len;
+
+	return 0;
+}
+
+/* Pad the output to a multiple of 8 bytes from base */
+static int ftab_align(struct ftab * tab, uint64_t base)
+{
+	size_t n = (8 - ((tab->offs - base) & 7)) & 7;
+
+	return n ? ftab_write(tab, ftab_pad, n) : 0;
+}
+
+struct ftab * ftab_create(const char * path, unsigned int fmt)
+{
+	struct ftab * tab;
+	FILE * f;
+
+	if (path != NULL) {
+		if ((f = fopen(path, "wb")) == NULL) {
+			return NULL;
+		};
+	} else
+		f = stdout;
+
+	if ((tab = (struct ftab *)calloc(1, sizeof(struct ftab))) == NULL) {
+		if (f != stdout)
+			fclose(f);
+		return NULL;
+	}
+
+	tab->f = f;
+	tab->fmt = fmt;
+
+	return tab;
+}
+
+int ftab_col_new(struct ftab * tab, const char * name, unsigned int type,
+				 size_t size, size_t offset)
+{
+	struct ftab_col * col;
+
+	assert(tab != NULL);
+	assert(name != NULL);
+
+	if (tab->started || (tab->ncols == FTAB_COL_MAX) ||
+		(type > FTAB_STR) || (size == 0) || (size > UINT16_MAX))
+		return -1;
+
+	/* the numbers are stored little-endian, their size is the type's */
+	if ((type != FTAB_STR) && (size != ftab_type_size[type]))
+		return -1;
+
+	col = &tab->col[tab->ncols];
+	col->type = type;
+	col->size = size;
+	col->offset = offset;
+	strncpy(col->name, name, FTAB_NAME_MAX);
+	col->name[FTAB_NAME_MAX] = '\0';
+
+	if ((tab->fmt == FTAB_FMT_BIN) &&
+		((col->buf = malloc((size_t)FTAB_BATCH_ROWS * size)) == NULL))
+		return -1;
+
+	return tab->ncols++;
+}
+
+static int ftab_hdr_write(struct ftab * tab)
+{
+	uint8_t buf[FTAB_HDR_LEN + FTAB_NAME_MAX];
+	struct ftab_col * col;
+	unsigned int i;
+	uint8_t * p;
+	size_t n;
+
+	tab->started = true;
+
+	if (tab->fmt == FTAB_FMT_TSV) {
+		for (i = 0; i < tab->ncols; ++i)
+			fprintf(tab->f, "%s%c", tab->col[i].name,
+					(i < tab->ncols - 1) ? '\t' : '\n');
+		return ferror(tab->f) ? -1 : 0;
+	}
+
+	memcpy(buf, "FTAB", 4);
+	p = ftab_put_u16(buf + 4, FTAB_VERSION);
+	p = ftab_put_u16(p, tab->ncols);
+	p = ftab_put_u32(p, FTAB_BATCH_ROWS);
+	p = ftab_put_u32(p, 0);
+	if (ftab_write(tab, buf, FTAB_HDR_LEN) < 0)
+		return -1;
+
+	for (i = 0; i < tab->ncols; ++i) {
+		col = &tab->col[i];
+		n = strlen(col->name);
+		buf[0] = col->type;
+		buf[1] = n;
+		ftab_put_u16(&buf[2], col->size);
+		memcpy(&buf[4], col->name, n);
+		if (ftab_write(tab, buf, 4 + n) < 0)
+			return -1;
+	}
+
+	return ftab_align(tab, 0);
+}
+
+/* Write the pending rows as a new batch */
+static int ftab_flush(struct ftab * tab)
+{
+	struct ftab_blk * blk;
+	uint8_t hdr[8];
+	uint64_t base;
+	unsigned int i;
+
+	if (tab->cnt == 0)
+		return 0;
+
+	if (tab->idx_cnt == tab->idx_size) {
+		uint32_t size = tab->idx_size ? 2 * tab->idx_size : 64;
+
+		if ((blk = realloc(tab->idx, size * sizeof(struct ftab_blk))) == NULL)
+			return -1;
+		tab->idx = blk;
+		tab->idx_size = size;
+	}
+
+	base = tab->offs;
+	blk = &tab->idx[tab->idx_cnt++];
+	blk->offset = base;
+	blk->rows = tab->cnt;
+
+	memcpy(hdr, "FTBB", 4);
+	ftab_put_u32(hdr + 4, tab->cnt);
+	if (ftab_write(tab, hdr, sizeof(hdr)) < 0)
+		return -1;
+
+	for (i = 0; i < tab->ncols; ++i) {
+		if ((ftab_write(tab, tab->col[i].buf,
+						(size_t)tab->cnt * tab->col[i].size) < 0) ||
+			(ftab_align(tab, base) < 0))
+			return -1;
+	}
+
+	tab->cnt = 0;
+
+	return 0;
+}
+
+/* Print one value of a row */
+static void ftab_tsv_put(FILE * f, const struct ftab_col * col,
+						 const uint8_t * p)
+{
+	union {
+		int32_t i32;
+		uint32_t u32;
+		int64_t i64;
+		uint64_t u64;
+		double f64;
+	} v;
+
+	if (col->type == FTAB_STR) {
+		fprintf(f, "%.*s", (int)col->size, (const char *)p);
+		return;
+	}
+
+	memcpy(&v, p, (col->size < sizeof(v)) ? col->size : sizeof(v));
+
+	switch (col->type) {
+	case FTAB_U8:
+		fprintf(f, "%u", *p);
+		break;
+	case FTAB_I32:
+		fprintf(f, "%" PRIi32, v.i32);
+		break;
+	case FTAB_U32:
+		fprintf(f, "%" PRIu32, v.u32);
+		break;
+	case FTAB_I64:
+		fprintf(f, "%" PRIi64, v.i64);
+		break;
+	case FTAB_U64:
+		fprintf(f, "%" PRIu64, v.u64);
+		break;
+	case FTAB_F64:
+		fprintf(f, "%.6f", v.f64);
+		break;
+	}
+}
+
+/* Copy n values of size bytes, stride bytes apart, to dst. The numbers
+   are converted from the host order to little-endian, on little-endian
+   hosts the stores below are plain copies. */
+static void ftab_gather(uint8_t * dst, const uint8_t * src, size_t stride,
+						const struct ftab_col * col, unsigned int n)
+{
+	size_t size = col->size;
+	uint32_t u32;
+	uint64_t u64;
+	unsigned int j;
+
+	switch (ftab_type_size[col->type]) {
+	case 4:
+		for (j = 0; j < n; ++j, src += stride, dst += 4) {
+			memcpy(&u32, src, 4);
+			ftab_put_u32(dst, u32);
+		}
+		break;
+	case 8:
+		for (j = 0; j < n; ++j, src += stride, dst += 8) {
+			memcpy(&u64, src, 8);
+			ftab_put_u64(dst, u64);
+		}
+		break;
+	default:
+		/* bytes and strings */
+		for (j = 0; j < n; ++j, src += stride, dst += size)
+			memcpy(dst, src, size);
+	}
+}
+
+int ftab_append(struct ftab * tab, const void * rows, size_t stride,
+				unsigned int cnt)
+{
+	const uint8_t * row = (const uint8_t *)rows;
+	struct ftab_col * col;
+	unsigned int n;
+	unsigned int i;
+	unsigned int j;
+
+	assert(tab != NULL);
+	assert((rows != NULL) || (cnt == 0));
+
+	if (!tab->started && (ftab_hdr_write(tab) < 0))
+		return -1;
+
+	tab->rows += cnt;
+
+	if (tab->fmt == FTAB_FMT_TSV) {
+		for (j = 0; j < cnt; ++j, row += stride) {
+			for (i = 0; i < tab->ncols; ++i) {
+				col = &tab->col[i];
+				ftab_tsv_put(tab->f, col, row + col->offset);
+				fputc((i < tab->ncols - 1) ? '\t' : '\n', tab->f);
+			}
+		}
+		return ferror(tab->f) ? -1 : 0;
+	}
+
+	while (cnt > 0) {
+		n = FTAB_BATCH_ROWS - tab->cnt;
+		if (n > cnt)
+			n = cnt;
+
+		/* gather the columns of n rows */
+		for (i = 0; i < tab->ncols; ++i) {
+			const uint8_t * src = row + tab->col[i].offset;
+			size_t size = tab->col[i].size;
+			uint8_t * dst;
+
+			col = &tab->col[i];
+			dst = col->buf + (size_t)tab->cnt * size;
+			ftab_gather(dst, src, stride, col, n);
+		}
+
+		tab->cnt += n;
+		row += (size_t)n * stride;
+		cnt -= n;
+
+		if ((tab->cnt == FTAB_BATCH_ROWS) && (ftab_flush(tab) < 0))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int ftab_trailer_write(struct ftab * tab)
+{
+	uint8_t buf[32];
+	uint64_t index;
+	unsigned int i;
+	uint8_t * p;
+
+	index = tab->offs;
+	p = ftab_put_u32(buf, tab->idx_cnt);
+	p = ftab_put_u32(p, 0);
+	if (ftab_write(tab, buf, p - buf) < 0)
+		return -1;
+
+	for (i = 0; i < tab->idx_cnt; ++i) {
+		p = ftab_put_u64(buf, tab->idx[i].offset);
+		p = ftab_put_u64(p, tab->idx[i].rows);
+		if (ftab_write(tab, buf, p - buf) < 0)
+			return -1;
+	}
+
+	p = ftab_put_u64(buf, index);
+	p = ftab_put_u64(p, tab->rows);
+	memcpy(p, "FTBI", 4);
+	p = ftab_put_u32(p + 4, tab->idx_cnt);
+
+	return ftab_write(tab, buf, p - buf);
+}
+
+int ftab_close(struct ftab * tab)
+{
+	int ret = 0;
+	unsigned int i;
+
+	assert(tab != NULL);
+	assert(tab->f != NULL);
+
+	/* a table with no rows still has its header */
+	if (!tab->started)
+		ret = ftab_hdr_write(tab);
+
+	if ((ret == 0) && (tab->fmt == FTAB_FMT_BIN)) {
+		ret = ftab_flush(tab);
+		if (ret == 0)
+			ret = ftab_trailer_write(tab);
+	}
+
+	DBG(DBG_INFO, "%" PRIu64 " rows, %u batches", tab->rows, tab->idx_cnt);
+
+	if (tab->f != stdout) {
+		if (fclose(tab->f) != 0)
+			ret = -1;
+	} else if (fflush(tab->f) != 0)
+		ret = -1;
+
+	for (i = 0; i < tab->ncols; ++i)
+		free(tab->col[i].buf);
+	free(tab->idx);
+	free(tab);
+
+	return ret;
+}
+
+
+/* -------------------------------------------------------------------------
+ * Reader
+ * ------------------------------------------------------------------------- */
+
+struct ftab_reader
+{
+	FILE * f;
+	uint64_t rows;
+	/* batch index */
+	struct ftab_blk * idx;
+	uint32_t idx_cnt;
+	unsigned int ncols;
+	struct ftab_col_info col[FTAB_COL_MAX];
+};
+
+int ftab_reader_close(struct ftab_reader * rd)
+{
+	assert(rd != NULL);
+
+	if (rd->f != NULL)
+		fclose(rd->f);
+	free(rd->idx);
+	free(rd);
+
+	return 0;
+}
+
+static int ftab_read_at(FILE * f, int64_t offs, void * buf, size_t len)
+{
+	if ((fseeko(f, offs, (offs < 0) ? SEEK_END : SEEK_SET) != 0) ||
+		(fread(buf, 1, len, f) != len))
+		return -1;
+
+	return 0;
+}
+
+struct ftab_reader * ftab_open(const char * path)
+{
+	uint8_t buf[FTAB_HDR_LEN + FTAB_NAME_MAX];
+	struct ftab_reader * rd;
+	struct ftab_col_info * col;
+	uint64_t index;
+	uint64_t rows;
+	uint32_t i;
+	size_t n;
+
+	assert(path != NULL);
+
+	if ((rd = (struct ftab_reader *)calloc(1, 
+							sizeof(struct ftab_reader))) == NULL)
+		return NULL;
+
+	if ((rd->f = fopen(path, "rb")) == NULL)
+		goto error;
+
+	if ((ftab_read_at(rd->f, 0, buf, FTAB_HDR_LEN) < 0) ||
+		(memcmp(buf, "FTAB", 4) != 0) ||
+		(ftab_get_u16(buf + 4) != FTAB_VERSION))
+		goto error;
+
+	rd->ncols = ftab_get_u16(buf + 6);
+	if (rd->ncols > FTAB_COL_MAX)
+		goto error;
+
+	for (i = 0; i < rd->ncols; ++i) {
+		col = &rd->col[i];
+		if (fread(buf, 1, 4, rd->f) != 4)
+			goto error;
+		col->type = buf[0];
+		col->size = ftab_get_u16(buf + 2);
+		n = buf[1];
+		if ((fread(col->name, 1, n, rd->f) != n) || (col->size == 0) ||
+			(col->type > FTAB_STR) || ((col->type != FTAB_STR) && 
+			 (col->size != ftab_type_size[col->type])))
+			goto error;
+		col->name[n] = '\0';
+	}
+
+	/* trailer: index offset, rows, magic and batch count */
+	if ((ftab_read_at(rd->f, -24, buf, 24) < 0) ||
+		(memcmp(buf + 16, "FTBI", 4) != 0))
+		goto error;
+	index = ftab_get_u64(buf);
+	rd->rows = ftab_get_u64(buf + 8);
+	rd->idx_cnt = ftab_get_u32(buf + 20);
+
+	if ((ftab_read_at(rd->f, index, buf, 8) < 0) ||
+		(ftab_get_u32(buf) != rd->idx_cnt))
+		goto error;
+
+	if ((rd->idx_cnt > 0) && ((rd->idx = malloc(rd->idx_cnt * 
+							sizeof(struct ftab_blk))) == NULL))
+		goto error;
+
+	for (i = 0, rows = 0; i < rd->idx_cnt; ++i) {
+		if (fread(buf, 1, 16, rd->f) != 16)
+			goto error;
+		rd->idx[i].offset = ftab_get_u64(buf);
+		rd->idx[i].rows = ftab_get_u64(buf + 8);
+		if ((rd->idx[i].rows > FTAB_BATCH_ROWS) || 
+			(rd->idx[i].offset >= index))
+			goto error;
+		rows += rd->idx[i].rows;
+	}
+
+	if (rows != rd->rows)
+		goto error;
+
+	return rd;
+
+error:
+	DBG(DBG_WARNING, "%s: not a table, or a truncated one!", path);
+	ftab_reader_close(rd);
+	return NULL;
+}
+
+unsigned int ftab_ncols(struct ftab_reader * rd)
+{
+	assert(rd != NULL);
+
+	return rd->ncols;
+}
+
+int ftab_col_info(struct ftab_reader * rd, unsigned int col,
+				  struct ftab_col_info * info)
+{
+	assert(rd != NULL);
+	assert(info != NULL);
+
+	if (col >= rd->ncols)
+		return -1;
+
+	memcpy(info, &rd->col[col], sizeof(struct ftab_col_info));
+
+	return 0;
+}
+
+int ftab_col_find(struct ftab_reader * rd, const char * name)
+{
+	unsigned int i;
+
+	assert(rd != NULL);
+	assert(name != NULL);
+
+	for (i = 0; i < rd->ncols; ++i) {
+		if (strcmp(rd->col[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+uint64_t ftab_rows(struct ftab_reader * rd)
+{
+	assert(rd != NULL);
+
+	return rd->rows;
+}
+
+unsigned int ftab_nbatches(struct ftab_reader * rd)
+{
+	assert(rd != NULL);
+
+	return rd->idx_cnt;
+}
+
+int ftab_batch_read(struct ftab_reader * rd, unsigned int batch,
+					unsigned int col, void * buf)
+{
+	uint8_t * p = (uint8_t *)buf;
+	uint64_t offs;
+	uint64_t rows;
+	uint32_t u32;
+	uint64_t u64;
+	uint8_t hdr[8];
+	unsigned int i;
+
+	assert(rd != NULL);
+	assert(buf != NULL);
+
+	if ((batch >= rd->idx_cnt) || (col >= rd->ncols))
+		return -1;
+
+	/* the columns before col, each padded to 8 bytes */
+	rows = rd->idx[batch].rows;
+	offs = 8;
+	for (i = 0; i < col; ++i)
+		offs = (offs + rows * rd->col[i].size + 7) & ~(uint64_t)7;
+
+	if ((ftab_read_at(rd->f, rd->idx[batch].offset, hdr, 8) < 0) ||
+		(memcmp(hdr, "FTBB", 4) != 0) || (ftab_get_u32(hdr + 4) != rows) ||
+		(ftab_read_at(rd->f, rd->idx[batch].offset + offs, buf, 
+					  rows * rd->col[col].size) < 0)) {
+		DBG(DBG_WARNING, "batch %u: read error!", batch);
+		return -1;
+	}
+
+	/* back to the host order */
+	switch (ftab_type_size[rd->col[col].type]) {
+	case 4:
+		for (i = 0; i < rows; ++i, p += 4) {
+			u32 = ftab_get_u32(p);
+			memcpy(p, &u32, 4);
+		}
+		break;
+	case 8:
+		for (i = 0; i < rows; ++i, p += 8) {
+			u64 = ftab_get_u64(p);
+			memcpy(p, &u64, 8);
+		}
+		break;
+	}
+
+	return rows;
+}
@@ -176,7 +176,7 @@ int vcd_var_append(struct vcd_var * var, void * data, unsigned int len)
 		allocsize = var->allocsize + datasize;
 		ptr = realloc(var->data, allocsize);
 		var->data  = ptr;
-		ptr += datasize;
+		ptr += var->allocsize;
 	}
 
 	var->length += len;
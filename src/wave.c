@@ -0,0 +1,363 @@
+/*
+ * wave - compact binary waveform encoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      wave.c
+ * \brief     Compact binary waveform encoder
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "debug.h"
+#include "wave.h"
+
+#define WAVE_HDR_LEN 32
+#define WAVE_BLK_HDR_LEN 20
+/* worst case size of a zig-zag varint encoded 16 bits delta */
+#define WAVE_VARINT_MAX 3
+
+struct wave_blk {
+	uint8_t var;
+	uint32_t count;
+	uint64_t start;
+	uint64_t offset;
+};
+
+struct wave_var
+{
+	struct wave * wv;
+	uint8_t type;
+	uint8_t sizeoftype;
+	uint8_t pos;
+	char name[30];
+	double period;
+	/* index of the first sample in the pending block */
+	uint64_t start;
+	/* number of samples in the pending block */
+	uint32_t cnt;
+	int16_t blk[WAVE_BLOCK_LEN];
+};
+
+#define WAVE_VAR_MAX 32
+
+struct wave
+{
+	FILE * f;
+	double timescale;
+	/* current write offset */
+	uint64_t offs;
+	unsigned int cnt;
+	/* block index */
+	struct wave_blk * idx;
+	uint32_t idx_cnt;
+	uint32_t idx_size;
+	/* block encoding buffer */
+	uint8_t buf[WAVE_BLK_HDR_LEN + WAVE_BLOCK_LEN * WAVE_VARINT_MAX];
+	struct wave_var var[WAVE_VAR_MAX];
+};
+
+static inline uint8_t * wave_put_u16(uint8_t * p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	return p + 2;
+}
+
+static inline uint8_t * wave_put_u32(uint8_t * p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+	return p + 4;
+}
+
+static inline uint8_t * wave_put_u64(uint8_t * p, uint64_t v)
+{
+	p = wave_put_u32(p, v);
+	return wave_put_u32(p, v >> 32);
+}
+
+static inline uint8_t * wave_put_double(uint8_t * p, double d)
+{
+	uint64_t v;
+
+	memcpy(&v, &d, sizeof(v));
+	return wave_put_u64(p, v);
+}
+
+static int wave_write(struct wave * wv, const void * buf, size_t len)
+{
+	if (fwrite(buf, 1, len, wv->f) != len) {
+		DBG(DBG_WARNING, "write error!");
+		return -1;
+	}
+
+	wv->offs += len;
+
+	return 0;
+}
+
+struct wave * wave_create(const char * path, double timescale)
+{
+	uint8_t hdr[WAVE_HDR_LEN];
+	struct wave * wv;
+	uint8_t * p;
+	FILE * f;
+
+	if (path != NULL) {
+		if ((f = fopen(path, "wb")) == NULL) {
+			return NULL;
+		};
+	} else
+		f = stdout;
+
+	if ((wv = (struct wave *)malloc(sizeof(struct wave))) == NULL) {
+		if (f != stdout)
+			fclose(f);
+		return NULL;
+	}
+
+	wv->f = f;
+	wv->timescale = timescale;
+	wv->offs = 0;
+	wv->cnt = 0;
+	wv->idx = NULL;
+	wv->idx_cnt = 0;
+	wv->idx_size = 0;
+
+	memcpy(hdr, "F5WV", 4);
+	p = wave_put_u16(hdr + 4, WAVE_VERSION);
+	p = wave_put_u16(p, WAVE_BLOCK_LEN);
+	p = wave_put_double(p, timescale);
+	p = wave_put_u64(p, (uint64_t)time(NULL));
+	p = wave_put_u64(p, 0);
+
+	if (wave_write(wv, hdr, WAVE_HDR_LEN) < 0) {
+		if (f != stdout)
+			fclose(f);
+		free(wv);
+		return NULL;
+	}
+
+	return wv;
+}
+
+struct wave_var * wave_var_new(struct wave * wv, const char * name,
+							 double rate)
+{
+	struct wave_var * var;
+	int pos;
+
+	pos = wv->cnt;
+	if (pos >= WAVE_VAR_MAX)
+		return NULL;
+
+	wv->cnt++;
+	var = &wv->var[pos];
+	var->wv = wv;
+	var->pos = pos;
+	var->type = 1;
+	var->sizeoftype = 2;
+
+	strncpy(var->name, name, sizeof(var->name) - 1);
+	var->name[sizeof(var->name) - 1] = '\0';
+	var->period = 1.0/rate;
+	var->start = 0;
+	var->cnt = 0;
+
+	return var;
+}
+
+/* Encode and write the pending samples of a variable as a new block */
+static int wave_var_flush(struct wave_var * var)
+{
+	struct wave * wv = var->wv;
+	struct wave_blk * blk;
+	int16_t prev;
+	uint8_t * p;
+	uint32_t i;
+
+	if (var->cnt == 0)
+		return 0;
+
+	if (wv->idx_cnt == wv->idx_size) {
+		uint32_t size = wv->idx_size ? 2 * wv->idx_size : 64;
+
+		if ((blk = realloc(wv->idx, size * sizeof(struct wave_blk))) == NULL)
+			return -1;
+		wv->idx = blk;
+		wv->idx_size = size;
+	}
+
+	blk = &wv->idx[wv->idx_cnt++];
+	blk->var = var->pos;
+	blk->count = var->cnt;
+	blk->start = var->start;
+	blk->offset = wv->offs;
+
+	/* delta encode the block, the first delta is taken against zero
+	   so that every block can be decoded on its own. */
+	p = wv->buf + WAVE_BLK_HDR_LEN;
+	prev = 0;
+	for (i = 0; i < var->cnt; ++i) {
+		int32_t d = (int32_t)var->blk[i] - prev;
+		uint32_t zz = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+
+		while (zz >= 0x80) {
+			*p++ = zz | 0x80;
+			zz >>= 7;
+		}
+		*p++ = zz;
+		prev = var->blk[i];
+	}
+
+	wv->buf[0] = var->pos;
+	wv->buf[1] = WAVE_ENC_DELTA_VARINT;
+	wave_put_u16(wv->buf + 2, 0);
+	wave_put_u32(wv->buf + 4, var->cnt);
+	wave_put_u64(wv->buf + 8, var->start);
+	wave_put_u32(wv->buf + 16, (p - wv->buf) - WAVE_BLK_HDR_LEN);
+
+	var->start += var->cnt;
+	var->cnt = 0;
+
+	return wave_write(wv, wv->buf, p - wv->buf);
+}
+
+int wave_var_append(struct wave_var * var, void * data, unsigned int len)
+{
+	int16_t * src = (int16_t *)data;
+	unsigned int n;
+
+	assert(var != NULL);
+	assert(data != NULL);
+
+	while (len > 0) {
+		n = WAVE_BLOCK_LEN - var->cnt;
+		if (n > len)
+			n = len;
+
+		memcpy(&var->blk[var->cnt], src, n * sizeof(int16_t));
+		var->cnt += n;
+		src += n;
+		len -= n;
+
+		if (var->cnt == WAVE_BLOCK_LEN) {
+			if (wave_var_flush(var) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int wave_trailer_write(struct wave * wv)
+{
+	uint8_t buf[64];
+	uint64_t vartab;
+	uint64_t index;
+	struct wave_var * var;
+	struct wave_blk * blk;
+	uint8_t * p;
+	unsigned int i;
+	size_t n;
+
+	vartab = wv->offs;
+	wave_put_u32(buf, wv->cnt);
+	if (wave_write(wv, buf, 4) < 0)
+		return -1;
+
+	for (i = 0; i < wv->cnt; ++i) {
+		var = &wv->var[i];
+		n = strlen(var->name);
+		buf[0] = var->pos;
+		buf[1] = var->sizeoftype;
+		buf[2] = n;
+		memcpy(&buf[3], var->name, n);
+		p = wave_put_double(&buf[3 + n], var->period);
+		if (wave_write(wv, buf, p - buf) < 0)
+			return -1;
+	}
+
+	index = wv->offs;
+	wave_put_u32(buf, wv->idx_cnt);
+	if (wave_write(wv, buf, 4) < 0)
+		return -1;
+
+	for (i = 0; i < wv->idx_cnt; ++i) {
+		blk = &wv->idx[i];
+		buf[0] = blk->var;
+		p = wave_put_u32(&buf[1], blk->count);
+		p = wave_put_u64(p, blk->start);
+		p = wave_put_u64(p, blk->offset);
+		if (wave_write(wv, buf, p - buf) < 0)
+			return -1;
+	}
+
+	p = wave_put_u64(buf, vartab);
+	p = wave_put_u64(p, index);
+	memcpy(p, "F5WI", 4);
+	p = wave_put_u32(p + 4, wv->idx_cnt);
+
+	return wave_write(wv, buf, p - buf);
+}
+
+int wave_close(struct wave * wv)
+{
+	int ret = 0;
+	int i;
+
+	assert(wv != NULL);
+	assert(wv->f != NULL);
+
+	/* flush partial blocks */
+	for (i = 0; i < wv->cnt; ++i) {
+		if (wave_var_flush(&wv->var[i]) < 0)
+			ret = -1;
+	}
+
+	if (ret == 0)
+		ret = wave_trailer_write(wv);
+
+	DBG(DBG_INFO, "%d blocks, %" PRIu64 " bytes", wv->idx_cnt, wv->offs);
+
+	if (wv->f != stdout)
+		fclose(wv->f);
+	else
+		fflush(wv->f);
+
+	if (wv->idx != NULL)
+		free(wv->idx);
+
+	free(wv);
+
+	return ret;
+}
+
@@ -0,0 +1,312 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      filter_test.c
+ * \brief     Raw signal filter chain checks
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fast5_filter.h"
+
+#define SIG_LEN 40000
+#define SIG_RATE 4000.0
+
+static int16_t sig[SIG_LEN];
+
+/* Run the whole signal through spec in chunks of chunk samples, the 
+   output is returned in out (malloc()ed) */
+static long filter(const char * spec, size_t chunk, int16_t ** out)
+{
+	struct fast5_filter * flt;
+	int16_t * buf;
+	int16_t * dst = NULL;
+	size_t size = 0;
+	size_t pos;
+	size_t cnt;
+	long tot = 0;
+	int n;
+
+	if ((flt = fast5_filter_new(spec)) == NULL)
+		return -1;
+
+	fast5_filter_rate(flt, SIG_RATE);
+	buf = malloc(fast5_filter_len(flt, chunk) * sizeof(int16_t));
+
+	for (pos = 0; pos < SIG_LEN; pos += cnt) {
+		cnt = (SIG_LEN - pos < chunk) ? SIG_LEN - pos : chunk;
+		if ((n = fast5_filter_process(flt, &sig[pos], cnt, buf)) < 0) {
+			tot = -1;
+			break;
+		}
+		if (tot + n > size) {
+			size = 2 * (tot + n);
+			dst = realloc(dst, size * sizeof(int16_t));
+		}
+		memcpy(&dst[tot], buf, n * sizeof(int16_t));
+		tot += n;
+	}
+
+	free(buf);
+	fast5_filter_free(flt);
+	*out = dst;
+
+	return tot;
+}
+
+/* Output length and independence from the chunk size */
+static int check(const char * spec, double rate)
+{
+	int16_t * a;
+	int16_t * b;
+	long na;
+	long nb;
+	long exp = lrint(SIG_LEN * rate / SIG_RATE);
+	int err = 0;
+
+	na = filter(spec, 16384, &a);
+	nb = filter(spec, 997, &b);
+
+	if ((na < 0) || (labs(na - exp) > 4)) {
+		fprintf(stderr, "%s: %ld samples, %ld expected\n", spec, na, exp);
+		err++;
+	} else if ((na != nb) || (memcmp(a, b, na * sizeof(int16_t)) != 0)) {
+		fprintf(stderr, "%s: output depends on the chunk size\n", spec);
+		err++;
+	}
+
+	free(a);
+	free(b);
+
+	return err;
+}
+
+/* Run len samples of in through spec in one chunk, out must hold 
+   fast5_filter_len() samples */
+static long run(const char * spec, const int16_t * in, size_t len, 
+				int16_t * out)
+{
+	struct fast5_filter * flt;
+	long n;
+
+	if ((flt = fast5_filter_new(spec)) == NULL)
+		return -1;
+
+	fast5_filter_rate(flt, SIG_RATE);
+	n = fast5_filter_process(flt, in, len, out);
+	fast5_filter_free(flt);
+
+	return n;
+}
+
+#define VAL_LEN 8192
+
+static int16_t in[VAL_LEN];
+static int16_t out[2 * VAL_LEN];
+
+/* A spike shorter than half the window doesn't get through the median */
+static int check_median(void)
+{
+	int i;
+
+	for (i = 0; i < VAL_LEN; ++i)
+		in[i] = 100;
+	in[500] = 5000;
+	in[501] = -5000;
+
+	if (run("median:5", in, VAL_LEN, out) != VAL_LEN)
+		return 1;
+
+	for (i = 0; i < VAL_LEN; ++i) {
+		if (out[i] != 100) {
+			fprintf(stderr, "median: %d at %d, 100 expected\n", out[i], i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* The taps are normalized for unity gain at DC */
+static int check_fir(void)
+{
+	int i;
+
+	for (i = 0; i < VAL_LEN; ++i)
+		in[i] = 1000;
+
+	if (run("fir:31:0.1", in, VAL_LEN, out) != VAL_LEN)
+		return 1;
+
+	for (i = 0; i < VAL_LEN; ++i) {
+		if (abs(out[i] - 1000) > 1) {
+			fprintf(stderr, "fir: %d at %d, 1000 expected\n", out[i], i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* An outlier is clipped to the median +- K * 1.4826 * MAD of the 
+   previous window, the other samples are left untouched */
+static int check_mad(void)
+{
+	unsigned int seed = 1;
+	int i;
+
+	/* uniform noise in [-50, 50], MAD 25: limits at about +-148 */
+	for (i = 0; i < VAL_LEN; ++i) {
+		seed = seed * 1103515245 + 12345;
+		in[i] = (int)((seed >> 16) % 101) - 50;
+	}
+	in[5000] = 10000;
+
+	if (run("mad:4:1024", in, VAL_LEN, out) != VAL_LEN)
+		return 1;
+
+	if ((out[5000] < 100) || (out[5000] > 200)) {
+		fprintf(stderr, "mad: outlier clipped to %d\n", out[5000]);
+		return 1;
+	}
+
+	for (i = 0; i < VAL_LEN; ++i) {
+		if ((i != 5000) && (out[i] != in[i])) {
+			fprintf(stderr, "mad: %d clipped to %d at %d\n", 
+					in[i], out[i], i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Step response of y += A * (x - y): 1 - (1 - A)^(n + 1) */
+static int check_iir(void)
+{
+	int i;
+
+	for (i = 0; i < VAL_LEN; ++i)
+		in[i] = (i < 100) ? 0 : 1000;
+
+	if (run("iir:0.25", in, VAL_LEN, out) != VAL_LEN)
+		return 1;
+
+	for (i = 0; i < VAL_LEN; ++i) {
+		long exp = (i < 100) ? 0 : 
+			lrint(1000 * (1 - pow(0.75, i - 100 + 1)));
+
+		if (labs(out[i] - exp) > 1) {
+			fprintf(stderr, "iir: %d at %d, %ld expected\n", 
+					out[i], i, exp);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* The 60 Hz tone keeps its amplitude and frequency at a lower rate */
+static int check_resample(void)
+{
+	int16_t * y;
+	long n;
+	int max = 0;
+	int cross = 0;
+	int i;
+
+	if ((n = filter("resample:1000", 16384, &y)) < 0)
+		return 1;
+
+	/* past the filter's transient, a whole number of cycles */
+	for (i = 100; i < 100 + 9000; ++i) {
+		if (abs(y[i]) > max)
+			max = abs(y[i]);
+		if ((y[i - 1] < 0) && (y[i] >= 0))
+			cross++;
+	}
+	free(y);
+
+	/* 9 s of 60 Hz */
+	if ((abs(max - 8000) > 80) || (abs(cross - 540) > 1)) {
+		fprintf(stderr, "resample: amplitude %d, %d cycles\n", max, cross);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Parameters out of range, not integers or NaN are rejected */
+static int check_invalid(void)
+{
+	static const char * const spec[] = {
+		"median:-1", "median:2.5", "median:1e30", "fir:-3", "fir:31:nan", 
+		"iir:nan", "mad:nan", "mad:4:-1", "resample:nan", 
+		"resample:1000:-2", "resample:1000:4294967296"
+	};
+	struct fast5_filter * flt;
+	int err = 0;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(spec) / sizeof(spec[0]); ++i) {
+		if ((flt = fast5_filter_new(spec[i])) != NULL) {
+			fprintf(stderr, "%s: accepted\n", spec[i]);
+			fast5_filter_free(flt);
+			err++;
+		}
+	}
+
+	return err;
+}
+
+int main(int argc, char ** argv)
+{
+	int err = 0;
+	int i;
+
+	for (i = 0; i < SIG_LEN; ++i)
+		sig[i] = lrint(8000 * sin(2 * M_PI * 60 * i / SIG_RATE));
+
+	/* output values of each stage */
+	err += check_median();
+	err += check_fir();
+	err += check_mad();
+	err += check_iir();
+	err += check_resample();
+	err += check_invalid();
+
+	err += check("median:5,fir:31:0.1", SIG_RATE);
+	err += check("mad:4:1024,iir:0.25", SIG_RATE);
+	err += check("resample:4000", 4000);
+	err += check("resample:3012", 3012);
+	err += check("resample:1000", 1000);
+	/* every stage gets the previous one's output length */
+	err += check("resample:8000,resample:16000", 16000);
+	err += check("resample:16000,fir:31:0.1,resample:2000", 2000);
+
+	return err ? 1 : 0;
+}
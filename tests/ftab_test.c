@@ -0,0 +1,194 @@
+/*
+ * fast5 - FAST5 decoder libary
+ *
+ * This file is part of libfast5.
+ *
+ * Ell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*!
+ * \file      ftab_test.c
+ * \brief     Columnar table write and read back checks
+ * \author    Bob Mittmann <bobmittmann@gmail.com>
+ * \copyright 2017, Bob Mittmann
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ftab.h"
+
+/* two full batches and a partial one */
+#define ROWS (2 * FTAB_BATCH_ROWS + 100)
+
+struct row {
+	char name[12];
+	uint8_t u8;
+	int32_t i32;
+	uint32_t u32;
+	int64_t i64;
+	uint64_t u64;
+	double f64;
+};
+
+#define COL(NAME, TYPE) { #NAME, TYPE, \
+	sizeof(((struct row *)0)->NAME), offsetof(struct row, NAME) }
+
+static const struct {
+	const char * name;
+	unsigned int type;
+	size_t size;
+	size_t offset;
+} cols[] = {
+	COL(name, FTAB_STR),
+	COL(u8, FTAB_U8),
+	COL(i32, FTAB_I32),
+	COL(u32, FTAB_U32),
+	COL(i64, FTAB_I64),
+	COL(u64, FTAB_U64),
+	COL(f64, FTAB_F64),
+};
+
+#define NCOLS (sizeof(cols) / sizeof(cols[0]))
+
+static void row_set(struct row * r, unsigned int i)
+{
+	memset(r, 0, sizeof(struct row));
+	snprintf(r->name, sizeof(r->name), "r%u", i);
+	r->u8 = i;
+	r->i32 = -(int32_t)i * 3;
+	r->u32 = 0x01020304 + i;
+	r->i64 = -(int64_t)i << 33;
+	r->u64 = 0x0102030405060708ULL + i;
+	r->f64 = i * 0.25;
+}
+
+int main(int argc, char ** argv)
+{
+	char path[] = "/tmp/ftab_testXXXXXX";
+	static struct row rows[ROWS];
+	struct ftab_reader * rd;
+	struct ftab_col_info info;
+	struct ftab * tab;
+	struct row r;
+	uint8_t * buf;
+	unsigned int b;
+	unsigned int c;
+	unsigned int i;
+	unsigned int pos;
+	int err = 0;
+	int n;
+	int fd;
+
+	if ((fd = mkstemp(path)) < 0)
+		return 1;
+	close(fd);
+
+	for (i = 0; i < ROWS; ++i)
+		row_set(&rows[i], i);
+
+	if ((tab = ftab_create(path, FTAB_FMT_BIN)) == NULL)
+		return 1;
+	for (c = 0; c < NCOLS; ++c) {
+		if (ftab_col_new(tab, cols[c].name, cols[c].type, cols[c].size, 
+						 cols[c].offset) < 0)
+			return 1;
+	}
+	/* a number column of the wrong size */
+	if (ftab_col_new(tab, "bad", FTAB_U32, 8, 0) >= 0) {
+		fprintf(stderr, "column of the wrong size accepted\n");
+		err++;
+	}
+	/* in two appends, across the batches */
+	if ((ftab_append(tab, rows, sizeof(struct row), 1000) < 0) ||
+		(ftab_append(tab, &rows[1000], sizeof(struct row), 
+					 ROWS - 1000) < 0) || (ftab_close(tab) < 0))
+		return 1;
+
+	if ((rd = ftab_open(path)) == NULL) {
+		fprintf(stderr, "can't read the table back\n");
+		unlink(path);
+		return 1;
+	}
+
+	if ((ftab_ncols(rd) != NCOLS) || (ftab_rows(rd) != ROWS) || 
+		(ftab_nbatches(rd) != 3) || (ftab_col_find(rd, "u64") != 5)) {
+		fprintf(stderr, "bad table layout\n");
+		err++;
+	}
+
+	buf = malloc((size_t)FTAB_BATCH_ROWS * sizeof(struct row));
+
+	for (c = 0; (err == 0) && (c < NCOLS); ++c) {
+		ftab_col_info(rd, c, &info);
+		if ((strcmp(info.name, cols[c].name) != 0) || 
+			(info.type != cols[c].type) || (info.size != cols[c].size)) {
+			fprintf(stderr, "column %u: bad info\n", c);
+			err++;
+			break;
+		}
+
+		for (b = 0, pos = 0; b < ftab_nbatches(rd); ++b, pos += n) {
+			if ((n = ftab_batch_read(rd, b, c, buf)) < 0) {
+				fprintf(stderr, "column %u, batch %u: read error\n", c, b);
+				err++;
+				break;
+			}
+			for (i = 0; i < n; ++i) {
+				row_set(&r, pos + i);
+				if (memcmp(buf + i * info.size, 
+						   (uint8_t *)&r + cols[c].offset, info.size) != 0) {
+					fprintf(stderr, "column %s, row %u: bad value\n", 
+							info.name, pos + i);
+					err++;
+					break;
+				}
+			}
+		}
+	}
+
+	free(buf);
+	ftab_reader_close(rd);
+
+	/* the numbers are little-endian whatever the host: the first u32 of
+	   the first batch, after the 16 bytes header, 7 column entries (4 
+	   bytes each and the names), padding, the batch header and the 
+	   name and u8 columns */
+	{
+		uint8_t v[4];
+		long offs = 16 + 7 * 4 + 4 + 2 + 3 + 3 + 3 + 3 + 3;
+		FILE * f = fopen(path, "rb");
+
+		offs = (offs + 7) & ~7L;
+		offs += 8 + ((12 * FTAB_BATCH_ROWS + 7) & ~7L) + 
+			((FTAB_BATCH_ROWS + 7) & ~7L) + 4 * FTAB_BATCH_ROWS;
+		if ((f == NULL) || (fseek(f, offs, SEEK_SET) != 0) ||
+			(fread(v, 1, 4, f) != 4) || (v[0] != 0x04) || (v[1] != 0x03) ||
+			(v[2] != 0x02) || (v[3] != 0x01)) {
+			fprintf(stderr, "u32 column not little-endian\n");
+			err++;
+		}
+		if (f != NULL)
+			fclose(f);
+	}
+
+	unlink(path);
+
+	return err ? 1 : 0;
+}